@@ -59,6 +59,60 @@ typedef struct
 /*}}}*/
 } PurpleAccountSetting;
 
+extern zval*
+phurple_object_map_get(void *ptr TSRMLS_DC);
+
+extern void*
+phurple_object_map_find(void *ptr TSRMLS_DC);
+
+extern void
+phurple_object_map_add(void *ptr, zval *obj TSRMLS_DC);
+
+extern void
+phurple_object_map_remove(void *ptr TSRMLS_DC);
+
+extern void
+phurple_object_map_release(void *ptr, void *obj TSRMLS_DC);
+
+extern void
+phurple_events_forget(void *ptr);
+
+extern void
+phurple_sendq_forget(PurpleAccount *account);
+
+extern int
+phurple_connq_push(PurpleAccount *account, const char *ui_id);
+
+extern void
+phurple_connq_forget(PurpleAccount *account);
+
+extern void
+phurple_reconnect_forget(PurpleAccount *account);
+
+extern void
+phurple_blist_tx_add(PurpleAccount *account, PurpleBuddy *buddy);
+
+extern void
+phurple_blist_tx_remove(PurpleAccount *account, PurpleBuddy *buddy, PurpleGroup *group);
+
+extern void
+phurple_blist_tx_forget(PurpleAccount *account);
+
+extern void
+phurple_blist_iterators_forget(PurpleAccount *account);
+
+extern void
+phurple_online_forget(PurpleAccount *account);
+
+extern void
+phurple_presence_forget(PurpleAccount *account);
+
+extern long
+phurple_online_count(PurpleAccount *account);
+
+extern void
+phurple_online_account_buddies(PurpleAccount *account, zval *ret TSRMLS_DC);
+
 #if PHURPLE_INTERNAL_DEBUG
 extern void phurple_dump_zval(zval *var);
 #endif
@@ -68,6 +122,8 @@ php_account_obj_destroy(void *obj TSRMLS_DC)
 {/*{{{*/
 	struct ze_account_obj *zao = (struct ze_account_obj *)obj;
 
+	phurple_object_map_release(zao->paccount, obj TSRMLS_CC);
+
 	zend_object_std_dtor(&zao->zo TSRMLS_CC);
 
 	/* IMPORTANT! don't destroy an account when object is destructing,
@@ -120,18 +176,55 @@ php_create_account_obj_zval(PurpleAccount *paccount TSRMLS_DC)
 	if (!paccount) {
 		ALLOC_INIT_ZVAL(ret);
 		ZVAL_NULL(ret);
-	} else {
+	} else if (NULL == (ret = phurple_object_map_get(paccount TSRMLS_CC))) {
 		ALLOC_ZVAL(ret);
 		object_init_ex(ret, PhurpleAccount_ce);
 		INIT_PZVAL(ret);
 
 		zao = (struct ze_account_obj *) zend_object_store_get_object(ret TSRMLS_CC);
 		zao->paccount = paccount;
+
+		phurple_object_map_add(paccount, ret TSRMLS_CC);
 	}
 
 	return ret;
 }/*}}}*/
 
+/* Detach the wrapper of an account being destroyed */
+static void
+phurple_account_invalidate(PurpleAccount *paccount)
+{/*{{{*/
+	struct ze_account_obj *zao;
+	TSRMLS_FETCH();
+
+	phurple_events_forget(paccount);
+	phurple_sendq_forget(paccount);
+	phurple_connq_forget(paccount);
+	phurple_reconnect_forget(paccount);
+	phurple_blist_tx_forget(paccount);
+	phurple_blist_iterators_forget(paccount);
+	phurple_online_forget(paccount);
+	phurple_presence_forget(paccount);
+
+	zao = (struct ze_account_obj *) phurple_object_map_find(paccount TSRMLS_CC);
+	if (zao) {
+		zao->paccount = NULL;
+		phurple_object_map_remove(paccount TSRMLS_CC);
+	}
+}/*}}}*/
+
+void
+phurple_account_signals_connect(void *handle)
+{/*{{{*/
+	purple_signal_connect_priority(purple_accounts_get_handle(),
+								   "account-destroying",
+								   handle,
+								   PURPLE_CALLBACK(phurple_account_invalidate),
+								   NULL,
+								   PURPLE_SIGNAL_PRIORITY_HIGHEST
+	);
+}/*}}}*/
+
 /*
 **
 **
@@ -161,6 +254,10 @@ PHP_METHOD(PhurpleAccount, __construct)
 	}
 
 	purple_accounts_add(zao->paccount);
+
+	if (!phurple_object_map_find(zao->paccount TSRMLS_CC)) {
+		phurple_object_map_add(zao->paccount, getThis() TSRMLS_CC);
+	}
 }
 /* }}} */
 
@@ -179,6 +276,11 @@ PHP_METHOD(PhurpleAccount, setPassword)
 
 	zao = (struct ze_account_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
 
+	if (NULL == zao->paccount) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The account is no longer available");
+		return;
+	}
+
 	purple_account_set_password(zao->paccount, password);
 }
 /* }}} */
@@ -197,12 +299,25 @@ PHP_METHOD(PhurpleAccount, setEnabled)
 	}
 
 	zao = (struct ze_account_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
+
+	if (NULL == zao->paccount) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The account is no longer available");
+		return;
+	}
 	
 #if PHP_MAJOR_VERSION == 5 && PHP_MINOR_VERSION < 4
 		ui_id = zend_std_get_static_property(PhurpleClient_ce, "ui_id", sizeof("ui_id")-1, 0 TSRMLS_CC);
 #else
 		ui_id = zend_std_get_static_property(PhurpleClient_ce, "ui_id", sizeof("ui_id")-1, 0, NULL TSRMLS_CC);
 #endif
+	if (!enabled) {
+		phurple_connq_forget(zao->paccount);
+		phurple_reconnect_forget(zao->paccount);
+	} else if (phurple_connq_push(zao->paccount, Z_STRVAL_PP(ui_id))) {
+		/* enabled once a connect slot is free */
+		return;
+	}
+
 	purple_account_set_enabled(zao->paccount, Z_STRVAL_PP(ui_id), (gboolean) enabled);
 }
 /* }}} */
@@ -223,8 +338,17 @@ PHP_METHOD(PhurpleAccount, addBuddy)
 	zao = (struct ze_account_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
 	zbo = (struct ze_buddy_obj *) zend_object_store_get_object(buddy TSRMLS_CC);
 
+	if (NULL == zao->paccount) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The account is no longer available");
+		return;
+	}
+	if (NULL == zbo->pbuddy) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The buddy is no longer available");
+		return;
+	}
+
 	purple_blist_add_buddy(zbo->pbuddy, NULL, NULL, NULL);
-	purple_account_add_buddy(zao->paccount, zbo->pbuddy);
+	phurple_blist_tx_add(zao->paccount, zbo->pbuddy);
 
 	RETURN_TRUE;
 }
@@ -245,7 +369,16 @@ PHP_METHOD(PhurpleAccount, removeBuddy)
 	zao = (struct ze_account_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
 	zbo = (struct ze_buddy_obj *) zend_object_store_get_object(buddy TSRMLS_CC);
 
-	purple_account_remove_buddy(zao->paccount, zbo->pbuddy, purple_buddy_get_group(zbo->pbuddy));
+	if (NULL == zao->paccount) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The account is no longer available");
+		return;
+	}
+	if (NULL == zbo->pbuddy) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The buddy is no longer available");
+		return;
+	}
+
+	phurple_blist_tx_remove(zao->paccount, zbo->pbuddy, purple_buddy_get_group(zbo->pbuddy));
 
 	RETURN_TRUE;
 }
@@ -263,6 +396,12 @@ PHP_METHOD(PhurpleAccount, clearSettings)
 	}
 
 	zao = (struct ze_account_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
+
+	if (NULL == zao->paccount) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The account is no longer available");
+		return;
+	}
+
 	purple_account_clear_settings(zao->paccount);
 
 	RETURN_TRUE;
@@ -290,6 +429,11 @@ PHP_METHOD(PhurpleAccount, set)
 	}
 	
 	zao = (struct ze_account_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
+
+	if (NULL == zao->paccount) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The account is no longer available");
+		return;
+	}
 	
 	switch (Z_TYPE_P(value)) {
 		case IS_BOOL:
@@ -341,6 +485,11 @@ PHP_METHOD(PhurpleAccount, get)
 
 	zao = (struct ze_account_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
 
+	if (NULL == zao->paccount) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The account is no longer available");
+		return;
+	}
+
 	if((table = g_hash_table_lookup(zao->paccount->ui_settings, Z_STRVAL_PP(ui_id))) == NULL) {
 		RETURN_NULL();
 	}
@@ -380,6 +529,11 @@ PHP_METHOD(PhurpleAccount, isConnected)
 	}
 	
 	zao = (struct ze_account_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
+
+	if (NULL == zao->paccount) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The account is no longer available");
+		return;
+	}
 	
 	RETVAL_BOOL((long) purple_account_is_connected(zao->paccount));
 }
@@ -397,6 +551,11 @@ PHP_METHOD(PhurpleAccount, isConnecting)
 	}
 	
 	zao = (struct ze_account_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
+
+	if (NULL == zao->paccount) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The account is no longer available");
+		return;
+	}
 	
 	RETVAL_BOOL((long) purple_account_is_connecting(zao->paccount));
 }
@@ -418,6 +577,11 @@ PHP_METHOD(PhurpleAccount, getUserName)
 
 	zao = (struct ze_account_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
 
+	if (NULL == zao->paccount) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The account is no longer available");
+		return;
+	}
+
 	RETURN_STRING(purple_account_get_username(zao->paccount), 1);
 }
 /* }}} */
@@ -438,6 +602,11 @@ PHP_METHOD(PhurpleAccount, getPassword)
 
 	zao = (struct ze_account_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
 
+	if (NULL == zao->paccount) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The account is no longer available");
+		return;
+	}
+
 	RETURN_STRING(purple_account_get_password(zao->paccount), 1);
 }
 /* }}} */
@@ -459,6 +628,11 @@ PHP_METHOD(PhurpleAccount, getPresence)
 	}
 
 	zao = (struct ze_account_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
+
+	if (NULL == zao->paccount) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The account is no longer available");
+		return;
+	}
 	
 	if(NULL != zao->paccount) {
 		ppresence = purple_account_get_presence(zao->paccount);
@@ -488,6 +662,11 @@ PHP_METHOD(PhurpleAccount, setStatus)
 
 	zao = (struct ze_account_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
 
+	if (NULL == zao->paccount) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The account is no longer available");
+		return;
+	}
+
 	if(NULL != zao->paccount) {
 		const char *id = purple_primitive_get_id_from_type((PurpleStatusPrimitive)status);
 		if (id) {
@@ -508,6 +687,11 @@ PHP_METHOD(PhurpleAccount, connect)
 	}
 
 	zao = (struct ze_account_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
+
+	if (NULL == zao->paccount) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The account is no longer available");
+		return;
+	}
 	
 	purple_account_connect(zao->paccount);
 }
@@ -524,6 +708,11 @@ PHP_METHOD(PhurpleAccount, disconnect)
 	}
 
 	zao = (struct ze_account_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
+
+	if (NULL == zao->paccount) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The account is no longer available");
+		return;
+	}
 	
 	purple_account_disconnect(zao->paccount);
 }
@@ -542,6 +731,11 @@ PHP_METHOD(PhurpleAccount, isDisconnecting)
 
 	zao = (struct ze_account_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
 
+	if (NULL == zao->paccount) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The account is no longer available");
+		return;
+	}
+
 	RETVAL_BOOL((long) purple_account_is_disconnecting(zao->paccount));
 }
 /* }}} */
@@ -559,10 +753,59 @@ PHP_METHOD(PhurpleAccount, isDisconnected)
 
 	zao = (struct ze_account_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
 
+	if (NULL == zao->paccount) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The account is no longer available");
+		return;
+	}
+
 	RETVAL_BOOL((long) purple_account_is_disconnected(zao->paccount));
 }
 /* }}} */
 
+
+/* {{{ proto array PhurpleAccount::getOnlineBuddies(void)
+	Returns the buddies of the account which are online, from an index kept up to date by the blist signals */
+PHP_METHOD(PhurpleAccount, getOnlineBuddies)
+{
+	struct ze_account_obj *zao;
+
+	if (zend_parse_parameters_none() == FAILURE) {
+		return;
+	}
+
+	zao = (struct ze_account_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
+
+	if (NULL == zao->paccount) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The account is no longer available");
+		return;
+	}
+
+	phurple_online_account_buddies(zao->paccount, return_value TSRMLS_CC);
+}
+/* }}} */
+
+
+/* {{{ proto int PhurpleAccount::getOnlineCount(void)
+	Returns the number of the online buddies of the account in constant time */
+PHP_METHOD(PhurpleAccount, getOnlineCount)
+{
+	struct ze_account_obj *zao;
+
+	if (zend_parse_parameters_none() == FAILURE) {
+		return;
+	}
+
+	zao = (struct ze_account_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
+
+	if (NULL == zao->paccount) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The account is no longer available");
+		return;
+	}
+
+	RETURN_LONG(phurple_online_count(zao->paccount));
+}
+/* }}} */
+
 /*
 **
 **
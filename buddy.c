@@ -39,6 +39,21 @@ php_create_group_obj_zval(PurpleGroup *pgroup TSRMLS_DC);
 extern zval *
 php_create_account_obj_zval(PurpleAccount *paccount TSRMLS_DC);
 
+extern zval*
+phurple_object_map_get(void *ptr TSRMLS_DC);
+
+extern void*
+phurple_object_map_find(void *ptr TSRMLS_DC);
+
+extern void
+phurple_object_map_add(void *ptr, zval *obj TSRMLS_DC);
+
+extern void
+phurple_object_map_remove(void *ptr TSRMLS_DC);
+
+extern void
+phurple_object_map_release(void *ptr, void *obj TSRMLS_DC);
+
 #if PHURPLE_INTERNAL_DEBUG
 extern void phurple_dump_zval(zval *var);
 #endif
@@ -48,6 +63,8 @@ php_buddy_obj_destroy(void *obj TSRMLS_DC)
 {/*{{{*/
 	struct ze_buddy_obj *zbo = (struct ze_buddy_obj *)obj;
 
+	phurple_object_map_release(zbo->pbuddy, obj TSRMLS_CC);
+
 	zend_object_std_dtor(&zbo->zo TSRMLS_CC);
 
 	/*if (zbo->pbuddy) {
@@ -97,18 +114,46 @@ php_create_buddy_obj_zval(PurpleBuddy *pbuddy TSRMLS_DC)
 	if (!pbuddy) {
 		ALLOC_INIT_ZVAL(ret);
 		ZVAL_NULL(ret);
-	} else {
+	} else if (NULL == (ret = phurple_object_map_get(pbuddy TSRMLS_CC))) {
 		ALLOC_ZVAL(ret);
 		object_init_ex(ret, PhurpleBuddy_ce);
 		INIT_PZVAL(ret);
 
 		zao = (struct ze_buddy_obj *) zend_object_store_get_object(ret TSRMLS_CC);
 		zao->pbuddy = pbuddy;
+
+		phurple_object_map_add(pbuddy, ret TSRMLS_CC);
 	}
 
 	return ret;
 }/*}}}*/
 
+/* A removed buddy is freed right after the signal, detach its wrapper */
+static void
+phurple_buddy_invalidate(PurpleBuddy *pbuddy)
+{/*{{{*/
+	struct ze_buddy_obj *zao;
+	TSRMLS_FETCH();
+
+	zao = (struct ze_buddy_obj *) phurple_object_map_find(pbuddy TSRMLS_CC);
+	if (zao) {
+		zao->pbuddy = NULL;
+		phurple_object_map_remove(pbuddy TSRMLS_CC);
+	}
+}/*}}}*/
+
+void
+phurple_buddy_signals_connect(void *handle)
+{/*{{{*/
+	purple_signal_connect_priority(purple_blist_get_handle(),
+								   "buddy-removed",
+								   handle,
+								   PURPLE_CALLBACK(phurple_buddy_invalidate),
+								   NULL,
+								   PURPLE_SIGNAL_PRIORITY_HIGHEST
+	);
+}/*}}}*/
+
 /*
 **
 **
@@ -133,6 +178,11 @@ PHP_METHOD(PhurpleBuddy, __construct)
 	zbo = (struct ze_buddy_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
 	zao = (struct ze_account_obj *) zend_object_store_get_object(account TSRMLS_CC);
 
+	if (NULL == zao->paccount) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The account is no longer available");
+		return;
+	}
+
 	zbo->pbuddy = purple_find_buddy(zao->paccount, name);
 
 	if(!zbo->pbuddy) {
@@ -143,6 +193,10 @@ PHP_METHOD(PhurpleBuddy, __construct)
 		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "Failed to create buddy");
 		return;
 	}
+
+	if (!phurple_object_map_find(zbo->pbuddy TSRMLS_CC)) {
+		phurple_object_map_add(zbo->pbuddy, getThis() TSRMLS_CC);
+	}
 }
 /* }}} */
 
@@ -163,6 +217,11 @@ PHP_METHOD(PhurpleBuddy, getName)
 
 	zbo = (struct ze_buddy_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
 
+	if (NULL == zbo->pbuddy) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The buddy is no longer available");
+		return;
+	}
+
 	RETURN_STRING(purple_buddy_get_name(zbo->pbuddy), 1);
 }
 /* }}} */
@@ -185,6 +244,11 @@ PHP_METHOD(PhurpleBuddy, getAlias)
 
 	zbo = (struct ze_buddy_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
 
+	if (NULL == zbo->pbuddy) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The buddy is no longer available");
+		return;
+	}
+
 	alias = purple_buddy_get_alias_only(zbo->pbuddy);
 
 	if (alias) {
@@ -211,6 +275,10 @@ PHP_METHOD(PhurpleBuddy, getGroup)
 
 	zbo = (struct ze_buddy_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
 
+	if (NULL == zbo->pbuddy) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The buddy is no longer available");
+		return;
+	}
 
 	pgroup = purple_buddy_get_group(zbo->pbuddy);
 	if(pgroup) {
@@ -243,12 +311,17 @@ PHP_METHOD(PhurpleBuddy, getAccount)
 	}
 
 	zbo = (struct ze_buddy_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
+
+	if (NULL == zbo->pbuddy) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The buddy is no longer available");
+		return;
+	}
 			
 	paccount = purple_buddy_get_account(zbo->pbuddy);
 	if(paccount) {
 		zval *tmp = php_create_account_obj_zval(paccount TSRMLS_CC);
 
-		*return_value = *tmp;
+		RETVAL_ZVAL(tmp, 1, 1);
 
 		return;
 	}
@@ -268,6 +341,11 @@ PHP_METHOD(PhurpleBuddy, isOnline)
 	}
 
 	zbo = (struct ze_buddy_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
+
+	if (NULL == zbo->pbuddy) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The buddy is no longer available");
+		return;
+	}
 			
 	RETVAL_BOOL(PURPLE_BUDDY_IS_ONLINE(zbo->pbuddy));
 }
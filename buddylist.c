@@ -23,6 +23,7 @@
 
 #include <php.h>
 #include "Zend/zend_exceptions.h"
+#include "Zend/zend_interfaces.h"
 
 #include "php_phurple.h"
 
@@ -40,6 +41,442 @@ php_create_buddy_obj_zval(PurpleBuddy *pbuddy TSRMLS_DC);
 extern void phurple_dump_zval(zval *var);
 #endif
 
+/* The server side changes of an account collected by a transaction */
+struct phurple_blist_pending {
+	GList *add;				/* PurpleBuddy * */
+	GList *remove;			/* PurpleBuddy * */
+	GList *remove_groups;	/* group names, parallel to remove */
+};
+
+static struct {
+	int depth;				/* nested begin() calls */
+	zend_bool dirty;		/* the blist has to be saved on commit */
+	GHashTable *accounts;	/* PurpleAccount * => struct phurple_blist_pending * */
+	GList *drop_buddies;	/* PurpleBuddy * to remove from the blist on commit */
+	GList *drop_groups;		/* group names to remove from the blist on commit */
+} phurple_blist_tx = {0, 0, NULL, NULL, NULL};
+
+static void
+phurple_blist_pending_free(gpointer data)
+{/*{{{*/
+	struct phurple_blist_pending *p = (struct phurple_blist_pending *)data;
+
+	g_list_free(p->add);
+	g_list_free(p->remove);
+	g_list_foreach(p->remove_groups, (GFunc) g_free, NULL);
+	g_list_free(p->remove_groups);
+	g_free(p);
+}/*}}}*/
+
+static void
+phurple_blist_drops_free(void)
+{/*{{{*/
+	g_list_free(phurple_blist_tx.drop_buddies);
+	phurple_blist_tx.drop_buddies = NULL;
+
+	g_list_foreach(phurple_blist_tx.drop_groups, (GFunc) g_free, NULL);
+	g_list_free(phurple_blist_tx.drop_groups);
+	phurple_blist_tx.drop_groups = NULL;
+}/*}}}*/
+
+static struct phurple_blist_pending *
+phurple_blist_pending_get(PurpleAccount *account)
+{/*{{{*/
+	struct phurple_blist_pending *p;
+
+	p = (struct phurple_blist_pending *) g_hash_table_lookup(phurple_blist_tx.accounts, account);
+	if (!p) {
+		p = g_new0(struct phurple_blist_pending, 1);
+		g_hash_table_insert(phurple_blist_tx.accounts, account, p);
+	}
+
+	return p;
+}/*}}}*/
+
+/* The removals done by phurple wait for the commit, so a buddy leaving the
+	blist now was removed by libpurple or the protocol, most likely on behalf
+	of the server. Whatever is pending for it is void. */
+static void
+phurple_blist_tx_node_removed(PurpleBlistNode *node)
+{/*{{{*/
+	PurpleBuddy *buddy;
+	struct phurple_blist_pending *p;
+	GList *b, *g;
+
+	if (!PURPLE_BLIST_NODE_IS_BUDDY(node)) {
+		return;
+	}
+
+	buddy = (PurpleBuddy *)node;
+	phurple_blist_tx.drop_buddies = g_list_remove(phurple_blist_tx.drop_buddies, buddy);
+
+	p = (struct phurple_blist_pending *) g_hash_table_lookup(phurple_blist_tx.accounts, purple_buddy_get_account(buddy));
+	if (!p) {
+		return;
+	}
+
+	p->add = g_list_remove(p->add, buddy);
+
+	for (b = p->remove, g = p->remove_groups; b; b = b->next, g = g->next) {
+		if (b->data == buddy) {
+			g_free(g->data);
+			p->remove = g_list_delete_link(p->remove, b);
+			p->remove_groups = g_list_delete_link(p->remove_groups, g);
+			break;
+		}
+	}
+}/*}}}*/
+
+static void
+phurple_blist_tx_flush(gpointer key, gpointer value, gpointer data)
+{/*{{{*/
+	PurpleAccount *account = (PurpleAccount *)key;
+	struct phurple_blist_pending *p = (struct phurple_blist_pending *)value;
+
+	/* both use the add_buddies/remove_buddies of the protocol if it has them */
+	if (p->add) {
+		purple_account_add_buddies(account, p->add);
+	}
+	if (p->remove) {
+		GList *b, *g, *groups = NULL;
+
+		/* the group could be gone or renamed meanwhile, the buddy is still there */
+		for (b = p->remove, g = p->remove_groups; b; b = b->next, g = g->next) {
+			PurpleGroup *group = purple_find_group((const char *)g->data);
+
+			groups = g_list_append(groups, group ? group : purple_buddy_get_group((PurpleBuddy *)b->data));
+		}
+
+		purple_account_remove_buddies(account, p->remove, groups);
+		g_list_free(groups);
+	}
+}/*}}}*/
+
+/* Whether nothing but buddies removed on commit is left in the group */
+static zend_bool
+phurple_blist_tx_group_empty(PurpleGroup *group)
+{/*{{{*/
+	PurpleBlistNode *cnode, *bnode;
+
+	for (cnode = ((PurpleBlistNode *)group)->child; cnode; cnode = cnode->next) {
+		if (!PURPLE_BLIST_NODE_IS_CONTACT(cnode)) {
+			return 0;
+		}
+		for (bnode = cnode->child; bnode; bnode = bnode->next) {
+			if (!g_list_find(phurple_blist_tx.drop_buddies, bnode)) {
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}/*}}}*/
+
+/* The buddies and groups leave the blist after the server got the removes */
+static void
+phurple_blist_tx_drop(GList *buddies, GList *groups)
+{/*{{{*/
+	GList *l;
+
+	for (l = buddies; l; l = l->next) {
+		purple_blist_remove_buddy((PurpleBuddy *)l->data);
+	}
+
+	for (l = groups; l; l = l->next) {
+		PurpleGroup *group = purple_find_group((const char *)l->data);
+
+		/* something was added to it meanwhile */
+		if (group && !((PurpleBlistNode *)group)->child) {
+			purple_blist_remove_group(group);
+		}
+	}
+}/*}}}*/
+
+/* Whether a transaction collects the blist changes */
+int
+phurple_blist_tx_active(void)
+{/*{{{*/
+	return phurple_blist_tx.depth > 0;
+}/*}}}*/
+
+void
+phurple_blist_tx_begin(void)
+{/*{{{*/
+	if (phurple_blist_tx.depth++) {
+		return;
+	}
+
+	phurple_blist_tx.accounts = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, phurple_blist_pending_free);
+	phurple_blist_tx.dirty = 0;
+
+	purple_signal_connect(purple_blist_get_handle(), "blist-node-removed", &phurple_blist_tx,
+						  PURPLE_CALLBACK(phurple_blist_tx_node_removed), NULL);
+}/*}}}*/
+
+/* Apply the collected changes once the outermost transaction ends */
+void
+phurple_blist_tx_commit(void)
+{/*{{{*/
+	GHashTable *accounts;
+	GList *buddies, *groups;
+
+	if (!phurple_blist_tx.depth || --phurple_blist_tx.depth) {
+		return;
+	}
+
+	purple_signals_disconnect_by_handle(&phurple_blist_tx);
+
+	/* the server requests could start another transaction */
+	accounts = phurple_blist_tx.accounts;
+	phurple_blist_tx.accounts = NULL;
+	buddies = phurple_blist_tx.drop_buddies;
+	groups = phurple_blist_tx.drop_groups;
+	phurple_blist_tx.drop_buddies = phurple_blist_tx.drop_groups = NULL;
+
+	g_hash_table_foreach(accounts, phurple_blist_tx_flush, NULL);
+	g_hash_table_destroy(accounts);
+
+	phurple_blist_tx_drop(buddies, groups);
+	g_list_free(buddies);
+	g_list_foreach(groups, (GFunc) g_free, NULL);
+	g_list_free(groups);
+
+	if (phurple_blist_tx.dirty) {
+		phurple_blist_tx.dirty = 0;
+		purple_blist_schedule_save();
+	}
+}/*}}}*/
+
+/* The blist changed, saved now or on commit */
+void
+phurple_blist_tx_save(void)
+{/*{{{*/
+	if (phurple_blist_tx.depth) {
+		phurple_blist_tx.dirty = 1;
+		return;
+	}
+
+	purple_blist_schedule_save();
+}/*}}}*/
+
+/* Add a buddy on the server now or on commit */
+void
+phurple_blist_tx_add(PurpleAccount *account, PurpleBuddy *buddy)
+{/*{{{*/
+	struct phurple_blist_pending *p;
+
+	if (!phurple_blist_tx.depth) {
+		purple_account_add_buddy(account, buddy);
+		return;
+	}
+
+	p = phurple_blist_pending_get(account);
+	if (!g_list_find(p->add, buddy)) {
+		p->add = g_list_append(p->add, buddy);
+	}
+}/*}}}*/
+
+/* Remove a buddy from the server now or on commit */
+void
+phurple_blist_tx_remove(PurpleAccount *account, PurpleBuddy *buddy, PurpleGroup *group)
+{/*{{{*/
+	struct phurple_blist_pending *p;
+
+	if (!phurple_blist_tx.depth) {
+		purple_account_remove_buddy(account, buddy, group);
+		return;
+	}
+
+	p = phurple_blist_pending_get(account);
+
+	/* added and removed within the transaction, the server sees neither */
+	if (g_list_find(p->add, buddy)) {
+		p->add = g_list_remove(p->add, buddy);
+		return;
+	}
+
+	if (!g_list_find(p->remove, buddy)) {
+		p->remove = g_list_append(p->remove, buddy);
+		p->remove_groups = g_list_append(p->remove_groups, g_strdup(group ? purple_group_get_name(group) : ""));
+	}
+}/*}}}*/
+
+/* Remove a buddy from the blist now or on commit, after the server removes */
+void
+phurple_blist_tx_remove_buddy(PurpleBuddy *buddy)
+{/*{{{*/
+	if (!phurple_blist_tx.depth) {
+		purple_blist_remove_buddy(buddy);
+		return;
+	}
+
+	if (!g_list_find(phurple_blist_tx.drop_buddies, buddy)) {
+		phurple_blist_tx.drop_buddies = g_list_append(phurple_blist_tx.drop_buddies, buddy);
+	}
+}/*}}}*/
+
+/* Remove an empty group from the blist now or on commit. Within a
+	transaction the buddies removed on commit don't count. */
+zend_bool
+phurple_blist_tx_remove_group(PurpleGroup *group)
+{/*{{{*/
+	if (!phurple_blist_tx.depth) {
+		if (((PurpleBlistNode *)group)->child) {
+			return 0;
+		}
+		purple_blist_remove_group(group);
+		return 1;
+	}
+
+	if (!phurple_blist_tx_group_empty(group)) {
+		return 0;
+	}
+
+	phurple_blist_tx.drop_groups = g_list_append(phurple_blist_tx.drop_groups, g_strdup(purple_group_get_name(group)));
+
+	return 1;
+}/*}}}*/
+
+/* An account is destroyed */
+void
+phurple_blist_tx_forget(PurpleAccount *account)
+{/*{{{*/
+	if (phurple_blist_tx.accounts) {
+		g_hash_table_remove(phurple_blist_tx.accounts, account);
+	}
+}/*}}}*/
+
+/* Drop an unfinished transaction without sending anything */
+void
+phurple_blist_tx_clear(void)
+{/*{{{*/
+	if (!phurple_blist_tx.accounts) {
+		return;
+	}
+
+	purple_signals_disconnect_by_handle(&phurple_blist_tx);
+
+	g_hash_table_destroy(phurple_blist_tx.accounts);
+	phurple_blist_tx.accounts = NULL;
+	phurple_blist_drops_free();
+	phurple_blist_tx.depth = 0;
+	phurple_blist_tx.dirty = 0;
+}/*}}}*/
+
+/* The group buddies without one go to, like in libpurple */
+#define PHURPLE_BLIST_DEFAULT_GROUP "Buddies"
+
+/* State of an import() */
+struct phurple_blist_import {
+	PurpleAccount *account;
+	GHashTable *groups;		/* name => PurpleGroup *, saves the group lookups */
+	zend_bool server;
+	long added;
+	long updated;
+	long skipped;
+};
+
+/* A string field of an import row by key or position, NULL if missing */
+static char *
+phurple_blist_row_field(HashTable *row, const char *key, ulong idx)
+{/*{{{*/
+	zval **field, tmp;
+	char *ret;
+
+	if (zend_hash_find(row, key, strlen(key) + 1, (void **) &field) == FAILURE
+		&& zend_hash_index_find(row, idx, (void **) &field) == FAILURE) {
+		return NULL;
+	}
+
+	if (IS_STRING == Z_TYPE_PP(field)) {
+		return Z_STRLEN_PP(field) ? g_strndup(Z_STRVAL_PP(field), Z_STRLEN_PP(field)) : NULL;
+	}
+
+	/* numeric names like the ICQ UINs */
+	if (IS_LONG != Z_TYPE_PP(field)) {
+		return NULL;
+	}
+
+	tmp = **field;
+	zval_copy_ctor(&tmp);
+	convert_to_string(&tmp);
+	ret = g_strndup(Z_STRVAL(tmp), Z_STRLEN(tmp));
+	zval_dtor(&tmp);
+
+	return ret;
+}/*}}}*/
+
+static PurpleGroup *
+phurple_blist_import_group(struct phurple_blist_import *imp, const char *name)
+{/*{{{*/
+	PurpleGroup *group;
+
+	group = (PurpleGroup *) g_hash_table_lookup(imp->groups, name);
+	if (group) {
+		return group;
+	}
+
+	group = purple_find_group(name);
+	if (!group) {
+		group = purple_group_new(name);
+		purple_blist_add_group(group, NULL);
+	}
+
+	g_hash_table_insert(imp->groups, g_strdup(name), group);
+
+	return group;
+}/*}}}*/
+
+/* A row is a name or an array of name, alias and group, by key or position */
+static void
+phurple_blist_import_row(struct phurple_blist_import *imp, zval *row)
+{/*{{{*/
+	char *name = NULL, *alias = NULL, *group_name = NULL;
+	PurpleGroup *group;
+	PurpleBuddy *buddy;
+
+	if (IS_STRING == Z_TYPE_P(row) && Z_STRLEN_P(row)) {
+		name = g_strndup(Z_STRVAL_P(row), Z_STRLEN_P(row));
+	} else if (IS_ARRAY == Z_TYPE_P(row)) {
+		name = phurple_blist_row_field(Z_ARRVAL_P(row), "name", 0);
+		alias = phurple_blist_row_field(Z_ARRVAL_P(row), "alias", 1);
+		group_name = phurple_blist_row_field(Z_ARRVAL_P(row), "group", 2);
+	}
+
+	if (!name) {
+		imp->skipped++;
+		g_free(alias);
+		g_free(group_name);
+		return;
+	}
+
+	group = phurple_blist_import_group(imp, group_name ? group_name : PHURPLE_BLIST_DEFAULT_GROUP);
+
+	/* a hash lookup in libpurple, also catches duplicate rows */
+	buddy = purple_find_buddy_in_group(imp->account, name, group);
+	if (buddy) {
+		const char *current = purple_buddy_get_alias_only(buddy);
+
+		if (alias && (!current || strcmp(current, alias))) {
+			purple_blist_alias_buddy(buddy, alias);
+			imp->updated++;
+		} else {
+			imp->skipped++;
+		}
+	} else {
+		buddy = purple_buddy_new(imp->account, name, alias);
+		purple_blist_add_buddy(buddy, NULL, group, NULL);
+		if (imp->server) {
+			phurple_blist_tx_add(imp->account, buddy);
+		}
+		imp->added++;
+	}
+
+	g_free(name);
+	g_free(alias);
+	g_free(group_name);
+}/*}}}*/
+
 /*zval *
 php_create_buddylist_obj_zval(PurpleBuddyList *pbuddylist TSRMLS_DC)
 {
@@ -93,7 +530,7 @@ PHP_METHOD(PhurpleBuddyList, addBuddy)
 
 	purple_blist_add_buddy(zbo->pbuddy, NULL, zgo->pgroup, NULL);
 
-	purple_blist_schedule_save();
+	phurple_blist_tx_save();
 
 	RETURN_TRUE;
 }
@@ -115,7 +552,7 @@ PHP_METHOD(PhurpleBuddyList, addGroup)
 	
 	purple_blist_add_group(zgo->pgroup, NULL);
 
-	purple_blist_schedule_save();
+	phurple_blist_tx_save();
 
 	RETURN_TRUE;
 }
@@ -143,7 +580,7 @@ PHP_METHOD(PhurpleBuddyList, findBuddy)
 	if(pbuddy) {
 		zval *buddy = php_create_buddy_obj_zval(pbuddy TSRMLS_CC);
 
-		*return_value = *buddy;
+		RETVAL_ZVAL(buddy, 1, 1);
 
 		return;
 	}
@@ -233,9 +670,9 @@ PHP_METHOD(PhurpleBuddyList, removeBuddy)
 
 	zbo = (struct ze_buddy_obj *) zend_object_store_get_object(buddy TSRMLS_CC);
 
-	purple_blist_remove_buddy(zbo->pbuddy);
+	phurple_blist_tx_remove_buddy(zbo->pbuddy);
 
-	purple_blist_schedule_save();
+	phurple_blist_tx_save();
 
 	RETURN_TRUE;
 }
@@ -248,7 +685,6 @@ PHP_METHOD(PhurpleBuddyList, removeGroup)
 {
 	zval *group;
 	struct ze_group_obj *zgo;
-	PurpleBlistNode *node;
 	
 	if(zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "O", &group, PhurpleGroup_ce) == FAILURE) {
 		RETURN_FALSE;
@@ -256,16 +692,12 @@ PHP_METHOD(PhurpleBuddyList, removeGroup)
 
 	zgo = (struct ze_group_obj *) zend_object_store_get_object(group TSRMLS_CC);
 
-	node = (PurpleBlistNode *) zgo->pgroup;
-
-	if(node->child) {
+	if (!phurple_blist_tx_remove_group(zgo->pgroup)) {
 		/* group isn't empty */
 		RETURN_FALSE;
 	}
-	
-	purple_blist_remove_group(zgo->pgroup);
 
-	purple_blist_schedule_save();
+	phurple_blist_tx_save();
 
 	RETURN_TRUE;
 }
@@ -296,7 +728,264 @@ PHP_METHOD(PhurpleBuddyList, addChat)
 
 	purple_blist_add_chat(pchat, NULL, NULL);
 
-	purple_blist_schedule_save();
+	phurple_blist_tx_save();
+}
+/* }}} */
+
+
+/* {{{ proto array PhurpleBuddyList::import(Phurple\Account account, array|Traversable rows[, bool server = true])
+	Adds the buddies of the rows within one transaction, returns the counts of the added, updated and skipped rows */
+PHP_METHOD(PhurpleBuddyList, import)
+{
+	zval *account, *rows;
+	zend_bool server = 1;
+	struct ze_account_obj *zao;
+	struct phurple_blist_import imp;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "Oz|b", &account, PhurpleAccount_ce, &rows, &server) == FAILURE) {
+		return;
+	}
+
+	if (IS_ARRAY != Z_TYPE_P(rows)
+		&& (IS_OBJECT != Z_TYPE_P(rows) || !instanceof_function(Z_OBJCE_P(rows), zend_ce_traversable TSRMLS_CC))) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The rows have to be an array or Traversable");
+		return;
+	}
+
+	zao = (struct ze_account_obj *) zend_object_store_get_object(account TSRMLS_CC);
+	if (!zao->paccount) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The account was deleted");
+		return;
+	}
+
+	memset(&imp, 0, sizeof(imp));
+	imp.account = zao->paccount;
+	imp.server = server;
+	imp.groups = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+	phurple_blist_tx_begin();
+
+	if (IS_ARRAY == Z_TYPE_P(rows)) {
+		zval **row;
+		HashPosition pos;
+
+		for (zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(rows), &pos);
+			 zend_hash_get_current_data_ex(Z_ARRVAL_P(rows), (void **) &row, &pos) == SUCCESS;
+			 zend_hash_move_forward_ex(Z_ARRVAL_P(rows), &pos)) {
+			phurple_blist_import_row(&imp, *row);
+		}
+	} else {
+		/* rows are pulled one by one, a generator never has to be an array */
+		zend_class_entry *ce = Z_OBJCE_P(rows);
+		zend_object_iterator *it = ce->get_iterator(ce, rows, 0 TSRMLS_CC);
+
+		if (it && !EG(exception)) {
+			if (it->funcs->rewind) {
+				it->funcs->rewind(it TSRMLS_CC);
+			}
+
+			while (!EG(exception) && it->funcs->valid(it TSRMLS_CC) == SUCCESS) {
+				zval **row = NULL;
+
+				it->funcs->get_current_data(it, &row TSRMLS_CC);
+				if (EG(exception)) {
+					break;
+				}
+				if (row) {
+					phurple_blist_import_row(&imp, *row);
+				}
+
+				it->funcs->move_forward(it TSRMLS_CC);
+			}
+		}
+
+		if (it) {
+			it->funcs->dtor(it TSRMLS_CC);
+		}
+	}
+
+	g_hash_table_destroy(imp.groups);
+
+	if (imp.added || imp.updated) {
+		phurple_blist_tx_save();
+	}
+
+	/* what was imported before an exception is kept */
+	phurple_blist_tx_commit();
+
+	if (EG(exception)) {
+		return;
+	}
+
+	array_init(return_value);
+	add_assoc_long(return_value, "added", imp.added);
+	add_assoc_long(return_value, "updated", imp.updated);
+	add_assoc_long(return_value, "skipped", imp.skipped);
+}
+/* }}} */
+
+
+/* {{{ proto array PhurpleBuddyList::export(Phurple\Account account)
+	Returns the buddies of the account as rows of name, alias and group, as accepted by import() */
+PHP_METHOD(PhurpleBuddyList, export)
+{
+	zval *account;
+	struct ze_account_obj *zao;
+	GSList *buddies, *iter;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "O", &account, PhurpleAccount_ce) == FAILURE) {
+		return;
+	}
+
+	zao = (struct ze_account_obj *) zend_object_store_get_object(account TSRMLS_CC);
+	if (!zao->paccount) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The account was deleted");
+		return;
+	}
+
+	buddies = purple_find_buddies(zao->paccount, NULL);
+
+	array_init_size(return_value, g_slist_length(buddies));
+
+	for (iter = buddies; iter; iter = iter->next) {
+		PurpleBuddy *buddy = (PurpleBuddy *)iter->data;
+		PurpleGroup *group = purple_buddy_get_group(buddy);
+		const char *alias = purple_buddy_get_alias_only(buddy);
+		zval *row;
+
+		MAKE_STD_ZVAL(row);
+		array_init_size(row, 3);
+		add_assoc_string(row, "name", (char *)purple_buddy_get_name(buddy), 1);
+		if (alias) {
+			add_assoc_string(row, "alias", (char *)alias, 1);
+		} else {
+			add_assoc_null(row, "alias");
+		}
+		if (group) {
+			add_assoc_string(row, "group", (char *)purple_group_get_name(group), 1);
+		} else {
+			add_assoc_null(row, "group");
+		}
+
+		add_next_index_zval(return_value, row);
+	}
+
+	g_slist_free(buddies);
+}
+/* }}} */
+
+
+/* {{{ proto Phurple\BuddyListIterator PhurpleBuddyList::iterate([Phurple\Account account[, mixed group[, bool online_only = false]]])
+	Returns an iterator over the buddies, filtered by account, group object or name and online state */
+PHP_METHOD(PhurpleBuddyList, iterate)
+{
+	zval *account = NULL, *group = NULL;
+	zend_bool online = 0;
+	PurpleAccount *paccount = NULL;
+	PurpleGroup *pgroup = NULL;
+	struct ze_buddylistiterator_obj *zio;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|O!zb", &account, PhurpleAccount_ce, &group, &online) == FAILURE) {
+		return;
+	}
+
+	if (!purple_get_blist()) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The buddy list isn't loaded yet");
+		return;
+	}
+
+	if (account) {
+		struct ze_account_obj *zao = (struct ze_account_obj *) zend_object_store_get_object(account TSRMLS_CC);
+
+		if (!zao->paccount) {
+			zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The account was deleted");
+			return;
+		}
+		paccount = zao->paccount;
+	}
+
+	if (group && IS_NULL != Z_TYPE_P(group)) {
+		if (IS_OBJECT == Z_TYPE_P(group) && instanceof_function(Z_OBJCE_P(group), PhurpleGroup_ce TSRMLS_CC)) {
+			struct ze_group_obj *zgo = (struct ze_group_obj *) zend_object_store_get_object(group TSRMLS_CC);
+
+			pgroup = zgo->pgroup;
+		} else if (IS_STRING == Z_TYPE_P(group)) {
+			pgroup = purple_find_group(Z_STRVAL_P(group));
+		} else {
+			zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The group has to be a Phurple\\BuddyGroup or a name");
+			return;
+		}
+	}
+
+	object_init_ex(return_value, PhurpleBuddyListIterator_ce);
+
+	zio = (struct ze_buddylistiterator_obj *) zend_object_store_get_object(return_value TSRMLS_CC);
+	zio->paccount = paccount;
+	zio->pgroup = pgroup;
+	zio->online = online;
+	/* an unknown group has no buddies */
+	zio->gone = group && IS_NULL != Z_TYPE_P(group) && !pgroup;
+}
+/* }}} */
+
+
+/* {{{ proto void PhurpleBuddyList::begin(void)
+	Collect the following blist changes until commit(), transactions can be nested */
+PHP_METHOD(PhurpleBuddyList, begin)
+{
+	if (zend_parse_parameters_none() == FAILURE) {
+		return;
+	}
+
+	phurple_blist_tx_begin();
+}
+/* }}} */
+
+
+/* {{{ proto void PhurpleBuddyList::commit(void)
+	Save the blist once and send the collected server side adds and removes per account */
+PHP_METHOD(PhurpleBuddyList, commit)
+{
+	if (zend_parse_parameters_none() == FAILURE) {
+		return;
+	}
+
+	if (!phurple_blist_tx_active()) {
+		zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "No buddy list transaction to commit");
+		return;
+	}
+
+	phurple_blist_tx_commit();
+}
+/* }}} */
+
+
+/* {{{ proto mixed PhurpleBuddyList::batch(callable fn)
+	Run fn within a transaction, it's committed also if fn throws. Returns what fn returns */
+PHP_METHOD(PhurpleBuddyList, batch)
+{
+	zend_fcall_info fci;
+	zend_fcall_info_cache fcc;
+	zval *retval = NULL;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "f", &fci, &fcc) == FAILURE) {
+		return;
+	}
+
+	fci.retval_ptr_ptr = &retval;
+	fci.params = NULL;
+	fci.param_count = 0;
+
+	phurple_blist_tx_begin();
+
+	zend_call_function(&fci, &fcc TSRMLS_CC);
+
+	/* the changes made so far are in the blist already, there's no rollback */
+	phurple_blist_tx_commit();
+
+	if (retval) {
+		RETVAL_ZVAL(retval, 0, 1);
+	}
 }
 /* }}} */
 
@@ -0,0 +1,336 @@
+/**
+ * Copyright (c) 2007-2014, Anatol Belski <ab@php.net>
+ *
+ * This file is part of Phurple.
+ *
+ * Phurple is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Phurple is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Phurple.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <php.h>
+#include "Zend/zend_exceptions.h"
+
+#include "php_phurple.h"
+
+#include <glib.h>
+
+#include <string.h>
+
+#include <purple.h>
+
+extern zval *
+php_create_buddy_obj_zval(PurpleBuddy *pbuddy TSRMLS_DC);
+
+#if PHURPLE_INTERNAL_DEBUG
+extern void phurple_dump_zval(zval *var);
+#endif
+
+/* The live iterators, moved on when the node they stand on goes away */
+static GList *phurple_blist_iterators = NULL;
+
+/* The next node of the tree in preorder, optionally skipping the children */
+static PurpleBlistNode *
+phurple_blist_node_next(PurpleBlistNode *node, gboolean skip_children)
+{/*{{{*/
+	if (!skip_children && node->child) {
+		return node->child;
+	}
+
+	while (node) {
+		if (node->next) {
+			return node->next;
+		}
+		node = node->parent;
+	}
+
+	return NULL;
+}/*}}}*/
+
+/* From node on, the first buddy passing the filters */
+static PurpleBlistNode *
+phurple_blist_iterator_seek(struct ze_buddylistiterator_obj *zio, PurpleBlistNode *node)
+{/*{{{*/
+	while (node) {
+		if (PURPLE_BLIST_NODE_IS_GROUP(node)) {
+			/* the walk started at the group, the next one ends it */
+			if (zio->pgroup && (PurpleGroup *)node != zio->pgroup) {
+				return NULL;
+			}
+		} else if (PURPLE_BLIST_NODE_IS_BUDDY(node)) {
+			PurpleBuddy *buddy = (PurpleBuddy *)node;
+
+			if ((!zio->paccount || purple_buddy_get_account(buddy) == zio->paccount)
+				&& (!zio->online || PURPLE_BUDDY_IS_ONLINE(buddy))) {
+				return node;
+			}
+		} else if (PURPLE_BLIST_NODE_IS_CHAT(node)) {
+			node = phurple_blist_node_next(node, TRUE);
+			continue;
+		}
+
+		node = phurple_blist_node_next(node, FALSE);
+	}
+
+	return NULL;
+}/*}}}*/
+
+/* The buddy is already unlinked, but still points to its old neighbours */
+static void
+phurple_blist_iterators_buddy_removed(PurpleBuddy *pbuddy)
+{/*{{{*/
+	GList *l;
+
+	for (l = phurple_blist_iterators; l; l = l->next) {
+		struct ze_buddylistiterator_obj *zio = (struct ze_buddylistiterator_obj *)l->data;
+
+		if (zio->node == (PurpleBlistNode *)pbuddy) {
+			zio->node = phurple_blist_iterator_seek(zio, phurple_blist_node_next(zio->node, TRUE));
+			zio->advanced = 1;
+		}
+	}
+}/*}}}*/
+
+static void
+phurple_blist_iterators_node_removed(PurpleBlistNode *node)
+{/*{{{*/
+	GList *l;
+
+	if (!PURPLE_BLIST_NODE_IS_GROUP(node)) {
+		return;
+	}
+
+	for (l = phurple_blist_iterators; l; l = l->next) {
+		struct ze_buddylistiterator_obj *zio = (struct ze_buddylistiterator_obj *)l->data;
+
+		if ((PurpleBlistNode *)zio->pgroup == node) {
+			zio->pgroup = NULL;
+			zio->node = NULL;
+			zio->gone = 1;
+		}
+	}
+}/*}}}*/
+
+/* An account filtered by an iterator is destroyed */
+void
+phurple_blist_iterators_forget(PurpleAccount *account)
+{/*{{{*/
+	GList *l;
+
+	for (l = phurple_blist_iterators; l; l = l->next) {
+		struct ze_buddylistiterator_obj *zio = (struct ze_buddylistiterator_obj *)l->data;
+
+		if (zio->paccount == account) {
+			zio->paccount = NULL;
+			zio->node = NULL;
+			zio->gone = 1;
+		}
+	}
+}/*}}}*/
+
+void
+php_buddylistiterator_obj_destroy(void *obj TSRMLS_DC)
+{/*{{{*/
+	struct ze_buddylistiterator_obj *zio = (struct ze_buddylistiterator_obj *)obj;
+
+	zend_object_std_dtor(&zio->zo TSRMLS_CC);
+
+	phurple_blist_iterators = g_list_remove(phurple_blist_iterators, zio);
+	if (!phurple_blist_iterators) {
+		purple_signals_disconnect_by_handle(&phurple_blist_iterators);
+	}
+
+	efree(zio);
+}/*}}}*/
+
+zend_object_value
+php_buddylistiterator_obj_init(zend_class_entry *ce TSRMLS_DC)
+{/*{{{*/
+	zend_object_value ret;
+	struct ze_buddylistiterator_obj *zio;
+#if PHP_MAJOR_VERSION == 5 && PHP_MINOR_VERSION < 4
+	zval *tmp;
+#endif
+
+	zio = (struct ze_buddylistiterator_obj *) emalloc(sizeof(struct ze_buddylistiterator_obj));
+	memset(zio, 0, sizeof(struct ze_buddylistiterator_obj));
+
+	zend_object_std_init(&zio->zo, ce TSRMLS_CC);
+#if PHP_MAJOR_VERSION== 5 && PHP_MINOR_VERSION < 4
+	zend_hash_copy(zio->zo.properties, &ce->default_properties, (copy_ctor_func_t) zval_add_ref,
+					(void *) &tmp, sizeof(zval *));
+#else
+	object_properties_init(&zio->zo, ce);
+#endif
+
+	if (!phurple_blist_iterators) {
+		purple_signal_connect(purple_blist_get_handle(), "buddy-removed", &phurple_blist_iterators,
+							  PURPLE_CALLBACK(phurple_blist_iterators_buddy_removed), NULL);
+		purple_signal_connect(purple_blist_get_handle(), "blist-node-removed", &phurple_blist_iterators,
+							  PURPLE_CALLBACK(phurple_blist_iterators_node_removed), NULL);
+	}
+	phurple_blist_iterators = g_list_prepend(phurple_blist_iterators, zio);
+
+	ret.handle = zend_objects_store_put(zio, NULL,
+								(zend_objects_free_object_storage_t) php_buddylistiterator_obj_destroy,
+								NULL TSRMLS_CC);
+
+	ret.handlers = &default_phurple_obj_handlers;
+
+	return ret;
+}/*}}}*/
+
+/*
+**
+**
+** Phurple BuddyListIterator methods
+**
+*/
+
+/* {{{ proto Phurple\BuddyListIterator Phurple\BuddyListIterator::__construct(void)
+	should newer be called, see Phurple\BuddyList::iterate() */
+PHP_METHOD(PhurpleBuddyListIterator, __construct)
+{
+}
+/* }}} */
+
+
+/* {{{ proto void Phurple\BuddyListIterator::rewind(void)
+	Go to the first buddy passing the filters */
+PHP_METHOD(PhurpleBuddyListIterator, rewind)
+{
+	struct ze_buddylistiterator_obj *zio;
+
+	if (zend_parse_parameters_none() == FAILURE) {
+		return;
+	}
+
+	zio = (struct ze_buddylistiterator_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
+
+	zio->key = 0;
+	zio->advanced = 0;
+
+	if (zio->gone || !purple_get_blist()) {
+		zio->node = NULL;
+		return;
+	}
+
+	zio->node = phurple_blist_iterator_seek(zio, zio->pgroup ? (PurpleBlistNode *)zio->pgroup : purple_blist_get_root());
+}
+/* }}} */
+
+
+/* {{{ proto bool Phurple\BuddyListIterator::valid(void)
+	Whether there is a current buddy */
+PHP_METHOD(PhurpleBuddyListIterator, valid)
+{
+	struct ze_buddylistiterator_obj *zio;
+
+	if (zend_parse_parameters_none() == FAILURE) {
+		return;
+	}
+
+	zio = (struct ze_buddylistiterator_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
+
+	RETURN_BOOL(NULL != zio->node);
+}
+/* }}} */
+
+
+/* {{{ proto Phurple\Buddy Phurple\BuddyListIterator::current(void)
+	Returns the current buddy, the wrapper is only created now. The identity
+	map doesn't hold it, so a walk doesn't leave a wrapper per buddy behind */
+PHP_METHOD(PhurpleBuddyListIterator, current)
+{
+	struct ze_buddylistiterator_obj *zio;
+	zval *buddy;
+
+	if (zend_parse_parameters_none() == FAILURE) {
+		return;
+	}
+
+	zio = (struct ze_buddylistiterator_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
+
+	if (!zio->node) {
+		RETURN_NULL();
+	}
+
+	buddy = php_create_buddy_obj_zval((PurpleBuddy *)zio->node TSRMLS_CC);
+
+	RETVAL_ZVAL(buddy, 1, 1);
+}
+/* }}} */
+
+
+/* {{{ proto int Phurple\BuddyListIterator::key(void)
+	Returns the position of the current buddy */
+PHP_METHOD(PhurpleBuddyListIterator, key)
+{
+	struct ze_buddylistiterator_obj *zio;
+
+	if (zend_parse_parameters_none() == FAILURE) {
+		return;
+	}
+
+	zio = (struct ze_buddylistiterator_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
+
+	RETURN_LONG(zio->key);
+}
+/* }}} */
+
+
+/* {{{ proto void Phurple\BuddyListIterator::next(void)
+	Go to the next buddy passing the filters */
+PHP_METHOD(PhurpleBuddyListIterator, next)
+{
+	struct ze_buddylistiterator_obj *zio;
+
+	if (zend_parse_parameters_none() == FAILURE) {
+		return;
+	}
+
+	zio = (struct ze_buddylistiterator_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
+
+	if (!zio->node) {
+		return;
+	}
+
+	zio->key++;
+
+	/* the current buddy was removed, its successor is the current one already */
+	if (zio->advanced) {
+		zio->advanced = 0;
+		return;
+	}
+
+	zio->node = phurple_blist_iterator_seek(zio, phurple_blist_node_next(zio->node, FALSE));
+}
+/* }}} */
+
+/*
+**
+**
+** End phurple BuddyListIterator methods
+**
+*/
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
@@ -0,0 +1,271 @@
+/**
+ * Copyright (c) 2007-2014, Anatol Belski <ab@php.net>
+ *
+ * This file is part of Phurple.
+ *
+ * Phurple is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Phurple is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Phurple.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <php.h>
+
+#include "php_phurple.h"
+
+#include <glib.h>
+
+#include <string.h>
+
+#include <purple.h>
+
+extern zval *
+php_create_account_obj_zval(PurpleAccount *paccount TSRMLS_DC);
+
+extern zval *
+php_create_conversation_obj_zval(PurpleConversation *pconv TSRMLS_DC);
+
+extern zval*
+phurple_string_zval(const char *s);
+
+#define PHURPLE_COMMAND_SPACE(c) (' ' == (c) || '\t' == (c) || '\r' == (c) || '\n' == (c))
+
+/* A byte of a registerCommand() name. The children of a node are a
+	sibling list, commands are short and few, so it's kept compact. */
+struct phurple_command_node {
+	unsigned char byte;
+	struct phurple_command_node *child;
+	struct phurple_command_node *sibling;
+	zend_bool has_handler;
+	zend_fcall_info fci;
+	zend_fcall_info_cache fcc;
+};
+
+static struct {
+	struct phurple_command_node *root;	/* sibling list of the first bytes */
+	int count;
+} phurple_commands = {NULL, 0};
+
+static void
+phurple_command_handler_free(struct phurple_command_node *node TSRMLS_DC)
+{/*{{{*/
+	if (node->has_handler) {
+		zval_ptr_dtor(&node->fci.function_name);
+		node->has_handler = 0;
+		phurple_commands.count--;
+	}
+}/*}}}*/
+
+static void
+phurple_command_nodes_free(struct phurple_command_node *node TSRMLS_DC)
+{/*{{{*/
+	while (node) {
+		struct phurple_command_node *next = node->sibling;
+
+		phurple_command_nodes_free(node->child TSRMLS_CC);
+		phurple_command_handler_free(node TSRMLS_CC);
+		g_free(node);
+
+		node = next;
+	}
+}/*}}}*/
+
+static struct phurple_command_node **
+phurple_command_slot(struct phurple_command_node **list, unsigned char byte)
+{/*{{{*/
+	while (*list && (*list)->byte != byte) {
+		list = &(*list)->sibling;
+	}
+
+	return list;
+}/*}}}*/
+
+int
+phurple_commands_count(void)
+{/*{{{*/
+	return phurple_commands.count;
+}/*}}}*/
+
+/* Register or replace the handler of a command */
+void
+phurple_command_add(const char *name, int name_len, zend_fcall_info *fci, zend_fcall_info_cache *fcc TSRMLS_DC)
+{/*{{{*/
+	struct phurple_command_node **list = &phurple_commands.root, *node = NULL;
+	int i;
+
+	for (i = 0; i < name_len; i++) {
+		struct phurple_command_node **slot = phurple_command_slot(list, (unsigned char)name[i]);
+
+		if (!*slot) {
+			*slot = g_new0(struct phurple_command_node, 1);
+			(*slot)->byte = (unsigned char)name[i];
+		}
+
+		node = *slot;
+		list = &node->child;
+	}
+
+	phurple_command_handler_free(node TSRMLS_CC);
+
+	node->fci = *fci;
+	node->fcc = *fcc;
+	Z_ADDREF_P(node->fci.function_name);
+	node->has_handler = 1;
+	phurple_commands.count++;
+}/*}}}*/
+
+/* The nodes stay, only the handler goes away */
+int
+phurple_command_remove(const char *name, int name_len TSRMLS_DC)
+{/*{{{*/
+	struct phurple_command_node **list = &phurple_commands.root, *node = NULL;
+	int i;
+
+	for (i = 0; i < name_len; i++) {
+		node = *phurple_command_slot(list, (unsigned char)name[i]);
+		if (!node) {
+			return 0;
+		}
+		list = &node->child;
+	}
+
+	if (!node || !node->has_handler) {
+		return 0;
+	}
+
+	phurple_command_handler_free(node TSRMLS_CC);
+
+	return 1;
+}/*}}}*/
+
+void
+phurple_commands_clear(TSRMLS_D)
+{/*{{{*/
+	phurple_command_nodes_free(phurple_commands.root TSRMLS_CC);
+	phurple_commands.root = NULL;
+	phurple_commands.count = 0;
+}/*}}}*/
+
+/* Walk the trie along the message, the longest command followed by a
+	space or the end of the message wins */
+static struct phurple_command_node *
+phurple_command_lookup(const char *message, const char **rest)
+{/*{{{*/
+	struct phurple_command_node *list = phurple_commands.root, *found = NULL;
+	const char *p;
+
+	for (p = message; *p && list; p++) {
+		struct phurple_command_node *node = *phurple_command_slot(&list, (unsigned char)*p);
+
+		if (!node) {
+			break;
+		}
+
+		if (node->has_handler && (!p[1] || PHURPLE_COMMAND_SPACE(p[1]))) {
+			found = node;
+			*rest = p + 1;
+		}
+
+		list = node->child;
+	}
+
+	return found;
+}/*}}}*/
+
+/* Call the handler of the command the message starts with, if any.
+	Returns whether the message was a command. */
+int
+phurple_command_dispatch(PurpleAccount *account, const char *sender, const char *message,
+						 PurpleConversation *conv TSRMLS_DC)
+{/*{{{*/
+	struct phurple_command_node *node;
+	zend_fcall_info fci;
+	zend_fcall_info_cache fcc;
+	const char *rest = NULL, *start;
+	zval *args, *from, *conversation, *acc, *retval = NULL;
+	zval **params[4];
+
+	if (!phurple_commands.count || !message) {
+		return 0;
+	}
+
+	while (PHURPLE_COMMAND_SPACE(*message)) {
+		message++;
+	}
+
+	node = phurple_command_lookup(message, &rest);
+	if (!node) {
+		return 0;
+	}
+
+	MAKE_STD_ZVAL(args);
+	array_init(args);
+
+	while (*rest) {
+		while (PHURPLE_COMMAND_SPACE(*rest)) {
+			rest++;
+		}
+		if (!*rest) {
+			break;
+		}
+
+		start = rest;
+		while (*rest && !PHURPLE_COMMAND_SPACE(*rest)) {
+			rest++;
+		}
+
+		add_next_index_stringl(args, (char *)start, rest - start, 1);
+	}
+
+	from = phurple_string_zval(sender);
+	conversation = php_create_conversation_obj_zval(conv TSRMLS_CC);
+	acc = php_create_account_obj_zval(account TSRMLS_CC);
+
+	params[0] = &args;
+	params[1] = &from;
+	params[2] = &conversation;
+	params[3] = &acc;
+
+	/* the handler could unregister itself, work on a copy */
+	fci = node->fci;
+	fcc = node->fcc;
+	Z_ADDREF_P(fci.function_name);
+	fci.retval_ptr_ptr = &retval;
+	fci.params = params;
+	fci.param_count = 4;
+	fci.no_separation = 1;
+
+	zend_call_function(&fci, &fcc TSRMLS_CC);
+
+	if (retval) {
+		zval_ptr_dtor(&retval);
+	}
+	zval_ptr_dtor(&fci.function_name);
+	zval_ptr_dtor(&args);
+	zval_ptr_dtor(&from);
+	zval_ptr_dtor(&conversation);
+	zval_ptr_dtor(&acc);
+
+	return 1;
+}/*}}}*/
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
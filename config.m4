@@ -92,9 +92,11 @@ if test "$PHP_PHURPLE" != "no"; then
 
 	dnl end check for pcre
 
+	AC_CHECK_HEADERS([sys/epoll.h sys/timerfd.h])
+
 	PHP_NEW_EXTENSION(phurple, [ phurple.c client.c conversation.c account.c \
 	                             connection.c buddy.c buddylist.c group.c \
-								presence.c \
+								presence.c eventloop.c events.c event.c filter.c commands.c sendqueue.c scheduler.c reconnect.c workers.c buddylistiterator.c online.c presencebuf.c \
 	                           ], $ext_shared)
 
 fi
@@ -35,6 +35,21 @@
 extern zval *
 php_create_account_obj_zval(PurpleAccount *paccount TSRMLS_DC);
 
+extern zval*
+phurple_object_map_get(void *ptr TSRMLS_DC);
+
+extern void*
+phurple_object_map_find(void *ptr TSRMLS_DC);
+
+extern void
+phurple_object_map_add(void *ptr, zval *obj TSRMLS_DC);
+
+extern void
+phurple_object_map_remove(void *ptr TSRMLS_DC);
+
+extern void
+phurple_object_map_release(void *ptr, void *obj TSRMLS_DC);
+
 #if PHURPLE_INTERNAL_DEBUG
 extern void phurple_dump_zval(zval *var);
 #endif
@@ -50,6 +65,8 @@ php_connection_obj_destroy(void *obj TSRMLS_DC)
 {/*{{{*/
 	struct ze_connection_obj *zco = (struct ze_connection_obj *)obj;
 
+	phurple_object_map_release(zco->pconnection, obj TSRMLS_CC);
+
 	zend_object_std_dtor(&zco->zo TSRMLS_CC);
 
 	/*if (zco->pconnection) {
@@ -99,18 +116,46 @@ php_create_connection_obj_zval(PurpleConnection *pconnection TSRMLS_DC)
 	if (!pconnection) {
 		ALLOC_INIT_ZVAL(ret);
 		ZVAL_NULL(ret);
-	} else {
+	} else if (NULL == (ret = phurple_object_map_get(pconnection TSRMLS_CC))) {
 		ALLOC_ZVAL(ret);
 		object_init_ex(ret, PhurpleConnection_ce);
 		INIT_PZVAL(ret);
 
 		zao = (struct ze_connection_obj *) zend_object_store_get_object(ret TSRMLS_CC);
 		zao->pconnection = pconnection;
+
+		phurple_object_map_add(pconnection, ret TSRMLS_CC);
 	}
 
 	return ret;
 }/*}}}*/
 
+/* signed-off is the last signal before the connection is freed */
+static void
+phurple_connection_invalidate(PurpleConnection *pconnection)
+{/*{{{*/
+	struct ze_connection_obj *zao;
+	TSRMLS_FETCH();
+
+	zao = (struct ze_connection_obj *) phurple_object_map_find(pconnection TSRMLS_CC);
+	if (zao) {
+		zao->pconnection = NULL;
+		phurple_object_map_remove(pconnection TSRMLS_CC);
+	}
+}/*}}}*/
+
+void
+phurple_connection_signals_connect(void *handle)
+{/*{{{*/
+	purple_signal_connect_priority(purple_connections_get_handle(),
+								   "signed-off",
+								   handle,
+								   PURPLE_CALLBACK(phurple_connection_invalidate),
+								   NULL,
+								   PURPLE_SIGNAL_PRIORITY_HIGHEST
+	);
+}/*}}}*/
+
 /*
 **
 **
@@ -149,7 +194,7 @@ PHP_METHOD(PhurpleConnection, getAccount)
 		if(NULL != acc) {
 			zval *ret = php_create_account_obj_zval(acc TSRMLS_CC);
 
-			*return_value = *ret;
+			RETVAL_ZVAL(ret, 1, 1);
 
 			return;
 		}
@@ -30,6 +30,7 @@
 
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
 
 #include <purple.h>
 
@@ -45,8 +46,91 @@ phurple_long_zval(long l);
 extern zval*
 phurple_string_zval(const char *s);
 
+extern zend_bool
+phurple_hook_enabled(enum phurple_hook hook TSRMLS_DC);
+
+extern zend_bool
+phurple_hook_batched(enum phurple_hook hook TSRMLS_DC);
+
+extern zend_bool
+phurple_hook_event(enum phurple_hook hook TSRMLS_DC);
+
+extern zval *
+php_create_event_obj_zval(PurpleConversation *pconv, PurpleAccount *paccount, const char *who,
+						  const char *alias, const char *message, long flags, long mtime TSRMLS_DC);
+
+extern void
+phurple_event_obj_release(zval **event TSRMLS_DC);
+
+extern zend_bool
+phurple_hook_delivered(enum phurple_hook hook TSRMLS_DC);
+
+extern int
+phurple_command_dispatch(PurpleAccount *account, const char *sender, const char *message,
+						 PurpleConversation *conv TSRMLS_DC);
+
+extern int
+phurple_filter_accept(enum phurple_hook hook, PurpleConversation *conv, const char *sender,
+					  const char *message, PurpleMessageFlags flags, int count);
+
+extern void
+phurple_event_push(enum phurple_hook hook, PurpleAccount *account, PurpleConversation *conv,
+				   const char *name, const char *message, long flags, long extra, time_t when TSRMLS_DC);
+
+extern void
+phurple_events_forget(void *ptr);
+
+extern int
+phurple_sendq_push(PurpleConversation *conv, const char *message, int message_len TSRMLS_DC);
+
+extern void
+phurple_sendq_forget_conv(PurpleConversation *conv);
+
+extern GHashTable *
+phurple_send_bulk_begin(void);
+
+extern void
+phurple_send_bulk_end(GHashTable *prev);
+
+extern int
+phurple_send_bulk(PurpleAccount *account, PurpleConversationType type, const char *name,
+				  const char *message, int message_len TSRMLS_DC);
+
+extern zval*
+phurple_call_hook(enum phurple_hook hook, zval **retval_ptr_ptr, int param_count, ...);
+
+extern void
+phurple_frame_init(struct phurple_frame *frame, enum phurple_hook hook TSRMLS_DC);
+
+extern zval *
+phurple_frame_long(struct phurple_frame *frame, long l TSRMLS_DC);
+
+extern zval *
+phurple_frame_string(struct phurple_frame *frame, const char *str TSRMLS_DC);
+
+extern void
+phurple_frame_zval(struct phurple_frame *frame, zval *value);
+
+extern zval *
+phurple_frame_call(struct phurple_frame *frame, zval **retval_ptr_ptr TSRMLS_DC);
+
+extern void
+phurple_frame_release(struct phurple_frame *frame TSRMLS_DC);
+
 extern zval*
-call_custom_method(zval **object_pp, zend_class_entry *obj_ce, zend_function **fn_proxy, char *function_name, int function_name_len, zval **retval_ptr_ptr, int param_count, ... );
+phurple_object_map_get(void *ptr TSRMLS_DC);
+
+extern void*
+phurple_object_map_find(void *ptr TSRMLS_DC);
+
+extern void
+phurple_object_map_add(void *ptr, zval *obj TSRMLS_DC);
+
+extern void
+phurple_object_map_remove(void *ptr TSRMLS_DC);
+
+extern void
+phurple_object_map_release(void *ptr, void *obj TSRMLS_DC);
 
 #if PHURPLE_INTERNAL_DEBUG
 extern void phurple_dump_zval(zval *var);
@@ -57,6 +141,8 @@ php_conversation_obj_destroy(void *obj TSRMLS_DC)
 {/*{{{*/
 	struct ze_conversation_obj *zao = (struct ze_conversation_obj *)obj;
 
+	phurple_object_map_release(zao->pconversation, obj TSRMLS_CC);
+
 	zend_object_std_dtor(&zao->zo TSRMLS_CC);
 
 	efree(zao);
@@ -102,57 +188,65 @@ php_create_conversation_obj_zval(PurpleConversation *pconv TSRMLS_DC)
 	if (!pconv) {
 		ALLOC_INIT_ZVAL(ret);
 		ZVAL_NULL(ret);
-	} else {
+	} else if (NULL == (ret = phurple_object_map_get(pconv TSRMLS_CC))) {
 		ALLOC_ZVAL(ret);
 		object_init_ex(ret, PhurpleConversation_ce);
 		INIT_PZVAL(ret);
 
 		zco = (struct ze_conversation_obj *) zend_object_store_get_object(ret TSRMLS_CC);
 		zco->pconversation = pconv;
+
+		phurple_object_map_add(pconv, ret TSRMLS_CC);
 	}
 
 	return ret;
 }/*}}}*/
 
+/* Drop the wrapper of a conversation being deleted */
+static void
+phurple_conversation_invalidate(PurpleConversation *pconv)
+{/*{{{*/
+	struct ze_conversation_obj *zco;
+	TSRMLS_FETCH();
+
+	phurple_events_forget(pconv);
+	phurple_sendq_forget_conv(pconv);
+
+	zco = (struct ze_conversation_obj *) phurple_object_map_find(pconv TSRMLS_CC);
+	if (zco) {
+		zco->pconversation = NULL;
+		phurple_object_map_remove(pconv TSRMLS_CC);
+	}
+}/*}}}*/
+
 static gboolean
-phurple_writing_msg_all_cb(char *method, PurpleAccount *account, const char *who, char **message, PurpleConversation *conv, PurpleMessageFlags flags)
+phurple_writing_msg_all_cb(enum phurple_hook hook, PurpleAccount *account, const char *who, char **message, PurpleConversation *conv, PurpleMessageFlags flags)
 {/*{{{*/
 	gboolean ret = 0;
-	zval *conversation, *acc, *tmp0, *tmp1, *tmp2;
-	zval *client;
+	struct phurple_frame frame;
+	zval *msg;
 	zval *method_ret = NULL;
-	zend_class_entry *ce;
 	char *orig_msg_ptr;
 	TSRMLS_FETCH();
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
+	if (!phurple_hook_enabled(hook TSRMLS_CC)) {
+		return ret;
+	}
 
-	conversation = php_create_conversation_obj_zval(conv TSRMLS_CC);
-	acc = php_create_account_obj_zval(account TSRMLS_CC);
-	tmp0 = phurple_string_zval(who);
-	tmp1 = phurple_string_zval(*message);
-	orig_msg_ptr = Z_STRVAL_P(tmp1);
-	tmp2 = phurple_long_zval((long)flags);
+	phurple_frame_init(&frame, hook TSRMLS_CC);
+	phurple_frame_zval(&frame, php_create_account_obj_zval(account TSRMLS_CC));
+	phurple_frame_string(&frame, who TSRMLS_CC);
+	msg = phurple_frame_string(&frame, *message TSRMLS_CC);
+	orig_msg_ptr = Z_STRVAL_P(msg);
+	phurple_frame_zval(&frame, php_create_conversation_obj_zval(conv TSRMLS_CC));
+	phurple_frame_long(&frame, (long)flags TSRMLS_CC);
 
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   method,
-					   strlen(method),
-					   &method_ret,
-					   5,
-					   &acc,
-					   &tmp0,
-					   &tmp1,
-					   &conversation,
-					   &tmp2
-	);
+	phurple_frame_call(&frame, &method_ret TSRMLS_CC);
 
-	convert_to_string(tmp1);
-	if (orig_msg_ptr != Z_STRVAL_P(tmp1)) {
+	convert_to_string(msg);
+	if (orig_msg_ptr != Z_STRVAL_P(msg)) {
 		g_free(*message);
-		*message = g_strdup(Z_STRVAL_P(tmp1));
+		*message = g_strdup(Z_STRVAL_P(msg));
 	}
 
 	if (NULL != method_ret) {
@@ -160,12 +254,10 @@ phurple_writing_msg_all_cb(char *method, PurpleAccount *account, const char *who
 		ret = Z_BVAL_P(method_ret);
 	}
 
-	zval_ptr_dtor(&conversation);
-	zval_ptr_dtor(&acc);
-	zval_ptr_dtor(&tmp0);
-	zval_ptr_dtor(&tmp1);
-	zval_ptr_dtor(&tmp2);
-	zval_ptr_dtor(&method_ret);
+	phurple_frame_release(&frame TSRMLS_CC);
+	if (method_ret) {
+		zval_ptr_dtor(&method_ret);
+	}
 
 	return ret;
 }/*}}}*/
@@ -173,263 +265,213 @@ phurple_writing_msg_all_cb(char *method, PurpleAccount *account, const char *who
 static gboolean
 phurple_writing_im_msg(PurpleAccount *account, const char *who, char **message, PurpleConversation *conv, PurpleMessageFlags flags)
 {/*{{{*/
-	return phurple_writing_msg_all_cb("writingimmsg", account, who, message, conv, flags);
+	return phurple_writing_msg_all_cb(PHURPLE_HOOK_WRITING_IM_MSG, account, who, message, conv, flags);
 }/*}}}*/
 
 static gboolean
 phurple_writing_chat_msg(PurpleAccount *account, const char *who, char **message, PurpleConversation *conv, PurpleMessageFlags flags)
 {/*{{{*/
-	return phurple_writing_msg_all_cb("writingchatmsg", account, who, message, conv, flags);
+	return phurple_writing_msg_all_cb(PHURPLE_HOOK_WRITING_CHAT_MSG, account, who, message, conv, flags);
 }/*}}}*/
 
 static void
-phurple_wrote_msg_all_cb(char *method, PurpleAccount *account, const char *who, char *message, PurpleConversation *conv, PurpleMessageFlags flags)
+phurple_wrote_msg_all_cb(enum phurple_hook hook, PurpleAccount *account, const char *who, char *message, PurpleConversation *conv, PurpleMessageFlags flags)
 {/*{{{*/
-	zval *conversation, *acc, *tmp0, *tmp1, *tmp2;
-	zval *client;
-	zend_class_entry *ce;
+	struct phurple_frame frame;
 	TSRMLS_FETCH();
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
+	if (!phurple_hook_enabled(hook TSRMLS_CC)) {
+		return;
+	}
 
-	conversation = php_create_conversation_obj_zval(conv TSRMLS_CC);
-	acc = php_create_account_obj_zval(account TSRMLS_CC);
-	tmp0 = phurple_string_zval(who);
-	tmp1 = phurple_string_zval(message);
-	tmp2 = phurple_long_zval((long)flags);
+	if (phurple_hook_batched(hook TSRMLS_CC)) {
+		phurple_event_push(hook, account, conv, who, message, flags, 0, 0 TSRMLS_CC);
+		return;
+	}
 
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   method,
-					   strlen(method),
-					   NULL,
-					   5,
-					   &acc,
-					   &tmp0,
-					   &tmp1,
-					   &conversation,
-					   &tmp2
-	);
+	if (phurple_hook_event(hook TSRMLS_CC)) {
+		zval *event = php_create_event_obj_zval(conv, account, who, NULL, message, (long)flags, (long)time(NULL) TSRMLS_CC);
 
-	zval_ptr_dtor(&conversation);
-	zval_ptr_dtor(&acc);
-	zval_ptr_dtor(&tmp0);
-	zval_ptr_dtor(&tmp1);
-	zval_ptr_dtor(&tmp2);
+		phurple_call_hook(hook, NULL, 1, &event);
+		phurple_event_obj_release(&event TSRMLS_CC);
+		return;
+	}
+
+	phurple_frame_init(&frame, hook TSRMLS_CC);
+	phurple_frame_zval(&frame, php_create_account_obj_zval(account TSRMLS_CC));
+	phurple_frame_string(&frame, who TSRMLS_CC);
+	phurple_frame_string(&frame, message TSRMLS_CC);
+	phurple_frame_zval(&frame, php_create_conversation_obj_zval(conv TSRMLS_CC));
+	phurple_frame_long(&frame, (long)flags TSRMLS_CC);
+
+	phurple_frame_call(&frame, NULL TSRMLS_CC);
+	phurple_frame_release(&frame TSRMLS_CC);
 }/*}}}*/
 
 static void
 phurple_wrote_im_msg(PurpleAccount *account, const char *who, char *message, PurpleConversation *conv, PurpleMessageFlags flags)
 {/*{{{*/
-	phurple_wrote_msg_all_cb("wroteimmsg", account, who, message, conv, flags);
+	phurple_wrote_msg_all_cb(PHURPLE_HOOK_WROTE_IM_MSG, account, who, message, conv, flags);
 }/*}}}*/
 
 static void
 phurple_wrote_chat_msg(PurpleAccount *account, const char *who, char *message, PurpleConversation *conv, PurpleMessageFlags flags)
 {/*{{{*/
-	phurple_wrote_msg_all_cb("wrotechatmsg", account, who, message, conv, flags);
+	phurple_wrote_msg_all_cb(PHURPLE_HOOK_WROTE_CHAT_MSG, account, who, message, conv, flags);
 }/*}}}*/
 
 static void
 phurple_sending_im_msg(PurpleAccount *account, const char *receiver, char **message)
 {/*{{{*/
-	zval *acc, *tmp0, *tmp1;
-	zval *client;
-	zend_class_entry *ce;
+	struct phurple_frame frame;
+	zval *msg;
 	char *orig_msg_ptr;
 	TSRMLS_FETCH();
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
+	if (!phurple_hook_enabled(PHURPLE_HOOK_SENDING_IM_MSG TSRMLS_CC)) {
+		return;
+	}
 
-	acc = php_create_account_obj_zval(account TSRMLS_CC);
-	tmp0 = phurple_string_zval(receiver);
-	tmp1 = phurple_string_zval(*message);
-	orig_msg_ptr = Z_STRVAL_P(tmp1);
+	phurple_frame_init(&frame, PHURPLE_HOOK_SENDING_IM_MSG TSRMLS_CC);
+	phurple_frame_zval(&frame, php_create_account_obj_zval(account TSRMLS_CC));
+	phurple_frame_string(&frame, receiver TSRMLS_CC);
+	msg = phurple_frame_string(&frame, *message TSRMLS_CC);
+	orig_msg_ptr = Z_STRVAL_P(msg);
 
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   "sendingimmsg",
-					   sizeof("sendingimmsg")-1,
-					   NULL,
-					   3,
-					   &acc,
-					   &tmp0,
-					   &tmp1
-	);
+	phurple_frame_call(&frame, NULL TSRMLS_CC);
 
-	convert_to_string(tmp1);
-	if (orig_msg_ptr != Z_STRVAL_P(tmp1)) {
+	convert_to_string(msg);
+	if (orig_msg_ptr != Z_STRVAL_P(msg)) {
 		g_free(*message);
-		*message = g_strdup(Z_STRVAL_P(tmp1));
+		*message = g_strdup(Z_STRVAL_P(msg));
 	}
 
-	zval_ptr_dtor(&acc);
-	zval_ptr_dtor(&tmp0);
-	zval_ptr_dtor(&tmp1);
+	phurple_frame_release(&frame TSRMLS_CC);
 }/*}}}*/
 
 static void
 phurple_sending_chat_msg(PurpleAccount *account, char **message, int id)
 {/*{{{*/
-	zval *acc, *tmp0, *tmp1;
-	zval *client;
-	zend_class_entry *ce;
+	struct phurple_frame frame;
+	zval *msg;
 	char *orig_msg_ptr;
 	TSRMLS_FETCH();
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
+	if (!phurple_hook_enabled(PHURPLE_HOOK_SENDING_CHAT_MSG TSRMLS_CC)) {
+		return;
+	}
 
-	acc = php_create_account_obj_zval(account TSRMLS_CC);
-	tmp0 = phurple_string_zval(*message);
-	orig_msg_ptr = Z_STRVAL_P(tmp0);
-	tmp1 = phurple_long_zval(id);
+	phurple_frame_init(&frame, PHURPLE_HOOK_SENDING_CHAT_MSG TSRMLS_CC);
+	phurple_frame_zval(&frame, php_create_account_obj_zval(account TSRMLS_CC));
+	msg = phurple_frame_string(&frame, *message TSRMLS_CC);
+	orig_msg_ptr = Z_STRVAL_P(msg);
+	phurple_frame_long(&frame, id TSRMLS_CC);
 
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   "sendingchatmsg",
-					   sizeof("sendingchatmsg")-1,
-					   NULL,
-					   3,
-					   &acc,
-					   &tmp0,
-					   &tmp1
-	);
+	phurple_frame_call(&frame, NULL TSRMLS_CC);
 
-	convert_to_string(tmp0);
-	if (orig_msg_ptr != Z_STRVAL_P(tmp0)) {
+	convert_to_string(msg);
+	if (orig_msg_ptr != Z_STRVAL_P(msg)) {
 		g_free(*message);
-		*message = g_strdup(Z_STRVAL_P(tmp0));
+		*message = g_strdup(Z_STRVAL_P(msg));
 	}
 
-	zval_ptr_dtor(&acc);
-	zval_ptr_dtor(&tmp0);
-	zval_ptr_dtor(&tmp1);
+	phurple_frame_release(&frame TSRMLS_CC);
 }/*}}}*/
 
 static void
 phurple_sent_im_msg(PurpleAccount *account, const char *receiver, const char *message)
 {/*{{{*/
-	zval *acc, *tmp0, *tmp1;
-	zval *client;
-	zend_class_entry *ce;
+	struct phurple_frame frame;
 	TSRMLS_FETCH();
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
+	if (!phurple_hook_enabled(PHURPLE_HOOK_SENT_IM_MSG TSRMLS_CC)) {
+		return;
+	}
 
-	acc = php_create_account_obj_zval(account TSRMLS_CC);
-	tmp0 = phurple_string_zval(receiver);
-	tmp1 = phurple_string_zval(message);
+	if (phurple_hook_batched(PHURPLE_HOOK_SENT_IM_MSG TSRMLS_CC)) {
+		phurple_event_push(PHURPLE_HOOK_SENT_IM_MSG, account, NULL, receiver, message, 0, 0, 0 TSRMLS_CC);
+		return;
+	}
 
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   "sentimmsg",
-					   sizeof("sentimmsg")-1,
-					   NULL,
-					   3,
-					   &acc,
-					   &tmp0,
-					   &tmp1
-	);
+	phurple_frame_init(&frame, PHURPLE_HOOK_SENT_IM_MSG TSRMLS_CC);
+	phurple_frame_zval(&frame, php_create_account_obj_zval(account TSRMLS_CC));
+	phurple_frame_string(&frame, receiver TSRMLS_CC);
+	phurple_frame_string(&frame, message TSRMLS_CC);
 
-	zval_ptr_dtor(&acc);
-	zval_ptr_dtor(&tmp0);
-	zval_ptr_dtor(&tmp1);
+	phurple_frame_call(&frame, NULL TSRMLS_CC);
+	phurple_frame_release(&frame TSRMLS_CC);
 }/*}}}*/
 
 static void
 phurple_sent_chat_msg(PurpleAccount *account, const char *message, int id)
 {/*{{{*/
-	zval *acc, *tmp0, *tmp1;
-	zval *client;
-	zend_class_entry *ce;
+	struct phurple_frame frame;
 	TSRMLS_FETCH();
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
+	if (!phurple_hook_enabled(PHURPLE_HOOK_SENT_CHAT_MSG TSRMLS_CC)) {
+		return;
+	}
 
-	acc = php_create_account_obj_zval(account TSRMLS_CC);
-	tmp0 = phurple_string_zval(message);
-	tmp1 = phurple_long_zval(id);
+	phurple_frame_init(&frame, PHURPLE_HOOK_SENT_CHAT_MSG TSRMLS_CC);
+	phurple_frame_zval(&frame, php_create_account_obj_zval(account TSRMLS_CC));
+	phurple_frame_string(&frame, message TSRMLS_CC);
+	phurple_frame_long(&frame, id TSRMLS_CC);
 
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   "sentchatmsg",
-					   sizeof("sentchatmsg")-1,
-					   NULL,
-					   3,
-					   &acc,
-					   &tmp0,
-					   &tmp1
-	);
-
-	zval_ptr_dtor(&acc);
-	zval_ptr_dtor(&tmp0);
-	zval_ptr_dtor(&tmp1);
-	
+	phurple_frame_call(&frame, NULL TSRMLS_CC);
+	phurple_frame_release(&frame TSRMLS_CC);
 }/*}}}*/
 
 static gboolean
-phurple_receiving_msg_all_cb(char *method, PurpleAccount *account, char **sender, char **message, PurpleConversation *conv, PurpleMessageFlags *flags)
+phurple_receiving_msg_all_cb(enum phurple_hook hook, PurpleAccount *account, char **sender, char **message, PurpleConversation *conv, PurpleMessageFlags *flags)
 {/*{{{*/
 	gboolean ret = 0;
-	zval *conversation, *acc, *tmp0, *tmp1, *tmp2;
-	zval *client;
+	struct phurple_frame frame;
+	zval *snd, *msg, *flg;
 	zval *method_ret = NULL;
-	zend_class_entry *ce;
 	char *orig_msg_ptr, *orig_sender_ptr;
 	PurpleMessageFlags orig_flags;
+	enum phurple_hook received;
 	TSRMLS_FETCH();
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
+	if (!phurple_hook_enabled(hook TSRMLS_CC)) {
+		return ret;
+	}
 
-	acc = php_create_account_obj_zval(account TSRMLS_CC);
-	tmp0 = phurple_string_zval(*sender);
-	orig_sender_ptr = Z_STRVAL_P(tmp0);
-	tmp1 = phurple_string_zval(*message);
-	orig_msg_ptr = Z_STRVAL_P(tmp1);
-	conversation = php_create_conversation_obj_zval(conv TSRMLS_CC);
-	tmp2 = phurple_long_zval((long)*flags);
+	received = PHURPLE_HOOK_RECEIVING_CHAT_MSG == hook ? PHURPLE_HOOK_RECEIVED_CHAT_MSG : PHURPLE_HOOK_RECEIVED_IM_MSG;
+
+	/* the received hook filters the message again and counts the drop then */
+	if (!phurple_filter_accept(hook, conv, *sender, *message, *flags,
+							   !phurple_hook_enabled(received TSRMLS_CC) || !phurple_hook_delivered(received TSRMLS_CC))) {
+		return ret;
+	}
+
+	phurple_frame_init(&frame, hook TSRMLS_CC);
+	phurple_frame_zval(&frame, php_create_account_obj_zval(account TSRMLS_CC));
+	snd = phurple_frame_string(&frame, *sender TSRMLS_CC);
+	orig_sender_ptr = Z_STRVAL_P(snd);
+	msg = phurple_frame_string(&frame, *message TSRMLS_CC);
+	orig_msg_ptr = Z_STRVAL_P(msg);
+	phurple_frame_zval(&frame, php_create_conversation_obj_zval(conv TSRMLS_CC));
+	flg = phurple_frame_long(&frame, (long)*flags TSRMLS_CC);
 	orig_flags = *flags;
 
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   method,
-					   strlen(method),
-					   &method_ret,
-					   5,
-					   &acc,
-					   &tmp0,
-					   &tmp1,
-					   &conversation,
-					   &tmp2
-	);
+	phurple_frame_call(&frame, &method_ret TSRMLS_CC);
 
-	convert_to_string(tmp0);
-	if (orig_sender_ptr != Z_STRVAL_P(tmp0)) {
+	convert_to_string(snd);
+	if (orig_sender_ptr != Z_STRVAL_P(snd)) {
 		g_free(*sender);
-		*sender = g_strdup(Z_STRVAL_P(tmp0));
+		*sender = g_strdup(Z_STRVAL_P(snd));
 	}
 
-	convert_to_string(tmp1);
-	if (orig_msg_ptr != Z_STRVAL_P(tmp1)) {
+	convert_to_string(msg);
+	if (orig_msg_ptr != Z_STRVAL_P(msg)) {
 		g_free(*message);
-		*message = g_strdup(Z_STRVAL_P(tmp1));
+		*message = g_strdup(Z_STRVAL_P(msg));
 	}
 
-	convert_to_long(tmp2);
-	if (orig_flags != Z_LVAL_P(tmp2)) {
-		*flags = Z_LVAL_P(tmp2);
+	convert_to_long(flg);
+	if (orig_flags != Z_LVAL_P(flg)) {
+		*flags = Z_LVAL_P(flg);
 	}
 
 	if (NULL != method_ret) {
@@ -437,12 +479,10 @@ phurple_receiving_msg_all_cb(char *method, PurpleAccount *account, char **sender
 		ret = Z_BVAL_P(method_ret);
 	}
 
-	zval_ptr_dtor(&conversation);
-	zval_ptr_dtor(&acc);
-	zval_ptr_dtor(&tmp0);
-	zval_ptr_dtor(&tmp1);
-	zval_ptr_dtor(&tmp2);
-	zval_ptr_dtor(&method_ret);
+	phurple_frame_release(&frame TSRMLS_CC);
+	if (method_ret) {
+		zval_ptr_dtor(&method_ret);
+	}
 
 	return ret;
 }/*}}}*/
@@ -450,121 +490,122 @@ phurple_receiving_msg_all_cb(char *method, PurpleAccount *account, char **sender
 static gboolean
 phurple_receiving_im_msg(PurpleAccount *account, char **sender, char **message, PurpleConversation *conv, PurpleMessageFlags *flags)
 {/*{{{*/
-	return phurple_receiving_msg_all_cb("receivingimmsg", account, sender, message, conv, flags);
+	return phurple_receiving_msg_all_cb(PHURPLE_HOOK_RECEIVING_IM_MSG, account, sender, message, conv, flags);
 }/*}}}*/
 
 static gboolean
 phurple_receiving_chat_msg(PurpleAccount *account, char **sender, char **message, PurpleConversation *conv, PurpleMessageFlags *flags)
 {/*{{{*/
-	return phurple_receiving_msg_all_cb("receivingchatmsg", account, sender, message, conv, flags);
+	return phurple_receiving_msg_all_cb(PHURPLE_HOOK_RECEIVING_CHAT_MSG, account, sender, message, conv, flags);
 }/*}}}*/
 
 static void
-phurple_received_msg_all_cb(char *method, PurpleAccount *account, char *sender, char *message, PurpleConversation *conv, PurpleMessageFlags flags)
+phurple_received_msg_all_cb(enum phurple_hook hook, PurpleAccount *account, char *sender, char *message, PurpleConversation *conv, PurpleMessageFlags flags)
 {/*{{{*/
-	zval *conversation, *acc, *tmp0, *tmp1, *tmp2;
-	zval *client;
-	zend_class_entry *ce;
+	struct phurple_frame frame;
 	TSRMLS_FETCH();
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
+	if (!phurple_hook_enabled(hook TSRMLS_CC)) {
+		return;
+	}
 
-	acc = php_create_account_obj_zval(account TSRMLS_CC);
-	tmp0 = phurple_string_zval(sender);
-	tmp1 = phurple_string_zval(message);
-	conversation = php_create_conversation_obj_zval(conv TSRMLS_CC);
-	tmp2 = phurple_long_zval((long)flags);
+	/* registerCommand() messages are consumed by their handler. The own
+		messages echoed back by a chat and the backlog replayed on join are no
+		commands, a bot answering with a command would trigger itself. */
+	if (!(flags & (PURPLE_MESSAGE_SEND | PURPLE_MESSAGE_DELAYED))
+		&& phurple_command_dispatch(account, sender, message, conv TSRMLS_CC)) {
+		return;
+	}
 
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   method,
-					   strlen(method),
-					   NULL,
-					   5,
-					   &acc,
-					   &tmp0,
-					   &tmp1,
-					   &conversation,
-					   &tmp2
-	);
+	if (!phurple_hook_delivered(hook TSRMLS_CC)) {
+		return;
+	}
 
-	zval_ptr_dtor(&conversation);
-	zval_ptr_dtor(&acc);
-	zval_ptr_dtor(&tmp0);
-	zval_ptr_dtor(&tmp1);
-	zval_ptr_dtor(&tmp2);
+	/* before any zval is built, most chat traffic ends here */
+	if (!phurple_filter_accept(hook, conv, sender, message, flags, 1)) {
+		return;
+	}
+
+	if (phurple_hook_batched(hook TSRMLS_CC)) {
+		phurple_event_push(hook, account, conv, sender, message, flags, 0, 0 TSRMLS_CC);
+		return;
+	}
+
+	if (phurple_hook_event(hook TSRMLS_CC)) {
+		zval *event = php_create_event_obj_zval(conv, account, sender, NULL, message, (long)flags, (long)time(NULL) TSRMLS_CC);
+
+		phurple_call_hook(hook, NULL, 1, &event);
+		phurple_event_obj_release(&event TSRMLS_CC);
+		return;
+	}
+
+	phurple_frame_init(&frame, hook TSRMLS_CC);
+	phurple_frame_zval(&frame, php_create_account_obj_zval(account TSRMLS_CC));
+	phurple_frame_string(&frame, sender TSRMLS_CC);
+	phurple_frame_string(&frame, message TSRMLS_CC);
+	phurple_frame_zval(&frame, php_create_conversation_obj_zval(conv TSRMLS_CC));
+	phurple_frame_long(&frame, (long)flags TSRMLS_CC);
+
+	phurple_frame_call(&frame, NULL TSRMLS_CC);
+	phurple_frame_release(&frame TSRMLS_CC);
 }/*}}}*/
 
 static void
 phurple_received_im_msg(PurpleAccount *account, char *sender, char *message, PurpleConversation *conv, PurpleMessageFlags flags)
 {/*{{{*/
-	phurple_received_msg_all_cb("receivedimmsg", account, sender, message, conv, flags);
+	phurple_received_msg_all_cb(PHURPLE_HOOK_RECEIVED_IM_MSG, account, sender, message, conv, flags);
 }/*}}}*/
 
 static void
 phurple_received_chat_msg(PurpleAccount *account, char *sender, char *message, PurpleConversation *conv, PurpleMessageFlags flags)
 {/*{{{*/
-	phurple_received_msg_all_cb("receivedchatmsg", account, sender, message, conv, flags);
+	phurple_received_msg_all_cb(PHURPLE_HOOK_RECEIVED_CHAT_MSG, account, sender, message, conv, flags);
 }/*}}}*/
 
 static void
 phurple_blocked_im_msg(PurpleAccount *account, const char *sender, const char *message, PurpleMessageFlags flags, time_t when)
 {/*{{{*/
-	zval *ts, *acc, *tmp0, *tmp1, *tmp2;
-	zval *client;
-	zend_class_entry *ce;
+	struct phurple_frame frame;
 	TSRMLS_FETCH();
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
+	if (!phurple_hook_enabled(PHURPLE_HOOK_BLOCKED_IM_MSG TSRMLS_CC)) {
+		return;
+	}
 
-	acc = php_create_account_obj_zval(account TSRMLS_CC);
-	tmp0 = phurple_string_zval(sender);
-	tmp1 = phurple_string_zval(message);
-	tmp2 = phurple_long_zval((long)flags);
-	ts = phurple_long_zval((long)when);
+	if (phurple_hook_batched(PHURPLE_HOOK_BLOCKED_IM_MSG TSRMLS_CC)) {
+		phurple_event_push(PHURPLE_HOOK_BLOCKED_IM_MSG, account, NULL, sender, message, flags, 0, when TSRMLS_CC);
+		return;
+	}
 
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   "blockedimmsg",
-					   sizeof("blockedimmsg")-1,
-					   NULL,
-					   5,
-					   &acc,
-					   &tmp0,
-					   &tmp1,
-					   &tmp2,
-					   ts
-	);
+	phurple_frame_init(&frame, PHURPLE_HOOK_BLOCKED_IM_MSG TSRMLS_CC);
+	phurple_frame_zval(&frame, php_create_account_obj_zval(account TSRMLS_CC));
+	phurple_frame_string(&frame, sender TSRMLS_CC);
+	phurple_frame_string(&frame, message TSRMLS_CC);
+	phurple_frame_long(&frame, (long)flags TSRMLS_CC);
+	phurple_frame_long(&frame, (long)when TSRMLS_CC);
 
-	zval_ptr_dtor(&ts);
-	zval_ptr_dtor(&acc);
-	zval_ptr_dtor(&tmp0);
-	zval_ptr_dtor(&tmp1);
-	zval_ptr_dtor(&tmp2);
+	phurple_frame_call(&frame, NULL TSRMLS_CC);
+	phurple_frame_release(&frame TSRMLS_CC);
 }/*}}}*/
 
 static void
-phurple_conversation_arg_only_cb(char *method, PurpleConversation *conv)
+phurple_conversation_arg_only_cb(enum phurple_hook hook, PurpleConversation *conv)
 {/*{{{*/
 	zval *conversation;
-	zval *client;
-	zend_class_entry *ce;
 	TSRMLS_FETCH();
 
+	if (!phurple_hook_enabled(hook TSRMLS_CC)) {
+		return;
+	}
+
+	if (phurple_hook_batched(hook TSRMLS_CC)) {
+		phurple_event_push(hook, NULL, conv, NULL, NULL, 0, 0, 0 TSRMLS_CC);
+		return;
+	}
+
 	conversation = php_create_conversation_obj_zval(conv TSRMLS_CC);
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
-	
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   method,
-					   strlen(method),
+	phurple_call_hook(hook,
 					   NULL,
 					   1,
 					   &conversation
@@ -576,28 +617,28 @@ phurple_conversation_arg_only_cb(char *method, PurpleConversation *conv)
 static void
 phurple_conversation_created(PurpleConversation *conv)
 {/*{{{*/
-	phurple_conversation_arg_only_cb("conversationcreated", conv);
+	phurple_conversation_arg_only_cb(PHURPLE_HOOK_CONVERSATION_CREATED, conv);
 }/*}}}*/
 
 static void
 phurple_conversation_updated(PurpleConversation *conv, PurpleConvUpdateType type)
 {/*{{{*/
 	zval *conversation, *uptype;
-	zval *client;
-	zend_class_entry *ce;
 	TSRMLS_FETCH();
 
+	if (!phurple_hook_enabled(PHURPLE_HOOK_CONVERSATION_UPDATED TSRMLS_CC)) {
+		return;
+	}
+
+	if (phurple_hook_batched(PHURPLE_HOOK_CONVERSATION_UPDATED TSRMLS_CC)) {
+		phurple_event_push(PHURPLE_HOOK_CONVERSATION_UPDATED, NULL, conv, NULL, NULL, type, 0, 0 TSRMLS_CC);
+		return;
+	}
+
 	conversation = php_create_conversation_obj_zval(conv TSRMLS_CC);
 	uptype = phurple_long_zval(type);
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
-	
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   "conversationupdated",
-					   sizeof("conversationupdated")-1,
+	phurple_call_hook(PHURPLE_HOOK_CONVERSATION_UPDATED,
 					   NULL,
 					   2,
 					   &conversation,
@@ -611,28 +652,28 @@ phurple_conversation_updated(PurpleConversation *conv, PurpleConvUpdateType type
 static void
 phurple_deleting_conversation(PurpleConversation *conv)
 {/*{{{*/
-	phurple_conversation_arg_only_cb("deletingconversation", conv);
+	phurple_conversation_arg_only_cb(PHURPLE_HOOK_DELETING_CONVERSATION, conv);
 }/*}}}*/
 
 static void
-phurple_buddy_typing_all_cb(char *method, PurpleAccount *account, const char *name)
+phurple_buddy_typing_all_cb(enum phurple_hook hook, PurpleAccount *account, const char *name)
 {/*{{{*/
 	zval *acc, *nm;
-	zval *client;
-	zend_class_entry *ce;
 	TSRMLS_FETCH();
 
+	if (!phurple_hook_enabled(hook TSRMLS_CC)) {
+		return;
+	}
+
+	if (phurple_hook_batched(hook TSRMLS_CC)) {
+		phurple_event_push(hook, account, NULL, name, NULL, 0, 0, 0 TSRMLS_CC);
+		return;
+	}
+
 	acc = php_create_account_obj_zval(account TSRMLS_CC);
 	nm = phurple_string_zval(name);
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
-	
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   method,
-					   strlen(method),
+	phurple_call_hook(hook,
 					   NULL,
 					   2,
 					   &acc,
@@ -646,13 +687,13 @@ phurple_buddy_typing_all_cb(char *method, PurpleAccount *account, const char *na
 static void
 phurple_buddy_typing(PurpleAccount *account, const char *name)
 {/*{{{*/
-	phurple_buddy_typing_all_cb("buddytyping", account, name);
+	phurple_buddy_typing_all_cb(PHURPLE_HOOK_BUDDY_TYPING, account, name);
 }/*}}}*/
 
 static void
 phurple_buddy_typing_stopped(PurpleAccount *account, const char *name)
 {/*{{{*/
-	phurple_buddy_typing_all_cb("buddytypingstopped", account, name);
+	phurple_buddy_typing_all_cb(PHURPLE_HOOK_BUDDY_TYPING_STOPPED, account, name);
 }/*}}}*/
 
 static gboolean
@@ -660,23 +701,18 @@ phurple_chat_buddy_joining(PurpleConversation *conv, const char *name, PurpleCon
 {/*{{{*/
 	gboolean ret = 0;
 	zval *conversation, *nm, *bflags;
-	zval *client;
-	zval *method_ret;
-	zend_class_entry *ce;
+	zval *method_ret = NULL;
 	TSRMLS_FETCH();
 
+	if (!phurple_hook_enabled(PHURPLE_HOOK_CHAT_BUDDY_JOINING TSRMLS_CC)) {
+		return ret;
+	}
+
 	conversation = php_create_conversation_obj_zval(conv TSRMLS_CC);
 	nm = phurple_string_zval(name);
 	bflags = phurple_long_zval(flags);
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
-
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   "chatbuddyjoining",
-					   sizeof("chatbuddyjoining")-1,
+	phurple_call_hook(PHURPLE_HOOK_CHAT_BUDDY_JOINING,
 					   &method_ret,
 					   3,
 					   &conversation,
@@ -692,7 +728,9 @@ phurple_chat_buddy_joining(PurpleConversation *conv, const char *name, PurpleCon
 	zval_ptr_dtor(&conversation);
 	zval_ptr_dtor(&nm);
 	zval_ptr_dtor(&bflags);
-	zval_ptr_dtor(&method_ret);
+	if (method_ret) {
+		zval_ptr_dtor(&method_ret);
+	}
 
 	return ret;
 }/*}}}*/
@@ -701,23 +739,23 @@ static void
 phurple_chat_buddy_joined(PurpleConversation *conv, const char *name, PurpleConvChatBuddyFlags flags, gboolean new_arrival)
 {/*{{{*/
 	zval *conversation, *nm, *bflags, *newa;
-	zval *client;
-	zend_class_entry *ce;
 	TSRMLS_FETCH();
 
+	if (!phurple_hook_enabled(PHURPLE_HOOK_CHAT_BUDDY_JOINED TSRMLS_CC)) {
+		return;
+	}
+
+	if (phurple_hook_batched(PHURPLE_HOOK_CHAT_BUDDY_JOINED TSRMLS_CC)) {
+		phurple_event_push(PHURPLE_HOOK_CHAT_BUDDY_JOINED, NULL, conv, name, NULL, flags, new_arrival, 0 TSRMLS_CC);
+		return;
+	}
+
 	conversation = php_create_conversation_obj_zval(conv TSRMLS_CC);
 	nm = phurple_string_zval(name);
 	bflags = phurple_long_zval(flags);
 	newa = phurple_long_zval(new_arrival);
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
-
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   "chatbuddyjoined",
-					   sizeof("chatbuddyjoined")-1,
+	phurple_call_hook(PHURPLE_HOOK_CHAT_BUDDY_JOINED,
 					   NULL,
 					   4,
 					   &conversation,
@@ -736,20 +774,15 @@ static void
 phurple_chat_join_failed(PurpleConnection *gc, GHashTable *components)
 {/*{{{*/
 	zval *connection;
-	zval *client;
-	zend_class_entry *ce;
 	TSRMLS_FETCH();
 
+	if (!phurple_hook_enabled(PHURPLE_HOOK_CHAT_JOIN_FAILED TSRMLS_CC)) {
+		return;
+	}
+
 	connection = php_create_connection_obj_zval(gc TSRMLS_CC);
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
-	
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   "chatjoinfailed",
-					   sizeof("chatjoinfailed")+1,
+	phurple_call_hook(PHURPLE_HOOK_CHAT_JOIN_FAILED,
 					   NULL,
 					   1,
 					   &connection
@@ -762,25 +795,20 @@ phurple_chat_join_failed(PurpleConnection *gc, GHashTable *components)
 static gboolean
 phurple_chat_buddy_leaving(PurpleConversation *conv, const char *name, const char *reason)
 {/*{{{*/
-	gboolean ret;
+	gboolean ret = 0;
 	zval *conversation, *nm, *reas;
-	zval *client;
-	zval *method_ret;
-	zend_class_entry *ce;
+	zval *method_ret = NULL;
 	TSRMLS_FETCH();
 
+	if (!phurple_hook_enabled(PHURPLE_HOOK_CHAT_BUDDY_LEAVING TSRMLS_CC)) {
+		return ret;
+	}
+
 	conversation = php_create_conversation_obj_zval(conv TSRMLS_CC);
 	nm = phurple_string_zval(name);
 	reas = phurple_string_zval(reason);
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
-
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   "chatbuddyleaving",
-					   sizeof("chatbuddyleaving")-1,
+	phurple_call_hook(PHURPLE_HOOK_CHAT_BUDDY_LEAVING,
 					   &method_ret,
 					   3,
 					   &conversation,
@@ -788,13 +816,17 @@ phurple_chat_buddy_leaving(PurpleConversation *conv, const char *name, const cha
 					   &reas
 	);
 
-	convert_to_boolean(method_ret);
-	ret = Z_BVAL_P(method_ret);
+	if (NULL != method_ret) {
+		convert_to_boolean(method_ret);
+		ret = Z_BVAL_P(method_ret);
+	}
 
 	zval_ptr_dtor(&conversation);
 	zval_ptr_dtor(&nm);
 	zval_ptr_dtor(&reas);
-	zval_ptr_dtor(&method_ret);
+	if (method_ret) {
+		zval_ptr_dtor(&method_ret);
+	}
 
 	return ret;
 }/*}}}*/
@@ -803,22 +835,22 @@ static void
 phurple_chat_buddy_left(PurpleConversation *conv, const char *name, const char *reason)
 {/*{{{*/
 	zval *conversation, *nm, *reas;
-	zval *client;
-	zend_class_entry *ce;
 	TSRMLS_FETCH();
 
+	if (!phurple_hook_enabled(PHURPLE_HOOK_CHAT_BUDDY_LEFT TSRMLS_CC)) {
+		return;
+	}
+
+	if (phurple_hook_batched(PHURPLE_HOOK_CHAT_BUDDY_LEFT TSRMLS_CC)) {
+		phurple_event_push(PHURPLE_HOOK_CHAT_BUDDY_LEFT, NULL, conv, name, reason, 0, 0, 0 TSRMLS_CC);
+		return;
+	}
+
 	conversation = php_create_conversation_obj_zval(conv TSRMLS_CC);
 	nm = phurple_string_zval(name);
 	reas = phurple_string_zval(reason);
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
-
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   "chatbuddyleft",
-					   sizeof("chatbuddyleft")-1,
+	phurple_call_hook(PHURPLE_HOOK_CHAT_BUDDY_LEFT,
 					   NULL,
 					   3,
 					   &conversation,
@@ -835,24 +867,19 @@ static void
 phurple_chat_inviting_user(PurpleConversation *conv, const char *name, char **invite_message)
 {/*{{{*/
 	zval *conversation, *nm, *msg;
-	zval *client;
-	zend_class_entry *ce;
 	char *orig_msg_ptr;
 	TSRMLS_FETCH();
 
+	if (!phurple_hook_enabled(PHURPLE_HOOK_CHAT_INVITING_USER TSRMLS_CC)) {
+		return;
+	}
+
 	conversation = php_create_conversation_obj_zval(conv TSRMLS_CC);
 	nm = phurple_string_zval(name);
-	orig_msg_ptr = Z_STRVAL_P(nm);
 	msg = phurple_string_zval(*invite_message);
+	orig_msg_ptr = Z_STRVAL_P(msg);
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
-
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   "chatinvitinguser",
-					   sizeof("chatinvitinguser")-1,
+	phurple_call_hook(PHURPLE_HOOK_CHAT_INVITING_USER,
 					   NULL,
 					   3,
 					   &conversation,
@@ -875,22 +902,22 @@ static void
 phurple_chat_invited_user(PurpleConversation *conv, const char *name, const char *invite_message)
 {/*{{{*/
 	zval *conversation, *nm, *msg;
-	zval *client;
-	zend_class_entry *ce;
 	TSRMLS_FETCH();
 
+	if (!phurple_hook_enabled(PHURPLE_HOOK_CHAT_INVITED_USER TSRMLS_CC)) {
+		return;
+	}
+
+	if (phurple_hook_batched(PHURPLE_HOOK_CHAT_INVITED_USER TSRMLS_CC)) {
+		phurple_event_push(PHURPLE_HOOK_CHAT_INVITED_USER, NULL, conv, name, invite_message, 0, 0, 0 TSRMLS_CC);
+		return;
+	}
+
 	conversation = php_create_conversation_obj_zval(conv TSRMLS_CC);
 	nm = phurple_string_zval(name);
 	msg = phurple_string_zval(invite_message);
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
-
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   "chatinviteduser",
-					   sizeof("chatinviteduser")-1,
+	phurple_call_hook(PHURPLE_HOOK_CHAT_INVITED_USER,
 					   NULL,
 					   3,
 					   &conversation,
@@ -909,24 +936,19 @@ phurple_chat_invited(PurpleAccount *account, const char *inviter, const char *ch
 {/*{{{*/
 	gint ret = 0;
 	zval *acc, *tmp0, *tmp1, *tmp2;
-	zval *client;
 	zval *method_ret = NULL;
-	zend_class_entry *ce;
 	TSRMLS_FETCH();
 
+	if (!phurple_hook_enabled(PHURPLE_HOOK_CHAT_INVITED TSRMLS_CC)) {
+		return ret;
+	}
+
 	acc = php_create_account_obj_zval(account TSRMLS_CC);
 	tmp0 = phurple_string_zval(inviter);
 	tmp1 = phurple_string_zval(chat);
 	tmp2 = phurple_string_zval(invite_message);
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
-
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   "chatinvited",
-					   sizeof("chatinvited")-1,
+	phurple_call_hook(PHURPLE_HOOK_CHAT_INVITED,
 					   &method_ret,
 					   4,
 					   &acc,
@@ -944,7 +966,9 @@ phurple_chat_invited(PurpleAccount *account, const char *inviter, const char *ch
 	zval_ptr_dtor(&tmp0);
 	zval_ptr_dtor(&tmp1);
 	zval_ptr_dtor(&tmp2);
-	zval_ptr_dtor(&method_ret);
+	if (method_ret) {
+		zval_ptr_dtor(&method_ret);
+	}
 
 	return ret;
 }/*}}}*/
@@ -953,23 +977,18 @@ static void
 phurple_chat_invite_blocked(PurpleAccount *account, const char *inviter, const char *name, const char *message, GHashTable *data)
 {/*{{{*/
 	zval *acc, *tmp0, *tmp1, *tmp2;
-	zval *client;
-	zend_class_entry *ce;
 	TSRMLS_FETCH();
 
+	if (!phurple_hook_enabled(PHURPLE_HOOK_CHAT_INVITE_BLOCKED TSRMLS_CC)) {
+		return;
+	}
+
 	acc = php_create_account_obj_zval(account TSRMLS_CC);
 	tmp0 = phurple_string_zval(inviter);
 	tmp1 = phurple_string_zval(name);
 	tmp2 = phurple_string_zval(message);
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
-
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   "chatinviteblocked",
-					   sizeof("chatinviteblocked")-1,
+	phurple_call_hook(PHURPLE_HOOK_CHAT_INVITE_BLOCKED,
 					   NULL,
 					   4,
 					   &acc,
@@ -987,35 +1006,35 @@ phurple_chat_invite_blocked(PurpleAccount *account, const char *inviter, const c
 static void
 phurple_chat_joined(PurpleConversation *conv)
 {/*{{{*/
-	phurple_conversation_arg_only_cb("chatjoined", conv);
+	phurple_conversation_arg_only_cb(PHURPLE_HOOK_CHAT_JOINED, conv);
 }/*}}}*/
 
 static void
 phurple_chat_left(PurpleConversation *conv)
 {/*{{{*/
-	phurple_conversation_arg_only_cb("chatleft", conv);
+	phurple_conversation_arg_only_cb(PHURPLE_HOOK_CHAT_LEFT, conv);
 }/*}}}*/
 
 static void
 phurple_chat_topic_changed(PurpleConversation *conv, const char *who, const char *topic)
 {/*{{{*/
 	zval *conversation, *wh, *top;
-	zval *client;
-	zend_class_entry *ce;
 	TSRMLS_FETCH();
 
+	if (!phurple_hook_enabled(PHURPLE_HOOK_CHAT_TOPIC_CHANGED TSRMLS_CC)) {
+		return;
+	}
+
+	if (phurple_hook_batched(PHURPLE_HOOK_CHAT_TOPIC_CHANGED TSRMLS_CC)) {
+		phurple_event_push(PHURPLE_HOOK_CHAT_TOPIC_CHANGED, NULL, conv, who, topic, 0, 0, 0 TSRMLS_CC);
+		return;
+	}
+
 	conversation = php_create_conversation_obj_zval(conv TSRMLS_CC);
 	wh = phurple_string_zval(who);
 	top = phurple_string_zval(topic);
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
-
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   "chattopicchanged",
-					   sizeof("chattopicchanged")-1,
+	phurple_call_hook(PHURPLE_HOOK_CHAT_TOPIC_CHANGED,
 					   NULL,
 					   3,
 					   &conversation,
@@ -1032,23 +1051,23 @@ static void
 phurple_chat_buddy_flags(PurpleConversation *conv, const char *name, PurpleConvChatBuddyFlags oldflags, PurpleConvChatBuddyFlags newflags)
 {/*{{{*/
 	zval *conversation, *nam, *oldf, *newf;
-	zval *client;
-	zend_class_entry *ce;
 	TSRMLS_FETCH();
 
+	if (!phurple_hook_enabled(PHURPLE_HOOK_CHAT_BUDDY_FLAGS TSRMLS_CC)) {
+		return;
+	}
+
+	if (phurple_hook_batched(PHURPLE_HOOK_CHAT_BUDDY_FLAGS TSRMLS_CC)) {
+		phurple_event_push(PHURPLE_HOOK_CHAT_BUDDY_FLAGS, NULL, conv, name, NULL, newflags, oldflags, 0 TSRMLS_CC);
+		return;
+	}
+
 	conversation = php_create_conversation_obj_zval(conv TSRMLS_CC);
 	nam = phurple_string_zval(name);
 	oldf = phurple_long_zval(oldflags);
 	newf = phurple_long_zval(newflags);
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
-
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   "chatbuddyflags",
-					   sizeof("chatbuddyflags")-1,
+	phurple_call_hook(PHURPLE_HOOK_CHAT_BUDDY_FLAGS,
 					   NULL,
 					   4,
 					   &conversation,
@@ -1063,233 +1082,105 @@ phurple_chat_buddy_flags(PurpleConversation *conv, const char *name, PurpleConvC
 	zval_ptr_dtor(&newf);
 }/*}}}*/
 
+/* Conversation signals, connected only for the enabled hooks */
+static const struct phurple_signal_entry phurple_conv_signals[] = {
+	{PHURPLE_HOOK_WRITING_IM_MSG, "writing-im-msg", PURPLE_CALLBACK(phurple_writing_im_msg)},
+	{PHURPLE_HOOK_WROTE_IM_MSG, "wrote-im-msg", PURPLE_CALLBACK(phurple_wrote_im_msg)},
+	{PHURPLE_HOOK_SENDING_IM_MSG, "sending-im-msg", PURPLE_CALLBACK(phurple_sending_im_msg)},
+	{PHURPLE_HOOK_SENT_IM_MSG, "sent-im-msg", PURPLE_CALLBACK(phurple_sent_im_msg)},
+	{PHURPLE_HOOK_RECEIVING_IM_MSG, "receiving-im-msg", PURPLE_CALLBACK(phurple_receiving_im_msg)},
+	{PHURPLE_HOOK_RECEIVED_IM_MSG, "received-im-msg", PURPLE_CALLBACK(phurple_received_im_msg)},
+	{PHURPLE_HOOK_BLOCKED_IM_MSG, "blocked-im-msg", PURPLE_CALLBACK(phurple_blocked_im_msg)},
+	{PHURPLE_HOOK_WRITING_CHAT_MSG, "writing-chat-msg", PURPLE_CALLBACK(phurple_writing_chat_msg)},
+	{PHURPLE_HOOK_WROTE_CHAT_MSG, "wrote-chat-msg", PURPLE_CALLBACK(phurple_wrote_chat_msg)},
+	{PHURPLE_HOOK_SENDING_CHAT_MSG, "sending-chat-msg", PURPLE_CALLBACK(phurple_sending_chat_msg)},
+	{PHURPLE_HOOK_SENT_CHAT_MSG, "sent-chat-msg", PURPLE_CALLBACK(phurple_sent_chat_msg)},
+	{PHURPLE_HOOK_RECEIVING_CHAT_MSG, "receiving-chat-msg", PURPLE_CALLBACK(phurple_receiving_chat_msg)},
+	{PHURPLE_HOOK_RECEIVED_CHAT_MSG, "received-chat-msg", PURPLE_CALLBACK(phurple_received_chat_msg)},
+	{PHURPLE_HOOK_CONVERSATION_CREATED, "conversation-created", PURPLE_CALLBACK(phurple_conversation_created)},
+	{PHURPLE_HOOK_CONVERSATION_UPDATED, "conversation-updated", PURPLE_CALLBACK(phurple_conversation_updated)},
+	{PHURPLE_HOOK_DELETING_CONVERSATION, "deleting-conversation", PURPLE_CALLBACK(phurple_deleting_conversation)},
+	{PHURPLE_HOOK_BUDDY_TYPING, "buddy-typing", PURPLE_CALLBACK(phurple_buddy_typing)},
+	{PHURPLE_HOOK_BUDDY_TYPING_STOPPED, "buddy-typing-stopped", PURPLE_CALLBACK(phurple_buddy_typing_stopped)},
+	{PHURPLE_HOOK_CHAT_BUDDY_JOINING, "chat-buddy-joining", PURPLE_CALLBACK(phurple_chat_buddy_joining)},
+	{PHURPLE_HOOK_CHAT_BUDDY_JOINED, "chat-buddy-joined", PURPLE_CALLBACK(phurple_chat_buddy_joined)},
+	{PHURPLE_HOOK_CHAT_BUDDY_LEAVING, "chat-buddy-leaving", PURPLE_CALLBACK(phurple_chat_buddy_leaving)},
+	{PHURPLE_HOOK_CHAT_BUDDY_LEFT, "chat-buddy-left", PURPLE_CALLBACK(phurple_chat_buddy_left)},
+	{PHURPLE_HOOK_CHAT_INVITING_USER, "chat-inviting-user", PURPLE_CALLBACK(phurple_chat_inviting_user)},
+	{PHURPLE_HOOK_CHAT_INVITED_USER, "chat-invited-user", PURPLE_CALLBACK(phurple_chat_invited_user)},
+	{PHURPLE_HOOK_CHAT_INVITED, "chat-invited", PURPLE_CALLBACK(phurple_chat_invited)},
+	{PHURPLE_HOOK_CHAT_INVITE_BLOCKED, "chat-invite-blocked", PURPLE_CALLBACK(phurple_chat_invite_blocked)},
+	{PHURPLE_HOOK_CHAT_JOINED, "chat-joined", PURPLE_CALLBACK(phurple_chat_joined)},
+	{PHURPLE_HOOK_CHAT_JOIN_FAILED, "chat-join-failed", PURPLE_CALLBACK(phurple_chat_join_failed)},
+	{PHURPLE_HOOK_CHAT_LEFT, "chat-left", PURPLE_CALLBACK(phurple_chat_left)},
+	{PHURPLE_HOOK_CHAT_TOPIC_CHANGED, "chat-topic-changed", PURPLE_CALLBACK(phurple_chat_topic_changed)},
+	{PHURPLE_HOOK_CHAT_BUDDY_FLAGS, "chat-buddy-flags", PURPLE_CALLBACK(phurple_chat_buddy_flags)},
+	{PHURPLE_HOOK_COUNT, NULL, NULL}
+};
+
+/* Connect the conversation signals of all the enabled hooks. This is done
+	once for the client, the signals are emitted for every conversation and
+	the callbacks get the conversation passed, so no routing is needed. */
 void
-phurple_setup_conv_signals(PurpleConversation *conv)
+phurple_conv_signals_connect(void *handle)
 {/*{{{*/
+	const struct phurple_signal_entry *entry;
+	TSRMLS_FETCH();
 
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "writing-im-msg",
-						  conv,
-						  PURPLE_CALLBACK(phurple_writing_im_msg),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "wrote-im-msg",
-						  conv,
-						  PURPLE_CALLBACK(phurple_wrote_im_msg),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "sending-im-msg",
-						  conv,
-						  PURPLE_CALLBACK(phurple_sending_im_msg),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "sent-im-msg",
-						  conv,
-						  PURPLE_CALLBACK(phurple_sent_im_msg),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "receiving-im-msg",
-						  conv,
-						  PURPLE_CALLBACK(phurple_receiving_im_msg),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "received-im-msg",
-						  conv,
-						  PURPLE_CALLBACK(phurple_received_im_msg),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "blocked-im-msg",
-						  conv,
-						  PURPLE_CALLBACK(phurple_blocked_im_msg),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "writing-chat-msg",
-						  conv,
-						  PURPLE_CALLBACK(phurple_writing_chat_msg),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "wrote-chat-msg",
-						  conv,
-						  PURPLE_CALLBACK(phurple_wrote_chat_msg),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "sending-chat-msg",
-						  conv,
-						  PURPLE_CALLBACK(phurple_sending_chat_msg),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "sent-chat-msg",
-						  conv,
-						  PURPLE_CALLBACK(phurple_sent_chat_msg),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "receiving-chat-msg",
-						  conv,
-						  PURPLE_CALLBACK(phurple_receiving_chat_msg),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "received-chat-msg",
-						  conv,
-						  PURPLE_CALLBACK(phurple_received_chat_msg),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "conversation-created",
-						  conv,
-						  PURPLE_CALLBACK(phurple_conversation_created),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "conversation-updated",
-						  conv,
-						  PURPLE_CALLBACK(phurple_conversation_updated),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "deleting-conversation",
-						  conv,
-						  PURPLE_CALLBACK(phurple_deleting_conversation),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "buddy-typing",
-						  conv,
-						  PURPLE_CALLBACK(phurple_buddy_typing),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "buddy-typing-stopped",
-						  conv,
-						  PURPLE_CALLBACK(phurple_buddy_typing_stopped),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "chat-buddy-joined",
-						  conv,
-						  PURPLE_CALLBACK(phurple_chat_buddy_joined),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "chat-buddy-joined",
-						  conv,
-						  PURPLE_CALLBACK(phurple_chat_buddy_joined),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "chat-buddy-leaving",
-						  conv,
-						  PURPLE_CALLBACK(phurple_chat_buddy_leaving),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "chat-buddy-left",
-						  conv,
-						  PURPLE_CALLBACK(phurple_chat_buddy_left),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "chat-inviting-user",
-						  conv,
-						  PURPLE_CALLBACK(phurple_chat_inviting_user),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "chat-invited-user",
-						  conv,
-						  PURPLE_CALLBACK(phurple_chat_invited_user),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "chat-invited",
-						  conv,
-						  PURPLE_CALLBACK(phurple_chat_invited),
-						  NULL
-	);
-
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "chat-invite-blocked",
-						  conv,
-						  PURPLE_CALLBACK(phurple_chat_invite_blocked),
-						  NULL
-	);
+	for (entry = phurple_conv_signals; entry->signal; entry++) {
+		if (phurple_hook_enabled(entry->hook TSRMLS_CC)) {
+			purple_signal_connect(purple_conversations_get_handle(),
+								  entry->signal,
+								  handle,
+								  entry->cb,
+								  NULL
+			);
+		}
+	}
 
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "chat-joined",
-						  conv,
-						  PURPLE_CALLBACK(phurple_chat_joined),
-						  NULL
+	/* run after the client callbacks, so they still get the same object */
+	purple_signal_connect_priority(purple_conversations_get_handle(),
+								   "deleting-conversation",
+								   handle,
+								   PURPLE_CALLBACK(phurple_conversation_invalidate),
+								   NULL,
+								   PURPLE_SIGNAL_PRIORITY_HIGHEST
 	);
+}/*}}}*/
 
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "chat-join-failed",
-						  conv,
-						  PURPLE_CALLBACK(phurple_chat_join_failed),
-						  NULL
-	);
+/* Connect or disconnect a conversation hook. Returns 0 if the hook isn't
+	a conversation signal. */
+int
+phurple_conv_hook_toggle(enum phurple_hook hook, zend_bool on, void *handle)
+{/*{{{*/
+	const struct phurple_signal_entry *entry;
 
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "chat-left",
-						  conv,
-						  PURPLE_CALLBACK(phurple_chat_left),
-						  NULL
-	);
+	for (entry = phurple_conv_signals; entry->signal; entry++) {
+		if (entry->hook == hook) {
+			break;
+		}
+	}
 
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "chat-topic-changed",
-						  conv,
-						  PURPLE_CALLBACK(phurple_chat_topic_changed),
-						  NULL
-	);
+	if (!entry->signal) {
+		return 0;
+	}
 
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "chat-buddy-flags",
-						  conv,
-						  PURPLE_CALLBACK(phurple_chat_buddy_flags),
-						  NULL
-	);
+	if (on) {
+		purple_signal_connect(purple_conversations_get_handle(),
+							  entry->signal,
+							  handle,
+							  entry->cb,
+							  NULL
+		);
+	} else {
+		purple_signal_disconnect(purple_conversations_get_handle(),
+								 entry->signal,
+								 handle,
+								 entry->cb
+		);
+	}
 
-	purple_signal_connect(purple_conversations_get_handle(),
-						  "chat-buddy-joining",
-						  conv,
-						  PURPLE_CALLBACK(phurple_chat_buddy_joining),
-						  NULL
-	);
+	return 1;
 }/*}}}*/
 
 /*
@@ -1336,7 +1227,9 @@ PHP_METHOD(PhurpleConversation, __construct)
 		return;
 	}
 
-	phurple_setup_conv_signals(zco->pconversation);
+	if (!phurple_object_map_find(zco->pconversation TSRMLS_CC)) {
+		phurple_object_map_add(zco->pconversation, getThis() TSRMLS_CC);
+	}
 
 	pchat = purple_blist_find_chat(zao->paccount, name);
 	if (!pchat) {
@@ -1397,8 +1290,8 @@ PHP_METHOD(PhurpleConversation, getName)
 /* }}} */
 
 
-/* {{{ proto void PhurpleConversation::sendIM(string message)
-	Sends a message to this IM conversation */
+/* {{{ proto bool PhurpleConversation::sendIM(string message)
+	Sends a message to this IM conversation, or queues it if the account is rate limited */
 PHP_METHOD(PhurpleConversation, sendIM)
 {
 	int message_len;
@@ -1414,18 +1307,107 @@ PHP_METHOD(PhurpleConversation, sendIM)
 	if(message_len && NULL != zco->pconversation) {
 		switch (purple_conversation_get_type(zco->pconversation)) {
 			case PURPLE_CONV_TYPE_IM:
-				purple_conv_im_send(PURPLE_CONV_IM(zco->pconversation), message);
-				break;
-
 			case PURPLE_CONV_TYPE_CHAT:
-				purple_conv_chat_send(PURPLE_CONV_CHAT(zco->pconversation), message);
 				break;
 
 			default:
 				zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "Unknown conversation type");
 				return;
 		}
+
+		switch (phurple_sendq_push(zco->pconversation, message, message_len TSRMLS_CC)) {
+			case PHURPLE_SEND_DIRECT:
+				break;
+
+			case 0:
+				RETURN_FALSE;
+
+			default:
+				RETURN_TRUE;
+		}
+
+		if (PURPLE_CONV_TYPE_IM == purple_conversation_get_type(zco->pconversation)) {
+			purple_conv_im_send(PURPLE_CONV_IM(zco->pconversation), message);
+		} else {
+			purple_conv_chat_send(PURPLE_CONV_CHAT(zco->pconversation), message);
+		}
+	}
+
+	RETURN_TRUE;
+}
+/* }}} */
+
+
+/* {{{ proto static int PhurpleConversation::sendMany(array messages)
+	Sends a list of (account, recipient, message[, type]) arrays, the conversations are resolved or opened internally */
+PHP_METHOD(PhurpleConversation, sendMany)
+{
+	zval *messages, **entry;
+	HashPosition pos;
+	GHashTable *prev;
+	long sent = 0, index = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a", &messages) == FAILURE) {
+		return;
+	}
+
+	/* like Phurple\Client::broadcast(), nothing is sent unless every entry is valid */
+	for (zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(messages), &pos);
+		 zend_hash_get_current_data_ex(Z_ARRVAL_P(messages), (void **) &entry, &pos) == SUCCESS;
+		 zend_hash_move_forward_ex(Z_ARRVAL_P(messages), &pos), index++) {
+		zval **account, **name, **message, **type;
+
+		if (Z_TYPE_PP(entry) != IS_ARRAY
+			|| zend_hash_index_find(Z_ARRVAL_PP(entry), 0, (void **) &account) == FAILURE
+			|| zend_hash_index_find(Z_ARRVAL_PP(entry), 1, (void **) &name) == FAILURE
+			|| zend_hash_index_find(Z_ARRVAL_PP(entry), 2, (void **) &message) == FAILURE
+			|| Z_TYPE_PP(account) != IS_OBJECT || !instanceof_function(Z_OBJCE_PP(account), PhurpleAccount_ce TSRMLS_CC)
+			|| Z_TYPE_PP(name) != IS_STRING || Z_TYPE_PP(message) != IS_STRING) {
+			zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "Entry %ld is not an (account, recipient, message) array", index);
+			return;
+		}
+
+		if (zend_hash_index_find(Z_ARRVAL_PP(entry), 3, (void **) &type) == SUCCESS
+			&& (Z_TYPE_PP(type) != IS_LONG || (PURPLE_CONV_TYPE_IM != Z_LVAL_PP(type) && PURPLE_CONV_TYPE_CHAT != Z_LVAL_PP(type)))) {
+			zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "Entry %ld has an unknown conversation type", index);
+			return;
+		}
+
+		if (!((struct ze_account_obj *) zend_object_store_get_object(*account TSRMLS_CC))->paccount) {
+			zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "The account of entry %ld is gone", index);
+			return;
+		}
 	}
+
+	prev = phurple_send_bulk_begin();
+
+	for (zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(messages), &pos);
+		 zend_hash_get_current_data_ex(Z_ARRVAL_P(messages), (void **) &entry, &pos) == SUCCESS && !EG(exception);
+		 zend_hash_move_forward_ex(Z_ARRVAL_P(messages), &pos)) {
+		zval **account, **name, **message, **type;
+		struct ze_account_obj *zao;
+		long conv_type = PURPLE_CONV_TYPE_IM;
+
+		zend_hash_index_find(Z_ARRVAL_PP(entry), 0, (void **) &account);
+		zend_hash_index_find(Z_ARRVAL_PP(entry), 1, (void **) &name);
+		zend_hash_index_find(Z_ARRVAL_PP(entry), 2, (void **) &message);
+		if (zend_hash_index_find(Z_ARRVAL_PP(entry), 3, (void **) &type) == SUCCESS) {
+			conv_type = Z_LVAL_PP(type);
+		}
+
+		/* a callback could have deleted the account */
+		zao = (struct ze_account_obj *) zend_object_store_get_object(*account TSRMLS_CC);
+		if (!zao->paccount) {
+			continue;
+		}
+
+		sent += phurple_send_bulk(zao->paccount, (PurpleConversationType)conv_type, Z_STRVAL_PP(name),
+								  Z_STRVAL_PP(message), Z_STRLEN_PP(message) TSRMLS_CC);
+	}
+
+	phurple_send_bulk_end(prev);
+
+	RETURN_LONG(sent);
 }
 /* }}} */
 
@@ -1452,7 +1434,7 @@ PHP_METHOD(PhurpleConversation, getAccount)
 		if(NULL != acc) {
 			zval *ret = php_create_account_obj_zval(acc TSRMLS_CC);
 
-			*return_value = *ret;
+			RETVAL_ZVAL(ret, 1, 1);
 
 			return;
 		}
@@ -1561,7 +1543,7 @@ PHP_METHOD(PhurpleConversation, getConnection)
 		if (pconn) {
 			zval *tmp = php_create_connection_obj_zval((PurpleConnection *)pconn TSRMLS_CC);
 
-			*return_value = *tmp;
+			RETVAL_ZVAL(tmp, 1, 1);
 
 			return;
 		}
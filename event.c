@@ -0,0 +1,368 @@
+/**
+ * Copyright (c) 2007-2014, Anatol Belski <ab@php.net>
+ *
+ * This file is part of Phurple.
+ *
+ * Phurple is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Phurple is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Phurple.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <php.h>
+
+#include "php_phurple.h"
+
+#include <glib.h>
+
+#include <string.h>
+
+#include <purple.h>
+
+extern zval *
+php_create_account_obj_zval(PurpleAccount *paccount TSRMLS_DC);
+
+extern zval *
+php_create_conversation_obj_zval(PurpleConversation *pconv TSRMLS_DC);
+
+extern zval *
+php_create_buddy_obj_zval(PurpleBuddy *pbuddy TSRMLS_DC);
+
+#if PHURPLE_INTERNAL_DEBUG
+extern void phurple_dump_zval(zval *var);
+#endif
+
+#if PHP_MAJOR_VERSION == 5 && PHP_MINOR_VERSION < 4
+# define PHURPLE_PROPERTY_KEY_DC
+# define PHURPLE_PROPERTY_KEY_CC
+#else
+# define PHURPLE_PROPERTY_KEY_DC , const zend_literal *key
+# define PHURPLE_PROPERTY_KEY_CC , key
+#endif
+
+enum phurple_event_prop {
+	PHURPLE_EVENT_PROP_CONVERSATION,
+	PHURPLE_EVENT_PROP_ACCOUNT,
+	PHURPLE_EVENT_PROP_BUDDY,
+	PHURPLE_EVENT_PROP_SENDER,
+	PHURPLE_EVENT_PROP_ALIAS,
+	PHURPLE_EVENT_PROP_MESSAGE,
+	PHURPLE_EVENT_PROP_FLAGS,
+	PHURPLE_EVENT_PROP_TIME,
+	PHURPLE_EVENT_PROP_COUNT
+};
+
+static const struct phurple_hook_entry phurple_event_props[PHURPLE_EVENT_PROP_COUNT] = {
+	{"conversation", sizeof("conversation")-1},
+	{"account", sizeof("account")-1},
+	{"buddy", sizeof("buddy")-1},
+	{"sender", sizeof("sender")-1},
+	{"alias", sizeof("alias")-1},
+	{"message", sizeof("message")-1},
+	{"flags", sizeof("flags")-1},
+	{"time", sizeof("time")-1}
+};
+
+/* The callbacks which can be passed a single event object */
+static const enum phurple_hook phurple_event_hooks[] = {
+	PHURPLE_HOOK_WRITE_CONV,
+	PHURPLE_HOOK_WRITE_IM,
+	PHURPLE_HOOK_WROTE_IM_MSG,
+	PHURPLE_HOOK_RECEIVED_IM_MSG,
+	PHURPLE_HOOK_WROTE_CHAT_MSG,
+	PHURPLE_HOOK_RECEIVED_CHAT_MSG,
+	PHURPLE_HOOK_COUNT
+};
+
+static zend_object_handlers phurple_event_obj_handlers;
+
+int
+phurple_event_obj_supported(enum phurple_hook hook)
+{/*{{{*/
+	int i;
+
+	for (i = 0; PHURPLE_HOOK_COUNT != phurple_event_hooks[i]; i++) {
+		if (hook == phurple_event_hooks[i]) {
+			return 1;
+		}
+	}
+
+	return 0;
+}/*}}}*/
+
+static int
+phurple_event_prop_by_name(zval *member)
+{/*{{{*/
+	int i;
+
+	if (IS_STRING != Z_TYPE_P(member)) {
+		return -1;
+	}
+
+	for (i = 0; i < PHURPLE_EVENT_PROP_COUNT; i++) {
+		if (phurple_event_props[i].name_len == Z_STRLEN_P(member)
+			&& !memcmp(phurple_event_props[i].name, Z_STRVAL_P(member), Z_STRLEN_P(member))) {
+			return i;
+		}
+	}
+
+	return -1;
+}/*}}}*/
+
+/* Put the property value into the property table, the first read
+	of a property is the only one doing any lookups */
+static void
+phurple_event_resolve(zval *object, int prop TSRMLS_DC)
+{/*{{{*/
+	struct ze_event_obj *zeo = (struct ze_event_obj *) zend_object_store_get_object(object TSRMLS_CC);
+	zval *value;
+
+	if (zeo->resolved & (1 << prop)) {
+		return;
+	}
+	zeo->resolved |= 1 << prop;
+
+	switch (prop) {
+		case PHURPLE_EVENT_PROP_CONVERSATION:
+			value = php_create_conversation_obj_zval(zeo->pconversation TSRMLS_CC);
+			break;
+
+		case PHURPLE_EVENT_PROP_ACCOUNT:
+			value = php_create_account_obj_zval(zeo->paccount TSRMLS_CC);
+			break;
+
+		case PHURPLE_EVENT_PROP_BUDDY: {
+			PurpleBuddy *pbuddy = NULL;
+			const char *name = zeo->who && *zeo->who ? zeo->who : NULL;
+
+			if (!name && zeo->pconversation) {
+				name = purple_conversation_get_name(zeo->pconversation);
+			}
+			if (zeo->paccount && name) {
+				pbuddy = purple_find_buddy(zeo->paccount, name);
+			}
+
+			value = php_create_buddy_obj_zval(pbuddy TSRMLS_CC);
+			break;
+		}
+
+		case PHURPLE_EVENT_PROP_SENDER:
+		case PHURPLE_EVENT_PROP_ALIAS:
+		case PHURPLE_EVENT_PROP_MESSAGE: {
+			const char *str = PHURPLE_EVENT_PROP_SENDER == prop ? zeo->who
+								: PHURPLE_EVENT_PROP_ALIAS == prop ? zeo->alias : zeo->message;
+
+			MAKE_STD_ZVAL(value);
+			if (str) {
+				ZVAL_STRING(value, (char *)str, 1);
+			} else {
+				ZVAL_NULL(value);
+			}
+			break;
+		}
+
+		case PHURPLE_EVENT_PROP_FLAGS:
+			MAKE_STD_ZVAL(value);
+			ZVAL_LONG(value, zeo->flags);
+			break;
+
+		default:
+			MAKE_STD_ZVAL(value);
+			ZVAL_LONG(value, zeo->mtime);
+			break;
+	}
+
+	zend_update_property(PhurpleEvent_ce, object, (char *)phurple_event_props[prop].name,
+						 phurple_event_props[prop].name_len, value TSRMLS_CC);
+	zval_ptr_dtor(&value);
+}/*}}}*/
+
+static zval *
+phurple_event_read_property(zval *object, zval *member, int type PHURPLE_PROPERTY_KEY_DC TSRMLS_DC)
+{/*{{{*/
+	int prop = phurple_event_prop_by_name(member);
+
+	if (prop >= 0) {
+		phurple_event_resolve(object, prop TSRMLS_CC);
+	}
+
+	return zend_std_read_property(object, member, type PHURPLE_PROPERTY_KEY_CC TSRMLS_CC);
+}/*}}}*/
+
+static void
+phurple_event_write_property(zval *object, zval *member, zval *value PHURPLE_PROPERTY_KEY_DC TSRMLS_DC)
+{/*{{{*/
+	int prop = phurple_event_prop_by_name(member);
+
+	if (prop >= 0) {
+		/* the handler's value wins */
+		struct ze_event_obj *zeo = (struct ze_event_obj *) zend_object_store_get_object(object TSRMLS_CC);
+
+		zeo->resolved |= 1 << prop;
+	}
+
+	zend_std_write_property(object, member, value PHURPLE_PROPERTY_KEY_CC TSRMLS_CC);
+}/*}}}*/
+
+static int
+phurple_event_has_property(zval *object, zval *member, int has_set_exists PHURPLE_PROPERTY_KEY_DC TSRMLS_DC)
+{/*{{{*/
+	int prop = phurple_event_prop_by_name(member);
+
+	if (prop >= 0) {
+		phurple_event_resolve(object, prop TSRMLS_CC);
+	}
+
+	return zend_std_has_property(object, member, has_set_exists PHURPLE_PROPERTY_KEY_CC TSRMLS_CC);
+}/*}}}*/
+
+static void
+phurple_event_resolve_all(zval *object TSRMLS_DC)
+{/*{{{*/
+	int i;
+
+	for (i = 0; i < PHURPLE_EVENT_PROP_COUNT; i++) {
+		phurple_event_resolve(object, i TSRMLS_CC);
+	}
+}/*}}}*/
+
+static HashTable *
+phurple_event_get_properties(zval *object TSRMLS_DC)
+{/*{{{*/
+	phurple_event_resolve_all(object TSRMLS_CC);
+
+	return zend_std_get_properties(object TSRMLS_CC);
+}/*}}}*/
+
+void
+php_event_obj_destroy(void *obj TSRMLS_DC)
+{/*{{{*/
+	struct ze_event_obj *zeo = (struct ze_event_obj *)obj;
+
+	zend_object_std_dtor(&zeo->zo TSRMLS_CC);
+
+	efree(zeo);
+}/*}}}*/
+
+zend_object_value
+php_event_obj_init(zend_class_entry *ce TSRMLS_DC)
+{/*{{{*/
+	zend_object_value ret;
+	struct ze_event_obj *zeo;
+#if PHP_MAJOR_VERSION == 5 && PHP_MINOR_VERSION < 4
+	zval *tmp;
+#endif
+
+	zeo = (struct ze_event_obj *) emalloc(sizeof(struct ze_event_obj));
+	memset(zeo, 0, sizeof(struct ze_event_obj));
+
+	zend_object_std_init(&zeo->zo, ce TSRMLS_CC);
+#if PHP_MAJOR_VERSION== 5 && PHP_MINOR_VERSION < 4
+	zend_hash_copy(zeo->zo.properties, &ce->default_properties, (copy_ctor_func_t) zval_add_ref,
+					(void *) &tmp, sizeof(zval *));
+#else
+	object_properties_init(&zeo->zo, ce);
+#endif
+
+	ret.handle = zend_objects_store_put(zeo, NULL,
+								(zend_objects_free_object_storage_t) php_event_obj_destroy,
+								NULL TSRMLS_CC);
+
+	if (!phurple_event_obj_handlers.read_property) {
+		memcpy(&phurple_event_obj_handlers, &default_phurple_obj_handlers, sizeof(zend_object_handlers));
+		phurple_event_obj_handlers.read_property = phurple_event_read_property;
+		phurple_event_obj_handlers.write_property = phurple_event_write_property;
+		phurple_event_obj_handlers.has_property = phurple_event_has_property;
+		phurple_event_obj_handlers.get_properties = phurple_event_get_properties;
+	}
+
+	ret.handlers = &phurple_event_obj_handlers;
+
+	return ret;
+}/*}}}*/
+
+/* The strings aren't copied, the event lives as long as the callback */
+zval *
+php_create_event_obj_zval(PurpleConversation *pconv, PurpleAccount *paccount, const char *who,
+						  const char *alias, const char *message, long flags, long mtime TSRMLS_DC)
+{/*{{{*/
+	zval *ret;
+	struct ze_event_obj *zeo;
+
+	ALLOC_ZVAL(ret);
+	object_init_ex(ret, PhurpleEvent_ce);
+	INIT_PZVAL(ret);
+
+	zeo = (struct ze_event_obj *) zend_object_store_get_object(ret TSRMLS_CC);
+	zeo->pconversation = pconv;
+	zeo->paccount = paccount;
+	zeo->who = who;
+	zeo->alias = alias;
+	zeo->message = message;
+	zeo->flags = flags;
+	zeo->mtime = mtime;
+
+	return ret;
+}/*}}}*/
+
+/* Drop the callback's reference. If the handler kept the event, it's
+	resolved completely while the libpurple data is still valid. A copy of
+	the object, like $this->last = $event, is another container referencing
+	the same object, so the object store refcount has to be checked too. */
+void
+phurple_event_obj_release(zval **event TSRMLS_DC)
+{/*{{{*/
+	if (Z_REFCOUNT_PP(event) > 1 || zend_objects_store_get_refcount(*event TSRMLS_CC) > 1) {
+		struct ze_event_obj *zeo = (struct ze_event_obj *) zend_object_store_get_object(*event TSRMLS_CC);
+
+		phurple_event_resolve_all(*event TSRMLS_CC);
+
+		zeo->pconversation = NULL;
+		zeo->paccount = NULL;
+		zeo->who = zeo->alias = zeo->message = NULL;
+	}
+
+	zval_ptr_dtor(event);
+}/*}}}*/
+
+/*
+**
+**
+** Phurple event methods
+**
+*/
+
+/* {{{ proto Phurple\Event Phurple\Event::__construct()
+	Events are only created by the client */
+PHP_METHOD(PhurpleEvent, __construct)
+{
+}
+/* }}} */
+
+/*
+**
+**
+** End phurple event methods
+**
+*/
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
@@ -0,0 +1,905 @@
+/**
+ * Copyright (c) 2007-2014, Anatol Belski <ab@php.net>
+ *
+ * This file is part of Phurple.
+ *
+ * Phurple is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Phurple is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Phurple.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <php.h>
+
+#include "php_phurple.h"
+
+#include <glib.h>
+
+#include <string.h>
+
+#include <purple.h>
+
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_TIMERFD_H)
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+/**
+ * The glib main context is bridged into a single epoll fd, so phurple can be
+ * driven by an external reactor. After each dispatch the context is prepared
+ * and queried, the polled fds are registered with the epoll fd and the
+ * context timeout is armed on a timerfd. The epoll fd becomes readable as
+ * soon as any of them is ready, then phurple_eventfd_dispatch() checks and
+ * dispatches the context.
+ */
+struct phurple_eventfd {
+	int epfd;
+	int timerfd;
+	/* the context is acquired and prepared, waiting for check */
+	gboolean prepared;
+	gint max_priority;
+	GPollFD *fds;
+	gint nfds;
+	gint fds_size;
+	/* fd => epoll events currently registered */
+	GHashTable *registered;
+};
+
+static struct phurple_eventfd bridge = {-1, -1, FALSE, 0, NULL, 0, 0, NULL};
+
+static guint32
+phurple_eventfd_events(gushort condition)
+{/*{{{*/
+	guint32 events = 0;
+
+	if (condition & G_IO_IN) {
+		events |= EPOLLIN;
+	}
+	if (condition & G_IO_PRI) {
+		events |= EPOLLPRI;
+	}
+	if (condition & G_IO_OUT) {
+		events |= EPOLLOUT;
+	}
+
+	return events;
+}/*}}}*/
+
+static void
+phurple_eventfd_arm_timer(gint timeout)
+{/*{{{*/
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+
+	if (0 == timeout) {
+		/* a zero it_value would disarm the timer */
+		its.it_value.tv_nsec = 1;
+	} else if (timeout > 0) {
+		its.it_value.tv_sec = timeout / 1000;
+		its.it_value.tv_nsec = (timeout % 1000) * 1000000;
+	}
+
+	timerfd_settime(bridge.timerfd, 0, &its, NULL);
+}/*}}}*/
+
+/* Prepare the context for the next round and sync the epoll set with the
+	fds glib wants to poll */
+static void
+phurple_eventfd_sync(void)
+{/*{{{*/
+	GMainContext *ctx = g_main_context_default();
+	GHashTable *wanted;
+	GHashTableIter iter;
+	gpointer key, value;
+	gint timeout, i;
+
+	if (bridge.prepared) {
+		return;
+	}
+
+	if (!g_main_context_acquire(ctx)) {
+		return;
+	}
+
+	g_main_context_prepare(ctx, &bridge.max_priority);
+
+	while ((bridge.nfds = g_main_context_query(ctx, bridge.max_priority, &timeout,
+												bridge.fds, bridge.fds_size)) > bridge.fds_size) {
+		bridge.fds_size = bridge.nfds;
+		bridge.fds = g_renew(GPollFD, bridge.fds, bridge.fds_size);
+	}
+
+	bridge.prepared = TRUE;
+
+	/* several sources can watch the same fd */
+	wanted = g_hash_table_new(g_direct_hash, g_direct_equal);
+	for (i = 0; i < bridge.nfds; i++) {
+		gpointer fd = GINT_TO_POINTER(bridge.fds[i].fd);
+		guint32 events = GPOINTER_TO_UINT(g_hash_table_lookup(wanted, fd));
+
+		g_hash_table_insert(wanted, fd, GUINT_TO_POINTER(events | phurple_eventfd_events(bridge.fds[i].events)));
+	}
+
+	g_hash_table_iter_init(&iter, bridge.registered);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		if (!g_hash_table_lookup_extended(wanted, key, NULL, NULL)) {
+			epoll_ctl(bridge.epfd, EPOLL_CTL_DEL, GPOINTER_TO_INT(key), NULL);
+			g_hash_table_iter_remove(&iter);
+		}
+	}
+
+	g_hash_table_iter_init(&iter, wanted);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		struct epoll_event ev;
+		gpointer old;
+		int op = EPOLL_CTL_ADD;
+
+		if (g_hash_table_lookup_extended(bridge.registered, key, NULL, &old)) {
+			if (old == value) {
+				continue;
+			}
+			op = EPOLL_CTL_MOD;
+		}
+
+		memset(&ev, 0, sizeof(ev));
+		ev.events = GPOINTER_TO_UINT(value);
+		ev.data.fd = GPOINTER_TO_INT(key);
+
+		if (0 == epoll_ctl(bridge.epfd, op, ev.data.fd, &ev)) {
+			g_hash_table_insert(bridge.registered, key, value);
+		} else if (EEXIST == errno && 0 == epoll_ctl(bridge.epfd, EPOLL_CTL_MOD, ev.data.fd, &ev)) {
+			g_hash_table_insert(bridge.registered, key, value);
+		}
+	}
+
+	g_hash_table_destroy(wanted);
+
+	phurple_eventfd_arm_timer(timeout);
+}/*}}}*/
+
+/* A source was added while the bridge holds a prepared context. Its fd or
+	timeout isn't in the epoll set yet and holding the context suppresses the
+	glib wakeup, so fire the timer, the next dispatch re-syncs. */
+void
+phurple_eventfd_invalidate(void)
+{/*{{{*/
+	if (bridge.epfd >= 0 && bridge.prepared) {
+		phurple_eventfd_arm_timer(0);
+	}
+}/*}}}*/
+
+/* Returns the epoll fd, creating it on the first call, or -1 on failure */
+int
+phurple_eventfd_get(void)
+{/*{{{*/
+	struct epoll_event ev;
+
+	if (bridge.epfd >= 0) {
+		return bridge.epfd;
+	}
+
+	bridge.epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (bridge.epfd < 0) {
+		return -1;
+	}
+
+	bridge.timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (bridge.timerfd < 0) {
+		close(bridge.epfd);
+		bridge.epfd = -1;
+		return -1;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = bridge.timerfd;
+	epoll_ctl(bridge.epfd, EPOLL_CTL_ADD, bridge.timerfd, &ev);
+
+	bridge.registered = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	phurple_eventfd_sync();
+
+	return bridge.epfd;
+}/*}}}*/
+
+/* Dispatch the sources which are ready without blocking. Returns TRUE if
+	anything was dispatched. */
+gboolean
+phurple_eventfd_dispatch(void)
+{/*{{{*/
+	GMainContext *ctx = g_main_context_default();
+	gboolean ready = FALSE;
+	guint64 expirations;
+
+	if (bridge.epfd < 0) {
+		return g_main_context_iteration(ctx, FALSE);
+	}
+
+	phurple_eventfd_sync();
+
+	if (bridge.prepared) {
+		/* fill in the revents, epoll only said something is ready */
+		if (bridge.nfds > 0) {
+			g_poll(bridge.fds, bridge.nfds, 0);
+		}
+
+		ready = g_main_context_check(ctx, bridge.max_priority, bridge.fds, bridge.nfds);
+		bridge.prepared = FALSE;
+
+		if (ready) {
+			g_main_context_dispatch(ctx);
+		}
+
+		g_main_context_release(ctx);
+	}
+
+	while (read(bridge.timerfd, &expirations, sizeof(expirations)) > 0);
+
+	phurple_eventfd_sync();
+
+	return ready;
+}/*}}}*/
+
+void
+phurple_eventfd_shutdown(void)
+{/*{{{*/
+	if (bridge.epfd < 0) {
+		return;
+	}
+
+	if (bridge.prepared) {
+		g_main_context_release(g_main_context_default());
+		bridge.prepared = FALSE;
+	}
+
+	close(bridge.timerfd);
+	close(bridge.epfd);
+	bridge.timerfd = -1;
+	bridge.epfd = -1;
+
+	g_hash_table_destroy(bridge.registered);
+	bridge.registered = NULL;
+
+	g_free(bridge.fds);
+	bridge.fds = NULL;
+	bridge.nfds = bridge.fds_size = 0;
+}/*}}}*/
+
+/**
+ * Native event loop backend, selected with phurple.event_loop=epoll. All the
+ * fds libpurple watches live in one epoll set and the timers in a
+ * hierarchical timing wheel of PHURPLE_WHEEL_LEVELS levels with
+ * PHURPLE_WHEEL_SIZE slots each, the resolution is 1ms. Both are driven by
+ * a single GSource, so runLoop(), iterate() and getEventFd() keep working.
+ */
+#define PHURPLE_WHEEL_BITS 6
+#define PHURPLE_WHEEL_SIZE (1 << PHURPLE_WHEEL_BITS)
+#define PHURPLE_WHEEL_MASK (PHURPLE_WHEEL_SIZE - 1)
+#define PHURPLE_WHEEL_LEVELS 4
+#define PHURPLE_EPOLL_BATCH 128
+
+struct phurple_timer {
+	guint id;
+	guint interval;
+	guint64 expires;
+	GSourceFunc func;
+	gpointer data;
+	struct phurple_timer *prev;
+	struct phurple_timer *next;
+	/* head of the list the timer is linked into */
+	struct phurple_timer **list;
+	gboolean removed;
+};
+
+struct phurple_watch {
+	guint id;
+	int fd;
+	PurpleInputCondition cond;
+	PurpleInputFunction func;
+	gpointer data;
+};
+
+struct phurple_fd {
+	int fd;
+	/* tells a reused fd number apart from a stale epoll event */
+	guint32 gen;
+	guint32 events;
+	GSList *watches;
+};
+
+struct phurple_epoll_loop {
+	int epfd;
+	GSource *source;
+	GPollFD pollfd;
+	/* monotonic ms the wheel was started at */
+	guint64 start;
+	/* current wheel tick, ms since start */
+	guint64 now;
+	struct phurple_timer *wheel[PHURPLE_WHEEL_LEVELS][PHURPLE_WHEEL_SIZE];
+	/* timers beyond the wheel range, rehashed when the top level wraps */
+	struct phurple_timer *overflow;
+	struct phurple_timer *running;
+	GHashTable *timers;
+	GHashTable *watches;
+	GHashTable *fds;
+	GArray *ready;
+	guint next_id;
+	guint32 next_gen;
+};
+
+static struct phurple_epoll_loop eloop;
+
+static guint64
+phurple_monotonic_ms(void)
+{/*{{{*/
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (guint64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}/*}}}*/
+
+static guint64
+phurple_epoll_clock(void)
+{/*{{{*/
+	return phurple_monotonic_ms() - eloop.start;
+}/*}}}*/
+
+static void
+phurple_timer_link(struct phurple_timer **list, struct phurple_timer *tm)
+{/*{{{*/
+	tm->prev = NULL;
+	tm->next = *list;
+	if (*list) {
+		(*list)->prev = tm;
+	}
+	*list = tm;
+	tm->list = list;
+}/*}}}*/
+
+static void
+phurple_timer_unlink(struct phurple_timer *tm)
+{/*{{{*/
+	if (tm->prev) {
+		tm->prev->next = tm->next;
+	} else {
+		*tm->list = tm->next;
+	}
+	if (tm->next) {
+		tm->next->prev = tm->prev;
+	}
+	tm->prev = tm->next = NULL;
+	tm->list = NULL;
+}/*}}}*/
+
+/* The timer goes to the lowest level where it shares the slot prefix of the
+	next level with the current tick, so its slot is always ahead */
+static void
+phurple_timer_place(struct phurple_timer *tm)
+{/*{{{*/
+	int level;
+
+	for (level = 0; level < PHURPLE_WHEEL_LEVELS; level++) {
+		int shift = PHURPLE_WHEEL_BITS * (level + 1);
+
+		if ((tm->expires >> shift) == (eloop.now >> shift)) {
+			phurple_timer_link(&eloop.wheel[level][(tm->expires >> (PHURPLE_WHEEL_BITS * level)) & PHURPLE_WHEEL_MASK], tm);
+			return;
+		}
+	}
+
+	phurple_timer_link(&eloop.overflow, tm);
+}/*}}}*/
+
+static void
+phurple_timer_schedule(struct phurple_timer *tm)
+{/*{{{*/
+	tm->expires = phurple_epoll_clock() + tm->interval;
+
+	/* the slot of the current tick has already been run */
+	if (tm->expires <= eloop.now) {
+		tm->expires = eloop.now + 1;
+	}
+
+	phurple_timer_place(tm);
+}/*}}}*/
+
+/* Returns the tick something has to be done at, either a timer expires or a
+	slot has to be cascaded, G_MAXUINT64 if the wheel is empty */
+static guint64
+phurple_timer_next_tick(void)
+{/*{{{*/
+	int level, i;
+
+	for (level = 0; level < PHURPLE_WHEEL_LEVELS; level++) {
+		int shift = PHURPLE_WHEEL_BITS * level;
+
+		for (i = ((eloop.now >> shift) & PHURPLE_WHEEL_MASK) + 1; i < PHURPLE_WHEEL_SIZE; i++) {
+			if (eloop.wheel[level][i]) {
+				return ((eloop.now >> (shift + PHURPLE_WHEEL_BITS)) << (shift + PHURPLE_WHEEL_BITS)) | ((guint64)i << shift);
+			}
+		}
+	}
+
+	if (eloop.overflow) {
+		int shift = PHURPLE_WHEEL_BITS * PHURPLE_WHEEL_LEVELS;
+
+		return ((eloop.now >> shift) + 1) << shift;
+	}
+
+	return G_MAXUINT64;
+}/*}}}*/
+
+static void
+phurple_timer_rehash(struct phurple_timer **list)
+{/*{{{*/
+	struct phurple_timer *tm = *list, *next;
+
+	*list = NULL;
+
+	while (tm) {
+		next = tm->next;
+		phurple_timer_place(tm);
+		tm = next;
+	}
+}/*}}}*/
+
+static void
+phurple_timer_free(struct phurple_timer *tm)
+{/*{{{*/
+	g_hash_table_remove(eloop.timers, GUINT_TO_POINTER(tm->id));
+	g_free(tm);
+}/*}}}*/
+
+/* Cascade the upper levels down and run the timers due at the current tick */
+static void
+phurple_timer_tick(void)
+{/*{{{*/
+	struct phurple_timer *due, *tm;
+	int level;
+
+	if (eloop.overflow && 0 == (eloop.now & ((G_GUINT64_CONSTANT(1) << (PHURPLE_WHEEL_BITS * PHURPLE_WHEEL_LEVELS)) - 1))) {
+		phurple_timer_rehash(&eloop.overflow);
+	}
+
+	for (level = PHURPLE_WHEEL_LEVELS - 1; level > 0; level--) {
+		int shift = PHURPLE_WHEEL_BITS * level;
+
+		if (0 == (eloop.now & ((G_GUINT64_CONSTANT(1) << shift) - 1))) {
+			phurple_timer_rehash(&eloop.wheel[level][(eloop.now >> shift) & PHURPLE_WHEEL_MASK]);
+		}
+	}
+
+	/* move the slot aside, callbacks may add or remove timers */
+	due = eloop.wheel[0][eloop.now & PHURPLE_WHEEL_MASK];
+	eloop.wheel[0][eloop.now & PHURPLE_WHEEL_MASK] = NULL;
+	for (tm = due; tm; tm = tm->next) {
+		tm->list = &due;
+	}
+
+	while (due) {
+		gboolean keep;
+
+		tm = due;
+		phurple_timer_unlink(tm);
+
+		eloop.running = tm;
+		keep = tm->func(tm->data);
+		eloop.running = NULL;
+
+		if (keep && !tm->removed) {
+			phurple_timer_schedule(tm);
+		} else {
+			phurple_timer_free(tm);
+		}
+	}
+}/*}}}*/
+
+static void
+phurple_timer_advance(guint64 target)
+{/*{{{*/
+	while (eloop.now < target) {
+		guint64 next = phurple_timer_next_tick();
+
+		if (next > target) {
+			eloop.now = target;
+			break;
+		}
+
+		eloop.now = next;
+		phurple_timer_tick();
+	}
+}/*}}}*/
+
+static guint
+phurple_epoll_timeout_add(guint interval, GSourceFunc function, gpointer data)
+{/*{{{*/
+	struct phurple_timer *tm = g_new0(struct phurple_timer, 1);
+
+	tm->id = ++eloop.next_id;
+	tm->interval = interval;
+	tm->func = function;
+	tm->data = data;
+
+	phurple_timer_schedule(tm);
+	g_hash_table_insert(eloop.timers, GUINT_TO_POINTER(tm->id), tm);
+
+	/* the wheel may be due earlier than the bridge timer is armed for */
+	phurple_eventfd_invalidate();
+
+	return tm->id;
+}/*}}}*/
+
+static guint
+phurple_epoll_timeout_add_seconds(guint interval, GSourceFunc function, gpointer data)
+{/*{{{*/
+	return phurple_epoll_timeout_add(interval * 1000, function, data);
+}/*}}}*/
+
+static gboolean
+phurple_epoll_timeout_remove(guint handle)
+{/*{{{*/
+	struct phurple_timer *tm = g_hash_table_lookup(eloop.timers, GUINT_TO_POINTER(handle));
+
+	if (!tm || tm->removed) {
+		return FALSE;
+	}
+
+	if (tm == eloop.running) {
+		/* freed once the callback returns */
+		tm->removed = TRUE;
+		return TRUE;
+	}
+
+	phurple_timer_unlink(tm);
+	phurple_timer_free(tm);
+
+	return TRUE;
+}/*}}}*/
+
+/* Sync the epoll registration of an fd with its watches. A new watch always
+	tries EPOLL_CTL_ADD, the fd number may belong to a socket closed without
+	removing its watches and reopened since, epoll has forgotten it then. */
+static void
+phurple_epoll_fd_update(struct phurple_fd *entry, gboolean added)
+{/*{{{*/
+	struct epoll_event ev;
+	GSList *l;
+	guint32 events = 0;
+
+	for (l = entry->watches; l; l = l->next) {
+		struct phurple_watch *w = l->data;
+
+		if (w->cond & PURPLE_INPUT_READ) {
+			events |= EPOLLIN | EPOLLPRI;
+		}
+		if (w->cond & PURPLE_INPUT_WRITE) {
+			events |= EPOLLOUT;
+		}
+	}
+
+	if (events == entry->events && (!added || !events)) {
+		return;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.u64 = ((guint64)entry->gen << 32) | (guint32)entry->fd;
+
+	if (!events) {
+		/* fails harmlessly if the fd is already closed */
+		epoll_ctl(eloop.epfd, EPOLL_CTL_DEL, entry->fd, NULL);
+		g_hash_table_remove(eloop.fds, GINT_TO_POINTER(entry->fd));
+		g_free(entry);
+		return;
+	}
+
+	if (!entry->events || added) {
+		guint32 gen = entry->gen;
+
+		if (entry->events) {
+			/* if the add works it's a new socket, the events still queued
+				for the old one are ignored by the generation */
+			gen = eloop.next_gen + 1;
+			ev.data.u64 = ((guint64)gen << 32) | (guint32)entry->fd;
+		}
+
+		if (0 == epoll_ctl(eloop.epfd, EPOLL_CTL_ADD, entry->fd, &ev)) {
+			if (gen != entry->gen) {
+				entry->gen = ++eloop.next_gen;
+			}
+		} else if (EEXIST == errno) {
+			ev.data.u64 = ((guint64)entry->gen << 32) | (guint32)entry->fd;
+			epoll_ctl(eloop.epfd, EPOLL_CTL_MOD, entry->fd, &ev);
+		}
+	} else if (0 != epoll_ctl(eloop.epfd, EPOLL_CTL_MOD, entry->fd, &ev) && ENOENT == errno) {
+		/* the fd was closed and reopened without removing the watch */
+		epoll_ctl(eloop.epfd, EPOLL_CTL_ADD, entry->fd, &ev);
+	}
+
+	entry->events = events;
+}/*}}}*/
+
+static guint
+phurple_epoll_input_add(int fd, PurpleInputCondition condition, PurpleInputFunction function, gpointer data)
+{/*{{{*/
+	struct phurple_watch *w;
+	struct phurple_fd *entry;
+
+	entry = g_hash_table_lookup(eloop.fds, GINT_TO_POINTER(fd));
+	if (!entry) {
+		entry = g_new0(struct phurple_fd, 1);
+		entry->fd = fd;
+		entry->gen = ++eloop.next_gen;
+		g_hash_table_insert(eloop.fds, GINT_TO_POINTER(fd), entry);
+	}
+
+	w = g_new0(struct phurple_watch, 1);
+	w->id = ++eloop.next_id;
+	w->fd = fd;
+	w->cond = condition;
+	w->func = function;
+	w->data = data;
+
+	entry->watches = g_slist_prepend(entry->watches, w);
+	g_hash_table_insert(eloop.watches, GUINT_TO_POINTER(w->id), w);
+
+	phurple_epoll_fd_update(entry, TRUE);
+
+	return w->id;
+}/*}}}*/
+
+static gboolean
+phurple_epoll_input_remove(guint handle)
+{/*{{{*/
+	struct phurple_watch *w = g_hash_table_lookup(eloop.watches, GUINT_TO_POINTER(handle));
+	struct phurple_fd *entry;
+
+	if (!w) {
+		return FALSE;
+	}
+
+	g_hash_table_remove(eloop.watches, GUINT_TO_POINTER(handle));
+
+	entry = g_hash_table_lookup(eloop.fds, GINT_TO_POINTER(w->fd));
+	if (entry) {
+		entry->watches = g_slist_remove(entry->watches, w);
+		phurple_epoll_fd_update(entry, FALSE);
+	}
+
+	g_free(w);
+
+	return TRUE;
+}/*}}}*/
+
+/* Run the callbacks of one batch of ready fds, then the expired timers */
+static void
+phurple_epoll_dispatch(void)
+{/*{{{*/
+	struct epoll_event events[PHURPLE_EPOLL_BATCH];
+	int n, i;
+	guint j;
+
+	n = epoll_wait(eloop.epfd, events, PHURPLE_EPOLL_BATCH, 0);
+
+	for (i = 0; i < n; i++) {
+		int fd = (int)(guint32)events[i].data.u64;
+		struct phurple_fd *entry = g_hash_table_lookup(eloop.fds, GINT_TO_POINTER(fd));
+		PurpleInputCondition cond = 0;
+		GSList *l;
+
+		if (!entry || entry->gen != (guint32)(events[i].data.u64 >> 32)) {
+			continue;
+		}
+
+		if (events[i].events & (EPOLLIN | EPOLLPRI | EPOLLHUP | EPOLLERR)) {
+			cond |= PURPLE_INPUT_READ;
+		}
+		if (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+			cond |= PURPLE_INPUT_WRITE;
+		}
+
+		/* callbacks may remove any watch, only the ids are safe to keep */
+		g_array_set_size(eloop.ready, 0);
+		for (l = entry->watches; l; l = l->next) {
+			struct phurple_watch *w = l->data;
+
+			if (w->cond & cond) {
+				g_array_append_val(eloop.ready, w->id);
+			}
+		}
+
+		for (j = 0; j < eloop.ready->len; j++) {
+			struct phurple_watch *w = g_hash_table_lookup(eloop.watches,
+								GUINT_TO_POINTER(g_array_index(eloop.ready, guint, j)));
+
+			if (w) {
+				w->func(w->data, w->fd, w->cond & cond);
+			}
+		}
+	}
+
+	phurple_timer_advance(phurple_epoll_clock());
+}/*}}}*/
+
+static gboolean
+phurple_epoll_source_prepare(GSource *source, gint *timeout)
+{/*{{{*/
+	guint64 next = phurple_timer_next_tick(), now = phurple_epoll_clock();
+
+	if (G_MAXUINT64 == next) {
+		*timeout = -1;
+		return FALSE;
+	}
+
+	if (next <= now) {
+		*timeout = 0;
+		return TRUE;
+	}
+
+	*timeout = next - now > G_MAXINT ? G_MAXINT : (gint)(next - now);
+
+	return FALSE;
+}/*}}}*/
+
+static gboolean
+phurple_epoll_source_check(GSource *source)
+{/*{{{*/
+	return (eloop.pollfd.revents & G_IO_IN) || phurple_timer_next_tick() <= phurple_epoll_clock();
+}/*}}}*/
+
+static gboolean
+phurple_epoll_source_dispatch(GSource *source, GSourceFunc callback, gpointer data)
+{/*{{{*/
+	phurple_epoll_dispatch();
+
+	return TRUE;
+}/*}}}*/
+
+static GSourceFuncs phurple_epoll_source_funcs = {
+	phurple_epoll_source_prepare,
+	phurple_epoll_source_check,
+	phurple_epoll_source_dispatch,
+	NULL
+};
+
+static PurpleEventLoopUiOps epoll_eventloops =
+{
+	phurple_epoll_timeout_add,
+	phurple_epoll_timeout_remove,
+	phurple_epoll_input_add,
+	phurple_epoll_input_remove,
+	NULL,
+	phurple_epoll_timeout_add_seconds,
+	NULL,
+	NULL,
+	NULL
+};
+
+/* Returns the epoll ui ops, starting the backend on the first call, or NULL
+	if it can't be started */
+PurpleEventLoopUiOps *
+phurple_epoll_eventloop_ops(void)
+{/*{{{*/
+	if (eloop.source) {
+		return &epoll_eventloops;
+	}
+
+	eloop.epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (eloop.epfd < 0) {
+		return NULL;
+	}
+
+	eloop.start = phurple_monotonic_ms();
+	eloop.now = 0;
+	eloop.timers = g_hash_table_new(g_direct_hash, g_direct_equal);
+	eloop.watches = g_hash_table_new(g_direct_hash, g_direct_equal);
+	eloop.fds = g_hash_table_new(g_direct_hash, g_direct_equal);
+	eloop.ready = g_array_new(FALSE, FALSE, sizeof(guint));
+
+	eloop.source = g_source_new(&phurple_epoll_source_funcs, sizeof(GSource));
+	eloop.pollfd.fd = eloop.epfd;
+	eloop.pollfd.events = G_IO_IN;
+	g_source_add_poll(eloop.source, &eloop.pollfd);
+	g_source_attach(eloop.source, NULL);
+
+	return &epoll_eventloops;
+}/*}}}*/
+
+static void
+phurple_epoll_free_value(gpointer key, gpointer value, gpointer data)
+{/*{{{*/
+	struct phurple_fd *entry = value;
+
+	if (data) {
+		g_slist_free(entry->watches);
+	}
+
+	g_free(value);
+}/*}}}*/
+
+void
+phurple_epoll_shutdown(void)
+{/*{{{*/
+	if (!eloop.source) {
+		return;
+	}
+
+	g_source_destroy(eloop.source);
+	g_source_unref(eloop.source);
+	eloop.source = NULL;
+
+	close(eloop.epfd);
+	eloop.epfd = -1;
+
+	g_hash_table_foreach(eloop.timers, phurple_epoll_free_value, NULL);
+	g_hash_table_foreach(eloop.watches, phurple_epoll_free_value, NULL);
+	g_hash_table_foreach(eloop.fds, phurple_epoll_free_value, GINT_TO_POINTER(1));
+	g_hash_table_destroy(eloop.timers);
+	g_hash_table_destroy(eloop.watches);
+	g_hash_table_destroy(eloop.fds);
+	g_array_free(eloop.ready, TRUE);
+
+	memset(&eloop, 0, sizeof(eloop));
+}/*}}}*/
+
+#else
+
+PurpleEventLoopUiOps *
+phurple_epoll_eventloop_ops(void)
+{/*{{{*/
+	return NULL;
+}/*}}}*/
+
+void
+phurple_epoll_shutdown(void)
+{/*{{{*/
+}/*}}}*/
+
+int
+phurple_eventfd_get(void)
+{/*{{{*/
+	return -1;
+}/*}}}*/
+
+gboolean
+phurple_eventfd_dispatch(void)
+{/*{{{*/
+	return g_main_context_iteration(NULL, FALSE);
+}/*}}}*/
+
+void
+phurple_eventfd_invalidate(void)
+{/*{{{*/
+}/*}}}*/
+
+void
+phurple_eventfd_shutdown(void)
+{/*{{{*/
+}/*}}}*/
+
+#endif
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
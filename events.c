@@ -0,0 +1,337 @@
+/**
+ * Copyright (c) 2007-2014, Anatol Belski <ab@php.net>
+ *
+ * This file is part of Phurple.
+ *
+ * Phurple is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Phurple is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Phurple.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <php.h>
+
+#include "php_phurple.h"
+
+#include <glib.h>
+
+#include <string.h>
+#include <time.h>
+
+#include <purple.h>
+
+extern zval *
+php_create_account_obj_zval(PurpleAccount *paccount TSRMLS_DC);
+
+extern zval *
+php_create_conversation_obj_zval(PurpleConversation *pconv TSRMLS_DC);
+
+extern zval*
+phurple_call_hook(enum phurple_hook hook, zval **retval_ptr_ptr, int param_count, ...);
+
+extern void
+phurple_worker_forward_events(zval *batch TSRMLS_DC);
+
+extern void
+phurple_eventfd_invalidate(void);
+
+#define PHURPLE_EVENT_ACCOUNT	(1<<0)
+#define PHURPLE_EVENT_CONV		(1<<1)
+#define PHURPLE_EVENT_NAME		(1<<2)
+#define PHURPLE_EVENT_MESSAGE	(1<<3)
+#define PHURPLE_EVENT_FLAGS		(1<<4)
+#define PHURPLE_EVENT_EXTRA		(1<<5)
+
+#define PHURPLE_EVENT_MSG (PHURPLE_EVENT_ACCOUNT | PHURPLE_EVENT_CONV | PHURPLE_EVENT_NAME | PHURPLE_EVENT_MESSAGE | PHURPLE_EVENT_FLAGS)
+
+/* The hooks which can be delivered through onEvents(). Their return value
+	isn't used by libpurple, so the handler may run later. */
+struct phurple_event_type {
+	enum phurple_hook hook;
+	const char *type;
+	int fields;
+	const char *flags_key;
+	const char *extra_key;
+};
+
+static const struct phurple_event_type phurple_event_types[] = {
+	{PHURPLE_HOOK_WROTE_IM_MSG, "wrote-im-msg", PHURPLE_EVENT_MSG, "flags", NULL},
+	{PHURPLE_HOOK_SENT_IM_MSG, "sent-im-msg", PHURPLE_EVENT_ACCOUNT | PHURPLE_EVENT_NAME | PHURPLE_EVENT_MESSAGE, NULL, NULL},
+	{PHURPLE_HOOK_RECEIVED_IM_MSG, "received-im-msg", PHURPLE_EVENT_MSG, "flags", NULL},
+	{PHURPLE_HOOK_BLOCKED_IM_MSG, "blocked-im-msg", PHURPLE_EVENT_ACCOUNT | PHURPLE_EVENT_NAME | PHURPLE_EVENT_MESSAGE | PHURPLE_EVENT_FLAGS, "flags", NULL},
+	{PHURPLE_HOOK_WROTE_CHAT_MSG, "wrote-chat-msg", PHURPLE_EVENT_MSG, "flags", NULL},
+	{PHURPLE_HOOK_RECEIVED_CHAT_MSG, "received-chat-msg", PHURPLE_EVENT_MSG, "flags", NULL},
+	{PHURPLE_HOOK_CONVERSATION_CREATED, "conversation-created", PHURPLE_EVENT_CONV, NULL, NULL},
+	{PHURPLE_HOOK_CONVERSATION_UPDATED, "conversation-updated", PHURPLE_EVENT_CONV | PHURPLE_EVENT_FLAGS, "update_type", NULL},
+	{PHURPLE_HOOK_BUDDY_TYPING, "buddy-typing", PHURPLE_EVENT_ACCOUNT | PHURPLE_EVENT_NAME, NULL, NULL},
+	{PHURPLE_HOOK_BUDDY_TYPING_STOPPED, "buddy-typing-stopped", PHURPLE_EVENT_ACCOUNT | PHURPLE_EVENT_NAME, NULL, NULL},
+	{PHURPLE_HOOK_CHAT_BUDDY_JOINED, "chat-buddy-joined", PHURPLE_EVENT_CONV | PHURPLE_EVENT_NAME | PHURPLE_EVENT_FLAGS | PHURPLE_EVENT_EXTRA, "flags", "new_arrival"},
+	{PHURPLE_HOOK_CHAT_BUDDY_LEFT, "chat-buddy-left", PHURPLE_EVENT_CONV | PHURPLE_EVENT_NAME | PHURPLE_EVENT_MESSAGE, NULL, NULL},
+	{PHURPLE_HOOK_CHAT_INVITED_USER, "chat-invited-user", PHURPLE_EVENT_CONV | PHURPLE_EVENT_NAME | PHURPLE_EVENT_MESSAGE, NULL, NULL},
+	{PHURPLE_HOOK_CHAT_JOINED, "chat-joined", PHURPLE_EVENT_CONV, NULL, NULL},
+	{PHURPLE_HOOK_CHAT_LEFT, "chat-left", PHURPLE_EVENT_CONV, NULL, NULL},
+	{PHURPLE_HOOK_CHAT_TOPIC_CHANGED, "chat-topic-changed", PHURPLE_EVENT_CONV | PHURPLE_EVENT_NAME | PHURPLE_EVENT_MESSAGE, NULL, NULL},
+	{PHURPLE_HOOK_CHAT_BUDDY_FLAGS, "chat-buddy-flags", PHURPLE_EVENT_CONV | PHURPLE_EVENT_NAME | PHURPLE_EVENT_FLAGS | PHURPLE_EVENT_EXTRA, "flags", "old_flags"},
+	{PHURPLE_HOOK_COUNT, NULL, 0, NULL, NULL}
+};
+
+/* A pending event, the libpurple pointers are cleared if the object goes
+	away before the batch is delivered */
+struct phurple_event {
+	const struct phurple_event_type *type;
+	PurpleAccount *account;
+	PurpleConversation *conv;
+	char *name;
+	char *message;
+	long flags;
+	long extra;
+	time_t time;
+};
+
+static struct {
+	struct phurple_event *events;
+	int size;
+	int count;
+	guint idle;
+	/* a worker sends the batch to its supervisor, see forwardEvents() */
+	zend_bool forward;
+} phurple_event_buf = {NULL, 0, 0, 0, 0};
+
+static const struct phurple_event_type *
+phurple_event_type_get(enum phurple_hook hook)
+{/*{{{*/
+	const struct phurple_event_type *type;
+
+	for (type = phurple_event_types; type->type; type++) {
+		if (type->hook == hook) {
+			return type;
+		}
+	}
+
+	return NULL;
+}/*}}}*/
+
+int
+phurple_event_batchable(enum phurple_hook hook)
+{/*{{{*/
+	return NULL != phurple_event_type_get(hook);
+}/*}}}*/
+
+/* Deliver the pending events with a single onEvents() call, or forward
+	them to the supervisor. Objects can't cross the process, so forwarded
+	records carry the account and conversation names instead */
+void
+phurple_events_flush(TSRMLS_D)
+{/*{{{*/
+	zval *batch;
+	int i;
+
+	if (phurple_event_buf.idle) {
+		g_source_remove(phurple_event_buf.idle);
+		phurple_event_buf.idle = 0;
+	}
+
+	if (!phurple_event_buf.count) {
+		return;
+	}
+
+	MAKE_STD_ZVAL(batch);
+	array_init_size(batch, phurple_event_buf.count);
+
+	for (i = 0; i < phurple_event_buf.count; i++) {
+		struct phurple_event *ev = &phurple_event_buf.events[i];
+		int fields = ev->type->fields;
+		zval *entry;
+
+		MAKE_STD_ZVAL(entry);
+		array_init(entry);
+
+		add_assoc_string(entry, "type", (char *)ev->type->type, 1);
+		add_assoc_long(entry, "time", (long)ev->time);
+
+		if (phurple_event_buf.forward) {
+			PurpleAccount *account = ev->account;
+
+			if (!account && ev->conv) {
+				account = purple_conversation_get_account(ev->conv);
+			}
+			if (account) {
+				add_assoc_string(entry, "account", (char *)purple_account_get_username(account), 1);
+				add_assoc_string(entry, "protocol", (char *)purple_account_get_protocol_id(account), 1);
+			} else if (fields & PHURPLE_EVENT_ACCOUNT) {
+				add_assoc_null(entry, "account");
+			}
+			if (fields & PHURPLE_EVENT_CONV) {
+				if (ev->conv) {
+					add_assoc_string(entry, "conversation", (char *)purple_conversation_get_name(ev->conv), 1);
+				} else {
+					add_assoc_null(entry, "conversation");
+				}
+			}
+		} else {
+			if (fields & PHURPLE_EVENT_ACCOUNT) {
+				add_assoc_zval(entry, "account", php_create_account_obj_zval(ev->account TSRMLS_CC));
+			}
+			if (fields & PHURPLE_EVENT_CONV) {
+				add_assoc_zval(entry, "conversation", php_create_conversation_obj_zval(ev->conv TSRMLS_CC));
+			}
+		}
+		if (fields & PHURPLE_EVENT_NAME) {
+			if (ev->name) {
+				add_assoc_string(entry, "name", ev->name, 1);
+			} else {
+				add_assoc_null(entry, "name");
+			}
+		}
+		if (fields & PHURPLE_EVENT_MESSAGE) {
+			if (ev->message) {
+				add_assoc_string(entry, "message", ev->message, 1);
+			} else {
+				add_assoc_null(entry, "message");
+			}
+		}
+		if (fields & PHURPLE_EVENT_FLAGS) {
+			add_assoc_long(entry, (char *)ev->type->flags_key, ev->flags);
+		}
+		if (fields & PHURPLE_EVENT_EXTRA) {
+			add_assoc_long(entry, (char *)ev->type->extra_key, ev->extra);
+		}
+
+		add_next_index_zval(batch, entry);
+
+		g_free(ev->name);
+		g_free(ev->message);
+	}
+
+	/* events raised by the handler go into the next batch */
+	phurple_event_buf.count = 0;
+
+	if (phurple_event_buf.forward) {
+		phurple_worker_forward_events(batch TSRMLS_CC);
+	} else {
+		phurple_call_hook(PHURPLE_HOOK_ON_EVENTS, NULL, 1, &batch);
+	}
+
+	zval_ptr_dtor(&batch);
+}/*}}}*/
+
+static gboolean
+phurple_events_idle(gpointer data)
+{/*{{{*/
+	TSRMLS_FETCH();
+
+	phurple_event_buf.idle = 0;
+	phurple_events_flush(TSRMLS_C);
+
+	return FALSE;
+}/*}}}*/
+
+/* Queue an event, the batch is delivered once the current loop iteration is
+	done or the buffer is full */
+void
+phurple_event_push(enum phurple_hook hook, PurpleAccount *account, PurpleConversation *conv,
+				   const char *name, const char *message, long flags, long extra, time_t when TSRMLS_DC)
+{/*{{{*/
+	struct phurple_event *ev;
+
+	if (phurple_event_buf.count >= phurple_event_buf.size) {
+		phurple_events_flush(TSRMLS_C);
+	}
+
+	if (!phurple_event_buf.size) {
+		return;
+	}
+
+	ev = &phurple_event_buf.events[phurple_event_buf.count++];
+	ev->type = phurple_event_type_get(hook);
+	ev->account = account;
+	ev->conv = conv;
+	ev->name = g_strdup(name);
+	ev->message = g_strdup(message);
+	ev->flags = flags;
+	ev->extra = extra;
+	ev->time = when ? when : time(NULL);
+
+	if (!phurple_event_buf.idle) {
+		phurple_event_buf.idle = g_idle_add(phurple_events_idle, NULL);
+		phurple_eventfd_invalidate();
+	}
+}/*}}}*/
+
+/* Resize the buffer, pending events are delivered first */
+void
+phurple_events_set_size(int size TSRMLS_DC)
+{/*{{{*/
+	phurple_events_flush(TSRMLS_C);
+
+	phurple_event_buf.events = g_renew(struct phurple_event, phurple_event_buf.events, size);
+	phurple_event_buf.size = size;
+}/*}}}*/
+
+/* Whether the batches go to the supervisor instead of onEvents() */
+void
+phurple_events_set_forward(zend_bool forward)
+{/*{{{*/
+	phurple_event_buf.forward = forward;
+}/*}}}*/
+
+/* An account or conversation is being destroyed */
+void
+phurple_events_forget(void *ptr)
+{/*{{{*/
+	int i;
+
+	for (i = 0; i < phurple_event_buf.count; i++) {
+		struct phurple_event *ev = &phurple_event_buf.events[i];
+
+		if (ev->account == ptr) {
+			ev->account = NULL;
+		}
+		if (ev->conv == ptr) {
+			ev->conv = NULL;
+		}
+	}
+}/*}}}*/
+
+/* Drop the pending events without delivering them */
+void
+phurple_events_clear(void)
+{/*{{{*/
+	int i;
+
+	if (phurple_event_buf.idle) {
+		g_source_remove(phurple_event_buf.idle);
+		phurple_event_buf.idle = 0;
+	}
+
+	for (i = 0; i < phurple_event_buf.count; i++) {
+		g_free(phurple_event_buf.events[i].name);
+		g_free(phurple_event_buf.events[i].message);
+	}
+
+	g_free(phurple_event_buf.events);
+	phurple_event_buf.events = NULL;
+	phurple_event_buf.size = phurple_event_buf.count = 0;
+	phurple_event_buf.forward = 0;
+}/*}}}*/
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
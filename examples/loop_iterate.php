@@ -145,18 +145,17 @@ try {
 	$countdown = 10;
  
 	/**
-	 * This conains how many ms the script should sleep
-	 * until next iteration. Note, that this brought
-	 * really good performance anvantage comparing with
-	 * the while(true){} construct.
+	 * How many ms a single iteration may wait for events.
+	 * The iteration blocks while there's nothing to do,
+	 * so there's no need to sleep between the iterations.
 	 */
-	$sleep_time = 300;
+	$timeout = 300;
  
 	while($countdown > 0) {
 		/**
-		 * Do one glib event loop iteration.
+		 * Wait for the glib events and dispatch them.
 		 */
-		$client->iterate();
+		$client->iterate($timeout);
  
 		/**
 		 * Run a custom heart beat method cause
@@ -170,8 +169,6 @@ try {
 		if($client->isMessageSent()) {
 			$countdown--;
 		}
- 
-		usleep($sleep_time);
 	}
  
 	exit(0);
@@ -0,0 +1,283 @@
+/**
+ * Copyright (c) 2007-2014, Anatol Belski <ab@php.net>
+ *
+ * This file is part of Phurple.
+ *
+ * Phurple is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Phurple is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Phurple.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <php.h>
+
+#ifdef PHP_WIN32
+# include <main/config.w32.h>
+#else
+# include <main/php_config.h>
+#endif
+#ifdef HAVE_BUNDLED_PCRE
+#include <ext/pcre/pcrelib/pcre.h>
+#elif HAVE_PCRE
+#include <pcre.h>
+#endif
+
+#include "php_phurple.h"
+
+#include <glib.h>
+
+#include <string.h>
+
+#include <purple.h>
+
+/* A compiled addMessageFilter() rule */
+struct phurple_filter {
+	long id;
+	int field;
+	int match;
+	int scope;
+	char *str;
+	int str_len;
+	long mask;
+	pcre *re;
+	pcre_extra *extra;
+};
+
+static struct {
+	struct phurple_filter *rules;
+	int count;
+	int size;
+	long next_id;
+	long dropped;
+	int scopes;		/* conversation types having at least one rule */
+} phurple_filters = {NULL, 0, 0, 1, 0, 0};
+
+static void
+phurple_filter_free(struct phurple_filter *rule)
+{/*{{{*/
+	g_free(rule->str);
+	if (rule->extra) {
+		pcre_free(rule->extra);
+	}
+	if (rule->re) {
+		pcre_free(rule->re);
+	}
+}/*}}}*/
+
+static void
+phurple_filters_update_scopes(void)
+{/*{{{*/
+	int i;
+
+	phurple_filters.scopes = 0;
+	for (i = 0; i < phurple_filters.count; i++) {
+		phurple_filters.scopes |= phurple_filters.rules[i].scope;
+	}
+}/*}}}*/
+
+/* Compile a rule, returns its id or 0 if the pattern isn't usable */
+long
+phurple_filter_add(int field, int match, const char *pattern, int pattern_len, long mask, int scope TSRMLS_DC)
+{/*{{{*/
+	struct phurple_filter rule;
+
+	memset(&rule, 0, sizeof(rule));
+	rule.field = field;
+	rule.match = match;
+	rule.scope = scope;
+	rule.mask = mask;
+
+	if (PHURPLE_FILTER_FLAGS != field) {
+		if (PHURPLE_MATCH_REGEX == (match & ~PHURPLE_MATCH_NOCASE)) {
+			const char *error;
+			int error_offset;
+
+			rule.re = pcre_compile(pattern, (match & PHURPLE_MATCH_NOCASE) ? PCRE_CASELESS : 0,
+								   &error, &error_offset, NULL);
+			if (!rule.re) {
+				php_error_docref(NULL TSRMLS_CC, E_WARNING, "Compilation failed: %s at offset %d", error, error_offset);
+				return 0;
+			}
+
+			rule.extra = pcre_study(rule.re, 0, &error);
+		} else {
+			rule.str = g_strndup(pattern, pattern_len);
+			rule.str_len = pattern_len;
+		}
+	}
+
+	if (phurple_filters.count >= phurple_filters.size) {
+		phurple_filters.size = phurple_filters.size ? phurple_filters.size * 2 : 8;
+		phurple_filters.rules = g_renew(struct phurple_filter, phurple_filters.rules, phurple_filters.size);
+	}
+
+	rule.id = phurple_filters.next_id++;
+	phurple_filters.rules[phurple_filters.count++] = rule;
+	phurple_filters.scopes |= scope;
+
+	return rule.id;
+}/*}}}*/
+
+int
+phurple_filter_remove(long id)
+{/*{{{*/
+	int i;
+
+	for (i = 0; i < phurple_filters.count; i++) {
+		if (phurple_filters.rules[i].id == id) {
+			phurple_filter_free(&phurple_filters.rules[i]);
+			memmove(&phurple_filters.rules[i], &phurple_filters.rules[i + 1],
+					(phurple_filters.count - i - 1) * sizeof(struct phurple_filter));
+			phurple_filters.count--;
+			phurple_filters_update_scopes();
+			return 1;
+		}
+	}
+
+	return 0;
+}/*}}}*/
+
+void
+phurple_filters_clear(void)
+{/*{{{*/
+	int i;
+
+	for (i = 0; i < phurple_filters.count; i++) {
+		phurple_filter_free(&phurple_filters.rules[i]);
+	}
+
+	g_free(phurple_filters.rules);
+	phurple_filters.rules = NULL;
+	phurple_filters.count = phurple_filters.size = 0;
+	phurple_filters.scopes = 0;
+	phurple_filters.dropped = 0;
+}/*}}}*/
+
+long
+phurple_filters_dropped(void)
+{/*{{{*/
+	return phurple_filters.dropped;
+}/*}}}*/
+
+static int
+phurple_filter_contains_nocase(const char *haystack, const char *needle, int needle_len)
+{/*{{{*/
+	if (!needle_len) {
+		return 1;
+	}
+
+	for (; *haystack; haystack++) {
+		if (!g_ascii_strncasecmp(haystack, needle, needle_len)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}/*}}}*/
+
+static int
+phurple_filter_match(const struct phurple_filter *rule, const char *subject)
+{/*{{{*/
+	if (!subject) {
+		return 0;
+	}
+
+	switch (rule->match) {
+		case PHURPLE_MATCH_PREFIX:
+			return !strncmp(subject, rule->str, rule->str_len);
+
+		case PHURPLE_MATCH_PREFIX | PHURPLE_MATCH_NOCASE:
+			return !g_ascii_strncasecmp(subject, rule->str, rule->str_len);
+
+		case PHURPLE_MATCH_CONTAINS:
+			return NULL != strstr(subject, rule->str);
+
+		case PHURPLE_MATCH_CONTAINS | PHURPLE_MATCH_NOCASE:
+			return phurple_filter_contains_nocase(subject, rule->str, rule->str_len);
+
+		default: {
+			int ovector[3];
+
+			return pcre_exec(rule->re, rule->extra, subject, strlen(subject), 0, 0, ovector, 3) >= 0;
+		}
+	}
+}/*}}}*/
+
+/* Whether a received message goes to PHP. Without rules for the
+	conversation type everything passes, otherwise one rule has to match.
+	A message is filtered by both the receiving and the received hook, only
+	the last of them counts the drop. */
+int
+phurple_filter_accept(enum phurple_hook hook, PurpleConversation *conv, const char *sender,
+					  const char *message, PurpleMessageFlags flags, int count)
+{/*{{{*/
+	int scope, i;
+
+	scope = (PHURPLE_HOOK_RECEIVING_CHAT_MSG == hook || PHURPLE_HOOK_RECEIVED_CHAT_MSG == hook)
+			? PURPLE_CONV_TYPE_CHAT : PURPLE_CONV_TYPE_IM;
+
+	if (!(phurple_filters.scopes & scope)) {
+		return 1;
+	}
+
+	for (i = 0; i < phurple_filters.count; i++) {
+		const struct phurple_filter *rule = &phurple_filters.rules[i];
+
+		if (!(rule->scope & scope)) {
+			continue;
+		}
+
+		switch (rule->field) {
+			case PHURPLE_FILTER_FLAGS:
+				if (flags & rule->mask) {
+					return 1;
+				}
+				break;
+
+			case PHURPLE_FILTER_SENDER:
+				if (phurple_filter_match(rule, sender)) {
+					return 1;
+				}
+				break;
+
+			case PHURPLE_FILTER_CONVERSATION:
+				if (conv && phurple_filter_match(rule, purple_conversation_get_name(conv))) {
+					return 1;
+				}
+				break;
+
+			default:
+				if (phurple_filter_match(rule, message)) {
+					return 1;
+				}
+				break;
+		}
+	}
+
+	if (count) {
+		phurple_filters.dropped++;
+	}
+
+	return 0;
+}/*}}}*/
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
@@ -36,6 +36,9 @@
 extern zval *
 php_create_account_obj_zval(PurpleAccount *paccount TSRMLS_DC);
 
+extern void
+phurple_online_group_buddies(PurpleGroup *group, PurpleAccount *account, zval *ret TSRMLS_DC);
+
 #if PHURPLE_INTERNAL_DEBUG
 extern void phurple_dump_zval(zval *var);
 #endif
@@ -248,6 +251,31 @@ PHP_METHOD(PhurpleGroup, getName)
 }
 /* }}} */
 
+
+/* {{{ proto array PhurpleGroup::getOnlineBuddies([Phurple\Account account])
+	Returns the online buddies of the group, optionally only those of the account */
+PHP_METHOD(PhurpleGroup, getOnlineBuddies)
+{
+	struct ze_group_obj *zgo;
+	zval *account = NULL;
+	PurpleAccount *paccount = NULL;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|O!", &account, PhurpleAccount_ce) == FAILURE) {
+		return;
+	}
+
+	zgo = (struct ze_group_obj *) zend_object_store_get_object(getThis() TSRMLS_CC);
+
+	if (account) {
+		struct ze_account_obj *zao = (struct ze_account_obj *) zend_object_store_get_object(account TSRMLS_CC);
+
+		paccount = zao->paccount;
+	}
+
+	phurple_online_group_buddies(zgo->pgroup, paccount, return_value TSRMLS_CC);
+}
+/* }}} */
+
 /*
 **
 **
@@ -0,0 +1,286 @@
+/**
+ * Copyright (c) 2007-2014, Anatol Belski <ab@php.net>
+ *
+ * This file is part of Phurple.
+ *
+ * Phurple is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Phurple is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Phurple.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <php.h>
+
+#include "php_phurple.h"
+
+#include <glib.h>
+
+#include <string.h>
+
+#include <purple.h>
+
+extern zval *
+php_create_buddy_obj_zval(PurpleBuddy *pbuddy TSRMLS_DC);
+
+/* The online buddies by account and group. Built by the first query and
+	kept up to date from the blist signals afterwards */
+static struct {
+	GHashTable *buddies;	/* PurpleBuddy * => PurpleGroup * it's indexed under */
+	GHashTable *accounts;	/* PurpleAccount * => set of PurpleBuddy * */
+	GHashTable *groups;		/* PurpleGroup * => set of PurpleBuddy * */
+} phurple_online = {NULL, NULL, NULL};
+
+static GHashTable *
+phurple_online_set(GHashTable *index, gpointer key, gboolean create)
+{/*{{{*/
+	GHashTable *set = (GHashTable *) g_hash_table_lookup(index, key);
+
+	if (!set && create) {
+		set = g_hash_table_new(g_direct_hash, g_direct_equal);
+		g_hash_table_insert(index, key, set);
+	}
+
+	return set;
+}/*}}}*/
+
+static void
+phurple_online_set_remove(GHashTable *index, gpointer key, PurpleBuddy *buddy)
+{/*{{{*/
+	GHashTable *set = phurple_online_set(index, key, FALSE);
+
+	if (set) {
+		g_hash_table_remove(set, buddy);
+		if (!g_hash_table_size(set)) {
+			g_hash_table_remove(index, key);
+		}
+	}
+}/*}}}*/
+
+static void
+phurple_online_remove(PurpleBuddy *buddy)
+{/*{{{*/
+	gpointer group;
+
+	if (!g_hash_table_lookup_extended(phurple_online.buddies, buddy, NULL, &group)) {
+		return;
+	}
+
+	phurple_online_set_remove(phurple_online.accounts, purple_buddy_get_account(buddy), buddy);
+	phurple_online_set_remove(phurple_online.groups, group, buddy);
+	g_hash_table_remove(phurple_online.buddies, buddy);
+}/*}}}*/
+
+/* Index or unindex the buddy by its current state and group */
+static void
+phurple_online_update(PurpleBuddy *buddy)
+{/*{{{*/
+	PurpleGroup *group;
+	gpointer old;
+
+	if (!PURPLE_BUDDY_IS_ONLINE(buddy)) {
+		phurple_online_remove(buddy);
+		return;
+	}
+
+	group = purple_buddy_get_group(buddy);
+
+	if (g_hash_table_lookup_extended(phurple_online.buddies, buddy, NULL, &old)) {
+		if (old == (gpointer)group) {
+			return;
+		}
+		/* moved to another group */
+		phurple_online_set_remove(phurple_online.groups, old, buddy);
+	}
+
+	g_hash_table_insert(phurple_online.buddies, buddy, group);
+	g_hash_table_insert(phurple_online_set(phurple_online.accounts, purple_buddy_get_account(buddy), TRUE), buddy, buddy);
+	g_hash_table_insert(phurple_online_set(phurple_online.groups, group, TRUE), buddy, buddy);
+}/*}}}*/
+
+static void
+phurple_online_status_changed(PurpleBuddy *buddy, PurpleStatus *old_status, PurpleStatus *status)
+{/*{{{*/
+	phurple_online_update(buddy);
+}/*}}}*/
+
+static void
+phurple_online_node_added(PurpleBlistNode *node)
+{/*{{{*/
+	if (PURPLE_BLIST_NODE_IS_BUDDY(node)) {
+		phurple_online_update((PurpleBuddy *)node);
+	}
+}/*}}}*/
+
+static gboolean
+phurple_online_drop_buddy(gpointer key, gpointer value, gpointer data)
+{/*{{{*/
+	PurpleBuddy *buddy = (PurpleBuddy *)key;
+
+	phurple_online_set_remove(phurple_online.groups, g_hash_table_lookup(phurple_online.buddies, buddy), buddy);
+	g_hash_table_remove(phurple_online.buddies, buddy);
+
+	return TRUE;
+}/*}}}*/
+
+/* All the buddies of the account are offline or gone at once */
+static void
+phurple_online_drop_account(PurpleAccount *account)
+{/*{{{*/
+	GHashTable *set;
+
+	if (!phurple_online.accounts) {
+		return;
+	}
+
+	set = phurple_online_set(phurple_online.accounts, account, FALSE);
+	if (set) {
+		g_hash_table_foreach_remove(set, phurple_online_drop_buddy, NULL);
+		g_hash_table_remove(phurple_online.accounts, account);
+	}
+}/*}}}*/
+
+static void
+phurple_online_signed_off(PurpleConnection *conn)
+{/*{{{*/
+	phurple_online_drop_account(purple_connection_get_account(conn));
+}/*}}}*/
+
+static void
+phurple_online_init(void)
+{/*{{{*/
+	PurpleBlistNode *gnode, *cnode, *bnode;
+	void *blist_handle = purple_blist_get_handle();
+
+	if (phurple_online.buddies) {
+		return;
+	}
+
+	phurple_online.buddies = g_hash_table_new(g_direct_hash, g_direct_equal);
+	phurple_online.accounts = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) g_hash_table_destroy);
+	phurple_online.groups = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) g_hash_table_destroy);
+
+	purple_signal_connect(blist_handle, "buddy-signed-on", &phurple_online,
+						  PURPLE_CALLBACK(phurple_online_update), NULL);
+	purple_signal_connect(blist_handle, "buddy-signed-off", &phurple_online,
+						  PURPLE_CALLBACK(phurple_online_update), NULL);
+	purple_signal_connect(blist_handle, "buddy-status-changed", &phurple_online,
+						  PURPLE_CALLBACK(phurple_online_status_changed), NULL);
+	purple_signal_connect(blist_handle, "blist-node-added", &phurple_online,
+						  PURPLE_CALLBACK(phurple_online_node_added), NULL);
+	/* the buddy is intact for all the handlers, so the order doesn't matter */
+	purple_signal_connect(blist_handle, "buddy-removed", &phurple_online,
+						  PURPLE_CALLBACK(phurple_online_remove), NULL);
+	purple_signal_connect(purple_connections_get_handle(), "signed-off", &phurple_online,
+						  PURPLE_CALLBACK(phurple_online_signed_off), NULL);
+
+	/* the only full walk, later on the signals keep it current */
+	if (!purple_get_blist()) {
+		return;
+	}
+
+	for (gnode = purple_blist_get_root(); gnode; gnode = gnode->next) {
+		for (cnode = gnode->child; cnode; cnode = cnode->next) {
+			if (!PURPLE_BLIST_NODE_IS_CONTACT(cnode)) {
+				continue;
+			}
+			for (bnode = cnode->child; bnode; bnode = bnode->next) {
+				if (PURPLE_BLIST_NODE_IS_BUDDY(bnode) && PURPLE_BUDDY_IS_ONLINE((PurpleBuddy *)bnode)) {
+					phurple_online_update((PurpleBuddy *)bnode);
+				}
+			}
+		}
+	}
+}/*}}}*/
+
+static void
+phurple_online_fill(GHashTable *set, PurpleAccount *account, zval *ret TSRMLS_DC)
+{/*{{{*/
+	GHashTableIter iter;
+	gpointer buddy;
+
+	array_init_size(ret, set ? g_hash_table_size(set) : 0);
+
+	if (!set) {
+		return;
+	}
+
+	/* the index holds no wrappers, the ones created here die with the array */
+	g_hash_table_iter_init(&iter, set);
+	while (g_hash_table_iter_next(&iter, &buddy, NULL)) {
+		if (account && purple_buddy_get_account((PurpleBuddy *)buddy) != account) {
+			continue;
+		}
+		add_next_index_zval(ret, php_create_buddy_obj_zval((PurpleBuddy *)buddy TSRMLS_CC));
+	}
+}/*}}}*/
+
+long
+phurple_online_count(PurpleAccount *account)
+{/*{{{*/
+	GHashTable *set;
+
+	phurple_online_init();
+
+	set = phurple_online_set(phurple_online.accounts, account, FALSE);
+
+	return set ? (long) g_hash_table_size(set) : 0;
+}/*}}}*/
+
+void
+phurple_online_account_buddies(PurpleAccount *account, zval *ret TSRMLS_DC)
+{/*{{{*/
+	phurple_online_init();
+
+	phurple_online_fill(phurple_online_set(phurple_online.accounts, account, FALSE), NULL, ret TSRMLS_CC);
+}/*}}}*/
+
+void
+phurple_online_group_buddies(PurpleGroup *group, PurpleAccount *account, zval *ret TSRMLS_DC)
+{/*{{{*/
+	phurple_online_init();
+
+	phurple_online_fill(phurple_online_set(phurple_online.groups, group, FALSE), account, ret TSRMLS_CC);
+}/*}}}*/
+
+/* An account is destroyed */
+void
+phurple_online_forget(PurpleAccount *account)
+{/*{{{*/
+	phurple_online_drop_account(account);
+}/*}}}*/
+
+void
+phurple_online_clear(void)
+{/*{{{*/
+	if (!phurple_online.buddies) {
+		return;
+	}
+
+	purple_signals_disconnect_by_handle(&phurple_online);
+
+	g_hash_table_destroy(phurple_online.groups);
+	g_hash_table_destroy(phurple_online.accounts);
+	g_hash_table_destroy(phurple_online.buddies);
+	phurple_online.groups = phurple_online.accounts = phurple_online.buddies = NULL;
+}/*}}}*/
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
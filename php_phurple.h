@@ -54,12 +54,13 @@ PHP_METHOD(PhurpleClient, writeIM);
 PHP_METHOD(PhurpleClient, onSignedOn);
 PHP_METHOD(PhurpleClient, onSignedOff);
 PHP_METHOD(PhurpleClient, onConnectionError);
-PHP_METHOD(PhurpleClient, onSigningdOn);
+PHP_METHOD(PhurpleClient, onSigningOn);
 PHP_METHOD(PhurpleClient, onSigningOff);
 PHP_METHOD(PhurpleClient, onAutojoin);
 PHP_METHOD(PhurpleClient, runLoop);
 PHP_METHOD(PhurpleClient, quitLoop);
 PHP_METHOD(PhurpleClient, addAccount);
+PHP_METHOD(PhurpleClient, addAccounts);
 PHP_METHOD(PhurpleClient, getProtocols);
 PHP_METHOD(PhurpleClient, loopCallback);
 PHP_METHOD(PhurpleClient, loopHeartBeat);
@@ -67,6 +68,8 @@ PHP_METHOD(PhurpleClient, deleteAccount);
 PHP_METHOD(PhurpleClient, findAccount);
 PHP_METHOD(PhurpleClient, authorizeRequest);
 PHP_METHOD(PhurpleClient, iterate);
+PHP_METHOD(PhurpleClient, getEventFd);
+PHP_METHOD(PhurpleClient, dispatchReady);
 /*PHP_METHOD(PhurpleClient, set);
 PHP_METHOD(PhurpleClient, get);*/
 PHP_METHOD(PhurpleClient, connect);
@@ -107,6 +110,40 @@ PHP_METHOD(PhurpleClient, chatJoinFailed);
 PHP_METHOD(PhurpleClient, chatLeft);
 PHP_METHOD(PhurpleClient, chatTopicChanged);
 PHP_METHOD(PhurpleClient, chatBuddyFlags);
+PHP_METHOD(PhurpleClient, subscribe);
+PHP_METHOD(PhurpleClient, unsubscribe);
+PHP_METHOD(PhurpleClient, batchEvents);
+PHP_METHOD(PhurpleClient, onEvents);
+PHP_METHOD(PhurpleClient, useEventObjects);
+PHP_METHOD(PhurpleClient, addMessageFilter);
+PHP_METHOD(PhurpleClient, removeMessageFilter);
+PHP_METHOD(PhurpleClient, clearMessageFilters);
+PHP_METHOD(PhurpleClient, getFilteredCount);
+PHP_METHOD(PhurpleClient, registerCommand);
+PHP_METHOD(PhurpleClient, unregisterCommand);
+PHP_METHOD(PhurpleClient, on);
+PHP_METHOD(PhurpleClient, off);
+PHP_METHOD(PhurpleClient, sendCompleted);
+PHP_METHOD(PhurpleClient, setSendLimit);
+PHP_METHOD(PhurpleClient, setSendQueue);
+PHP_METHOD(PhurpleClient, getSendQueueLength);
+PHP_METHOD(PhurpleClient, clearSendQueue);
+PHP_METHOD(PhurpleClient, broadcast);
+PHP_METHOD(PhurpleClient, setConnectLimits);
+PHP_METHOD(PhurpleClient, getConnectProgress);
+PHP_METHOD(PhurpleClient, setReconnectLimit);
+PHP_METHOD(PhurpleClient, onReconnect);
+PHP_METHOD(PhurpleClient, forwardEvents);
+PHP_METHOD(PhurpleClient, spawnWorkers);
+PHP_METHOD(PhurpleClient, getWorkerId);
+PHP_METHOD(PhurpleClient, workerFor);
+PHP_METHOD(PhurpleClient, notifySupervisor);
+PHP_METHOD(PhurpleClient, sendToWorker);
+PHP_METHOD(PhurpleClient, sendViaWorker);
+PHP_METHOD(PhurpleClient, readWorkers);
+PHP_METHOD(PhurpleClient, onSupervisorMessage);
+PHP_METHOD(PhurpleClient, setPresenceCoalescing);
+PHP_METHOD(PhurpleClient, buddyPresenceChanged);
 
 PHP_METHOD(PhurpleAccount, __construct);
 PHP_METHOD(PhurpleAccount, setPassword);
@@ -128,6 +165,8 @@ PHP_METHOD(PhurpleAccount, disconnect);
 PHP_METHOD(PhurpleAccount, isDisconnecting);
 #endif
 PHP_METHOD(PhurpleAccount, isDisconnected);
+PHP_METHOD(PhurpleAccount, getOnlineBuddies);
+PHP_METHOD(PhurpleAccount, getOnlineCount);
 
 PHP_METHOD(PhurpleConnection, __construct);
 PHP_METHOD(PhurpleConnection, getAccount);
@@ -141,6 +180,7 @@ PHP_METHOD(PhurpleConnection, setFlags);
 PHP_METHOD(PhurpleConversation, __construct);
 PHP_METHOD(PhurpleConversation, getName);
 PHP_METHOD(PhurpleConversation, sendIM);
+PHP_METHOD(PhurpleConversation, sendMany);
 PHP_METHOD(PhurpleConversation, getAccount);
 PHP_METHOD(PhurpleConversation, setAccount);
 PHP_METHOD(PhurpleConversation, inviteUser);
@@ -166,27 +206,62 @@ PHP_METHOD(PhurpleBuddyList, findGroup);
 PHP_METHOD(PhurpleBuddyList, removeBuddy);
 PHP_METHOD(PhurpleBuddyList, removeGroup);
 PHP_METHOD(PhurpleBuddyList, addChat);
+PHP_METHOD(PhurpleBuddyList, begin);
+PHP_METHOD(PhurpleBuddyList, commit);
+PHP_METHOD(PhurpleBuddyList, batch);
+PHP_METHOD(PhurpleBuddyList, import);
+PHP_METHOD(PhurpleBuddyList, export);
+PHP_METHOD(PhurpleBuddyList, iterate);
+
+PHP_METHOD(PhurpleBuddyListIterator, __construct);
+PHP_METHOD(PhurpleBuddyListIterator, rewind);
+PHP_METHOD(PhurpleBuddyListIterator, valid);
+PHP_METHOD(PhurpleBuddyListIterator, current);
+PHP_METHOD(PhurpleBuddyListIterator, key);
+PHP_METHOD(PhurpleBuddyListIterator, next);
 
 PHP_METHOD(PhurpleGroup, __construct);
 PHP_METHOD(PhurpleGroup, getAccounts);
 PHP_METHOD(PhurpleGroup, getSize);
 PHP_METHOD(PhurpleGroup, getOnlineCount);
 PHP_METHOD(PhurpleGroup, getName);
+PHP_METHOD(PhurpleGroup, getOnlineBuddies);
 
 PHP_METHOD(PhurplePresence, __construct);
 
+PHP_METHOD(PhurpleEvent, __construct);
+
+#define PHURPLE_ARG_POOL_SIZE 32
+
 ZEND_BEGIN_MODULE_GLOBALS(phurple)
 
 	/**
 	 * This are ini settings
 	 */
 	char *custom_plugin_path;
+	char *event_loop;
 
 	/**
 	 * Client singleton instance
 	 */
 	zval *phurple_client_obj;
 
+	/**
+	 * Wrapper objects by libpurple pointer
+	 */
+	GHashTable *object_map;
+
+	/**
+	 * getProtocols() results, plain and detailed
+	 */
+	zval *protocol_cache[2];
+
+	/**
+	 * Spare hook argument zvals, see phurple_frame_release()
+	 */
+	zval *arg_pool[PHURPLE_ARG_POOL_SIZE];
+	int arg_pool_len;
+
 ZEND_END_MODULE_GLOBALS(phurple)
 
 #ifdef ZTS
@@ -208,6 +283,8 @@ extern zend_class_entry *PhurpleBuddyList_ce;
 extern zend_class_entry *PhurpleGroup_ce;
 extern zend_class_entry *PhurpleException_ce;
 extern zend_class_entry *PhurplePresence_ce;
+extern zend_class_entry *PhurpleEvent_ce;
+extern zend_class_entry *PhurpleBuddyListIterator_ce;
 
 # define PHURPLE_CLIENT_CLASS_NAME "Phurple\\Client"
 # define PHURPLE_CONVERSATION_CLASS_NAME "Phurple\\Conversation"
@@ -218,6 +295,8 @@ extern zend_class_entry *PhurplePresence_ce;
 # define PHURPLE_BUDDY_GROUP_CLASS_NAME "Phurple\\BuddyGroup"
 # define PHURPLE_EXCEPTION_CLASS_NAME "Phurple\\Exception"
 # define PHURPLE_PRESENCE_CLASS_NAME "Phurple\\Presence"
+# define PHURPLE_EVENT_CLASS_NAME "Phurple\\Event"
+# define PHURPLE_BUDDYLIST_ITERATOR_CLASS_NAME "Phurple\\BuddyListIterator"
 
 struct ze_buddy_obj {
 	zend_object zo;
@@ -244,10 +323,170 @@ struct ze_connection_obj {
 	PurpleConnection *pconnection;
 };
 
+struct ze_buddylistiterator_obj {
+	zend_object zo;
+	/* filters, NULL matches any */
+	PurpleAccount *paccount;
+	PurpleGroup *pgroup;
+	zend_bool online;
+	/* the current buddy, NULL past the end */
+	PurpleBlistNode *node;
+	/* node was moved on by a removal, next() keeps it */
+	zend_bool advanced;
+	/* a filtered account or group is gone, nothing matches anymore */
+	zend_bool gone;
+	long key;
+};
+
+/**
+ * Client callback methods, which are invoked from the libpurple signal
+ * handlers. The order must match phurple_hooks[] in client.c
+ */
+enum phurple_hook {
+	PHURPLE_HOOK_INIT_INTERNAL = 0,
+	PHURPLE_HOOK_LOOP_CALLBACK,
+	PHURPLE_HOOK_LOOP_HEARTBEAT,
+	PHURPLE_HOOK_WRITE_CONV,
+	PHURPLE_HOOK_WRITE_IM,
+	PHURPLE_HOOK_ON_SIGNED_ON,
+	PHURPLE_HOOK_ON_SIGNING_ON,
+	PHURPLE_HOOK_ON_SIGNED_OFF,
+	PHURPLE_HOOK_ON_SIGNING_OFF,
+	PHURPLE_HOOK_ON_CONNECTION_ERROR,
+	PHURPLE_HOOK_ON_AUTOJOIN,
+	PHURPLE_HOOK_AUTHORIZE_REQUEST,
+	PHURPLE_HOOK_REQUEST_ACTION,
+	PHURPLE_HOOK_WRITING_IM_MSG,
+	PHURPLE_HOOK_WROTE_IM_MSG,
+	PHURPLE_HOOK_SENDING_IM_MSG,
+	PHURPLE_HOOK_SENT_IM_MSG,
+	PHURPLE_HOOK_RECEIVING_IM_MSG,
+	PHURPLE_HOOK_RECEIVED_IM_MSG,
+	PHURPLE_HOOK_BLOCKED_IM_MSG,
+	PHURPLE_HOOK_WRITING_CHAT_MSG,
+	PHURPLE_HOOK_WROTE_CHAT_MSG,
+	PHURPLE_HOOK_SENDING_CHAT_MSG,
+	PHURPLE_HOOK_SENT_CHAT_MSG,
+	PHURPLE_HOOK_RECEIVING_CHAT_MSG,
+	PHURPLE_HOOK_RECEIVED_CHAT_MSG,
+	PHURPLE_HOOK_CONVERSATION_CREATED,
+	PHURPLE_HOOK_CONVERSATION_UPDATED,
+	PHURPLE_HOOK_DELETING_CONVERSATION,
+	PHURPLE_HOOK_BUDDY_TYPING,
+	PHURPLE_HOOK_BUDDY_TYPING_STOPPED,
+	PHURPLE_HOOK_CHAT_BUDDY_JOINING,
+	PHURPLE_HOOK_CHAT_BUDDY_JOINED,
+	PHURPLE_HOOK_CHAT_BUDDY_LEAVING,
+	PHURPLE_HOOK_CHAT_BUDDY_LEFT,
+	PHURPLE_HOOK_CHAT_INVITING_USER,
+	PHURPLE_HOOK_CHAT_INVITED_USER,
+	PHURPLE_HOOK_CHAT_INVITED,
+	PHURPLE_HOOK_CHAT_INVITE_BLOCKED,
+	PHURPLE_HOOK_CHAT_JOINED,
+	PHURPLE_HOOK_CHAT_JOIN_FAILED,
+	PHURPLE_HOOK_CHAT_LEFT,
+	PHURPLE_HOOK_CHAT_TOPIC_CHANGED,
+	PHURPLE_HOOK_CHAT_BUDDY_FLAGS,
+	PHURPLE_HOOK_ON_EVENTS,
+	PHURPLE_HOOK_SEND_COMPLETED,
+	PHURPLE_HOOK_ON_RECONNECT,
+	PHURPLE_HOOK_ON_SUPERVISOR_MESSAGE,
+	PHURPLE_HOOK_BUDDY_PRESENCE_CHANGED,
+	PHURPLE_HOOK_COUNT
+};
+
+struct phurple_hook_entry {
+	const char *name;	/* lowercased method name */
+	int name_len;
+};
+
+#define PHURPLE_FRAME_SIZE 8
+
+enum phurple_arg_kind {
+	PHURPLE_ARG_OWNED = 0,	/* a reference passed in by the caller */
+	PHURPLE_ARG_POOLED,		/* taken from the argument pool */
+	PHURPLE_ARG_BORROWED	/* pooled, the string belongs to libpurple */
+};
+
+/** Arguments of a single hook call, lives on the C stack of the callback */
+struct phurple_frame {
+	enum phurple_hook hook;
+	zend_function *fn;
+	int argc;
+	zval *argv[PHURPLE_FRAME_SIZE];
+	enum phurple_arg_kind kind[PHURPLE_FRAME_SIZE];
+	zend_bool borrow;	/* strings may be passed without a copy */
+};
+
+/** A callable attached with Client::on() */
+struct phurple_listener {
+	zend_fcall_info fci;
+	zend_fcall_info_cache fcc;
+	long priority;
+	zend_bool removed;	/* off() during the dispatch, unlinked afterwards */
+	struct phurple_listener *next;
+};
+
+/** Message parts addMessageFilter() rules look at */
+enum phurple_filter_field {
+	PHURPLE_FILTER_MESSAGE = 0,
+	PHURPLE_FILTER_SENDER,
+	PHURPLE_FILTER_CONVERSATION,
+	PHURPLE_FILTER_FLAGS
+};
+
+#define PHURPLE_MATCH_PREFIX	1
+#define PHURPLE_MATCH_CONTAINS	2
+#define PHURPLE_MATCH_REGEX		3
+#define PHURPLE_MATCH_NOCASE	(1<<4)
+
+/** Outcome of a rate limited message, see sendCompleted() */
+#define PHURPLE_SEND_DIRECT		-1	/* not limited, sent by the caller */
+#define PHURPLE_SEND_SENT		1
+#define PHURPLE_SEND_DROPPED	2
+#define PHURPLE_SEND_FAILED		3
+
+/** What a full send queue does with one more message */
+#define PHURPLE_QUEUE_DROP_NEWEST	0
+#define PHURPLE_QUEUE_DROP_OLDEST	1
+
+/** What onReconnect() reports */
+#define PHURPLE_RECONNECT_SCHEDULED	1
+#define PHURPLE_RECONNECT_STARTED	2
+#define PHURPLE_RECONNECT_GAVE_UP	3
+
+/** Frames between the supervisor and the workers, see spawnWorkers() */
+#define PHURPLE_WORKER_FRAME_MESSAGE	'M'	/* notifySupervisor(), sendToWorker() */
+#define PHURPLE_WORKER_FRAME_EVENTS		'E'	/* forwardEvents() batch */
+#define PHURPLE_WORKER_FRAME_SEND		'S'	/* sendViaWorker() */
+
+/** The libpurple signal a hook is dispatched from */
+struct phurple_signal_entry {
+	enum phurple_hook hook;
+	const char *signal;
+	PurpleCallback cb;
+};
+
 struct ze_client_obj {
 	zend_object zo;
 	int connection_handle;
 	GMainLoop *loop;
+	/* per class dispatch table, resolved once in getInstance() */
+	zend_function *hook_fn[PHURPLE_HOOK_COUNT];
+	zend_bool hook_overridden[PHURPLE_HOOK_COUNT];
+	/* hooks currently dispatched, see subscribe()/unsubscribe() */
+	zend_bool hook_enabled[PHURPLE_HOOK_COUNT];
+	/* hooks queued for onEvents(), see batchEvents() */
+	zend_bool hook_batched[PHURPLE_HOOK_COUNT];
+	/* hooks passed a single Phurple\Event, see useEventObjects() */
+	zend_bool hook_event[PHURPLE_HOOK_COUNT];
+	/* on() callables by hook, highest priority first */
+	struct phurple_listener *listeners[PHURPLE_HOOK_COUNT];
+	int listener_depth;
+	zend_bool listeners_dirty;
+	zend_bool connected;
+	/* stream over the event fd, see getEventFd() */
+	zval *event_stream;
 };
 
 struct ze_presence_obj {
@@ -255,6 +494,19 @@ struct ze_presence_obj {
 	PurplePresence *ppresence;
 };
 
+/* The wrappers are only created once a property is read */
+struct ze_event_obj {
+	zend_object zo;
+	PurpleConversation *pconversation;
+	PurpleAccount *paccount;
+	const char *who;
+	const char *alias;
+	const char *message;
+	long flags;
+	long mtime;
+	int resolved;	/* bit per property already in the property table */
+};
+
 zend_object_handlers default_phurple_obj_handlers;
 
 /* These functions are renamed in libpurple >= 3, we can be compatible with < 3 then */
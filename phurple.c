@@ -24,6 +24,7 @@
 #include <php.h>
 #include <php_ini.h>
 #include <ext/standard/info.h>
+#include <zend_interfaces.h>
 
 #ifdef PHP_WIN32
 # include <main/config.w32.h>
@@ -58,6 +59,10 @@ ZEND_DECLARE_MODULE_GLOBALS(phurple)
 static void phurple_glib_io_destroy(gpointer data);
 static gboolean phurple_glib_io_invoke(GIOChannel *source, GIOCondition condition, gpointer data);
 static guint glib_input_add(gint fd, PurpleInputCondition condition, PurpleInputFunction function, gpointer data);
+static guint phurple_glib_timeout_add(guint interval, GSourceFunc function, gpointer data);
+#if GLIB_CHECK_VERSION(2,14,0)
+static guint phurple_glib_timeout_add_seconds(guint interval, GSourceFunc function, gpointer data);
+#endif
 static void phurple_write_conv_function(PurpleConversation *conv, const char *who, const char *alias, const char *message, PurpleMessageFlags flags, time_t mtime);
 static void phurple_write_im_function(PurpleConversation *conv, const char *who, const char *message, PurpleMessageFlags flags, time_t mtime);
 static void phurple_g_log_handler(const gchar *log_domain, GLogLevelFlags log_level, const gchar *message, gpointer user_data);
@@ -99,8 +104,39 @@ php_connection_obj_init(zend_class_entry *ce TSRMLS_DC);
 
 extern zend_object_value
 php_presence_obj_init(zend_class_entry *ce TSRMLS_DC);
+
+extern zend_object_value
+php_event_obj_init(zend_class_entry *ce TSRMLS_DC);
+
+extern zend_object_value
+php_buddylistiterator_obj_init(zend_class_entry *ce TSRMLS_DC);
+
+extern zval *
+php_create_event_obj_zval(PurpleConversation *pconv, PurpleAccount *paccount, const char *who,
+						  const char *alias, const char *message, long flags, long mtime TSRMLS_DC);
+
+extern void
+phurple_event_obj_release(zval **event TSRMLS_DC);
 /* }}} */
 
+extern zend_bool phurple_hook_enabled(enum phurple_hook hook TSRMLS_DC);
+extern zend_bool phurple_hook_event(enum phurple_hook hook TSRMLS_DC);
+extern void phurple_frame_init(struct phurple_frame *frame, enum phurple_hook hook TSRMLS_DC);
+extern zval *phurple_frame_long(struct phurple_frame *frame, long l TSRMLS_DC);
+extern zval *phurple_frame_string(struct phurple_frame *frame, const char *str TSRMLS_DC);
+extern void phurple_frame_zval(struct phurple_frame *frame, zval *value);
+extern zval *phurple_frame_call(struct phurple_frame *frame, zval **retval_ptr_ptr TSRMLS_DC);
+extern void phurple_frame_release(struct phurple_frame *frame TSRMLS_DC);
+extern zval* phurple_call_hook(enum phurple_hook hook, zval **retval_ptr_ptr, int param_count, ...);
+extern void phurple_eventfd_shutdown(void);
+extern void phurple_eventfd_invalidate(void);
+extern void phurple_epoll_shutdown(void);
+
+static GHashTable *phurple_protocols = NULL;
+void phurple_protocols_cache_clear(TSRMLS_D);
+extern void phurple_frame_pool_clear(TSRMLS_D);
+extern void phurple_workers_shutdown(void);
+
 /*  {{{ libpurple definitions */
 /* XXX no signal handler on windows, for now at least */
 #if defined(HAVE_SIGNAL_H) && !defined(PHP_WIN32)
@@ -135,13 +171,13 @@ typedef struct _PurpleGLibIOClosure {
 
 PurpleEventLoopUiOps glib_eventloops =
 {
-	g_timeout_add,
+	phurple_glib_timeout_add,
 	g_source_remove,
 	glib_input_add,
 	g_source_remove,
 	NULL,
 #if GLIB_CHECK_VERSION(2,14,0)
-	g_timeout_add_seconds,
+	phurple_glib_timeout_add_seconds,
 #else
 	NULL,
 #endif
@@ -219,14 +255,23 @@ PurpleRequestUiOps php_request_uiops =
 /* }}} */
 
 /* classes definitions*/
-zend_class_entry *PhurpleClient_ce, *PhurpleConversation_ce, *PhurpleAccount_ce, *PhurpleConnection_ce, *PhurpleBuddy_ce, *PhurpleBuddyList_ce, *PhurpleGroup_ce, *PhurpleException_ce, *PhurplePresence_ce;
+zend_class_entry *PhurpleClient_ce, *PhurpleConversation_ce, *PhurpleAccount_ce, *PhurpleConnection_ce, *PhurpleBuddy_ce, *PhurpleBuddyList_ce, *PhurpleGroup_ce, *PhurpleException_ce, *PhurplePresence_ce, *PhurpleEvent_ce, *PhurpleBuddyListIterator_ce;
 
 void phurple_globals_ctor(zend_phurple_globals *phurple_globals TSRMLS_DC)
 {/*{{{*/
 	phurple_globals->phurple_client_obj = NULL;
 
+	phurple_globals->object_map = NULL;
+
+	phurple_globals->protocol_cache[0] = NULL;
+	phurple_globals->protocol_cache[1] = NULL;
+
+	phurple_globals->arg_pool_len = 0;
+
 	phurple_globals->custom_plugin_path = NULL;
 
+	phurple_globals->event_loop = NULL;
+
 }/*}}}*/
 
 void phurple_globals_dtor(zend_phurple_globals *phurple_globals TSRMLS_DC)
@@ -240,6 +285,9 @@ void phurple_globals_dtor(zend_phurple_globals *phurple_globals TSRMLS_DC)
 ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_addAccount, 0, 0, 1)
 	    ZEND_ARG_INFO(0, dsn)
 ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_addAccounts, 0, 0, 1)
+	    ZEND_ARG_ARRAY_INFO(0, dsns, 0)
+ZEND_END_ARG_INFO()
 ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_runLoop, 0, 0, 1)
 	    ZEND_ARG_INFO(0, interval)
 ZEND_END_ARG_INFO()
@@ -263,6 +311,126 @@ ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_authorizeRequest, 0, 0, 4)
 	    ZEND_ARG_INFO(0, message)
 	    ZEND_ARG_INFO(0, on_list)
 ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_iterate, 0, 0, 0)
+	    ZEND_ARG_INFO(0, timeout_ms)
+	    ZEND_ARG_INFO(0, max_dispatches)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_getProtocols, 0, 0, 0)
+	    ZEND_ARG_INFO(0, details)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_batchEvents, 0, 0, 1)
+	    ZEND_ARG_ARRAY_INFO(0, hooks, 0)
+	    ZEND_ARG_INFO(0, max_events)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_onEvents, 0, 0, 1)
+	    ZEND_ARG_ARRAY_INFO(0, events, 0)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_useEventObjects, 0, 0, 1)
+	    ZEND_ARG_ARRAY_INFO(0, hooks, 0)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_addMessageFilter, 0, 0, 3)
+	    ZEND_ARG_INFO(0, field)
+	    ZEND_ARG_INFO(0, match)
+	    ZEND_ARG_INFO(0, pattern)
+	    ZEND_ARG_INFO(0, scope)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_removeMessageFilter, 0, 0, 1)
+	    ZEND_ARG_INFO(0, id)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_registerCommand, 0, 0, 2)
+	    ZEND_ARG_INFO(0, command)
+	    ZEND_ARG_INFO(0, handler)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_unregisterCommand, 0, 0, 1)
+	    ZEND_ARG_INFO(0, command)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_on, 0, 0, 2)
+	    ZEND_ARG_INFO(0, event)
+	    ZEND_ARG_INFO(0, listener)
+	    ZEND_ARG_INFO(0, priority)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_off, 0, 0, 1)
+	    ZEND_ARG_INFO(0, event)
+	    ZEND_ARG_INFO(0, listener)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_sendCompleted, 0, 0, 4)
+	    ZEND_ARG_OBJ_INFO(0, account, Phurple\\Account, 0)
+	    ZEND_ARG_INFO(0, name)
+	    ZEND_ARG_INFO(0, message)
+	    ZEND_ARG_INFO(0, status)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_setSendLimit, 0, 0, 1)
+	    ZEND_ARG_INFO(0, messages)
+	    ZEND_ARG_INFO(0, bytes)
+	    ZEND_ARG_INFO(0, burst)
+	    ZEND_ARG_OBJ_INFO(0, account, Phurple\\Account, 1)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_setSendQueue, 0, 0, 1)
+	    ZEND_ARG_INFO(0, size)
+	    ZEND_ARG_INFO(0, policy)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_getSendQueueLength, 0, 0, 0)
+	    ZEND_ARG_OBJ_INFO(0, account, Phurple\\Account, 1)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_clearSendQueue, 0, 0, 0)
+	    ZEND_ARG_OBJ_INFO(0, account, Phurple\\Account, 1)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_setConnectLimits, 0, 0, 1)
+	    ZEND_ARG_INFO(0, max)
+	    ZEND_ARG_INFO(0, per_host)
+	    ZEND_ARG_INFO(0, jitter)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_setReconnectLimit, 0, 0, 1)
+	    ZEND_ARG_INFO(0, per_minute)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_onReconnect, 0, 0, 5)
+	    ZEND_ARG_OBJ_INFO(0, account, Phurple\\Account, 0)
+	    ZEND_ARG_INFO(0, state)
+	    ZEND_ARG_INFO(0, attempt)
+	    ZEND_ARG_INFO(0, delay)
+	    ZEND_ARG_INFO(0, error)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_spawnWorkers, 0, 0, 2)
+	    ZEND_ARG_INFO(0, n)
+	    ZEND_ARG_INFO(0, worker_init)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_workerFor, 0, 0, 1)
+	    ZEND_ARG_INFO(0, key)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_notifySupervisor, 0, 0, 1)
+	    ZEND_ARG_INFO(0, data)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_sendToWorker, 0, 0, 2)
+	    ZEND_ARG_INFO(0, id)
+	    ZEND_ARG_INFO(0, data)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_sendViaWorker, 0, 0, 3)
+	    ZEND_ARG_INFO(0, account)
+	    ZEND_ARG_INFO(0, recipient)
+	    ZEND_ARG_INFO(0, message)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_readWorkers, 0, 0, 0)
+	    ZEND_ARG_INFO(0, timeout)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_onSupervisorMessage, 0, 0, 1)
+	    ZEND_ARG_INFO(0, data)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_setPresenceCoalescing, 0, 0, 1)
+	    ZEND_ARG_INFO(0, window_ms)
+	    ZEND_ARG_INFO(0, max_per_flush)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_buddyPresenceChanged, 0, 0, 1)
+	    ZEND_ARG_ARRAY_INFO(0, changes, 0)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_broadcast, 0, 0, 3)
+	    ZEND_ARG_OBJ_INFO(0, account, Phurple\\Account, 0)
+	    ZEND_ARG_ARRAY_INFO(0, recipients, 0)
+	    ZEND_ARG_INFO(0, message)
+	    ZEND_ARG_INFO(0, type)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_subscribe, 0, 0, 1)
+	    ZEND_ARG_INFO(0, hook)
+ZEND_END_ARG_INFO()
 ZEND_BEGIN_ARG_INFO_EX(PhurpleClient_setUserDir, 0, 0, 1)
 	    ZEND_ARG_INFO(0, path)
 ZEND_END_ARG_INFO()
@@ -464,6 +632,9 @@ ZEND_END_ARG_INFO()
 ZEND_BEGIN_ARG_INFO_EX(PhurpleConversation_sendIM, 0, 0, 1)
 	    ZEND_ARG_INFO(0, message)
 ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleConversation_sendMany, 0, 0, 1)
+	    ZEND_ARG_ARRAY_INFO(0, messages, 0)
+ZEND_END_ARG_INFO()
 ZEND_BEGIN_ARG_INFO_EX(PhurpleConversation_setAccount, 0, 0, 1)
 	    ZEND_ARG_OBJ_INFO(0, account, Phurple\\Account, 0)
 ZEND_END_ARG_INFO()
@@ -532,6 +703,25 @@ ZEND_BEGIN_ARG_INFO_EX(PhurpleBuddyList_addChat, 0, 0, 2)
 	    ZEND_ARG_INFO(0, name)
 	    ZEND_ARG_OBJ_INFO(0, account, Phurple\\Account, 0)
 ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleBuddyList_batch, 0, 0, 1)
+	    ZEND_ARG_INFO(0, fn)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleBuddyList_import, 0, 0, 2)
+	    ZEND_ARG_OBJ_INFO(0, account, Phurple\\Account, 0)
+	    ZEND_ARG_INFO(0, rows)
+	    ZEND_ARG_INFO(0, server)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleBuddyList_export, 0, 0, 1)
+	    ZEND_ARG_OBJ_INFO(0, account, Phurple\\Account, 0)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleBuddyList_iterate, 0, 0, 0)
+	    ZEND_ARG_OBJ_INFO(0, account, Phurple\\Account, 1)
+	    ZEND_ARG_INFO(0, group)
+	    ZEND_ARG_INFO(0, online_only)
+ZEND_END_ARG_INFO()
+ZEND_BEGIN_ARG_INFO_EX(PhurpleGroup_getOnlineBuddies, 0, 0, 0)
+	    ZEND_ARG_OBJ_INFO(0, account, Phurple\\Account, 1)
+ZEND_END_ARG_INFO()
 ZEND_BEGIN_ARG_INFO_EX(PhurpleGroup_construct, 0, 0, 1)
 	    ZEND_ARG_INFO(0, name)
 ZEND_END_ARG_INFO()
@@ -561,19 +751,22 @@ zend_function_entry PhurpleClient_methods[] = {
 	PHP_ME(PhurpleClient, onSignedOn, PhurpleClient_simpleCallback, ZEND_ACC_PROTECTED)
 	PHP_ME(PhurpleClient, onSignedOff, PhurpleClient_simpleCallback, ZEND_ACC_PROTECTED)
 	PHP_ME(PhurpleClient, onConnectionError, PhurpleClient_onConnectionError, ZEND_ACC_PROTECTED)
-	PHP_ME(PhurpleClient, onSigningdOn, PhurpleClient_simpleCallback, ZEND_ACC_PROTECTED)
+	PHP_ME(PhurpleClient, onSigningOn, PhurpleClient_simpleCallback, ZEND_ACC_PROTECTED)
 	PHP_ME(PhurpleClient, onSigningOff, PhurpleClient_simpleCallback, ZEND_ACC_PROTECTED)
 	PHP_ME(PhurpleClient, onAutojoin, PhurpleClient_simpleCallback, ZEND_ACC_PROTECTED)
 	PHP_ME(PhurpleClient, runLoop, PhurpleClient_runLoop, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
 	PHP_ME(PhurpleClient, quitLoop, NULL, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
 	PHP_ME(PhurpleClient, addAccount, PhurpleClient_addAccount, ZEND_ACC_PUBLIC)
-	PHP_ME(PhurpleClient, getProtocols, NULL, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, addAccounts, PhurpleClient_addAccounts, ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, getProtocols, PhurpleClient_getProtocols, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
 	PHP_ME(PhurpleClient, loopCallback, NULL, ZEND_ACC_PROTECTED)
 	PHP_ME(PhurpleClient, loopHeartBeat, NULL, ZEND_ACC_PROTECTED)
 	PHP_ME(PhurpleClient, deleteAccount, PhurpleClient_deleteAccount, ZEND_ACC_PUBLIC)
 	PHP_ME(PhurpleClient, findAccount, PhurpleClient_findAccount, ZEND_ACC_PUBLIC )
 	PHP_ME(PhurpleClient, authorizeRequest, PhurpleClient_authorizeRequest, ZEND_ACC_PROTECTED)
-	PHP_ME(PhurpleClient, iterate, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, iterate, PhurpleClient_iterate, ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, getEventFd, NULL, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, dispatchReady, NULL, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
 	/*PHP_ME(PhurpleClient, set, NULL, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
 	PHP_ME(PhurpleClient, get, NULL, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)*/
 	PHP_ME(PhurpleClient, connect, NULL, ZEND_ACC_PUBLIC)
@@ -614,6 +807,40 @@ zend_function_entry PhurpleClient_methods[] = {
 	PHP_ME(PhurpleClient, chatLeft, PhurpleClient_chatLeft, ZEND_ACC_PROTECTED)
 	PHP_ME(PhurpleClient, chatTopicChanged, PhurpleClient_chatTopicChanged, ZEND_ACC_PROTECTED)
 	PHP_ME(PhurpleClient, chatBuddyFlags, PhurpleClient_chatBuddyFlags, ZEND_ACC_PROTECTED)
+	PHP_ME(PhurpleClient, subscribe, PhurpleClient_subscribe, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, unsubscribe, PhurpleClient_subscribe, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, batchEvents, PhurpleClient_batchEvents, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, onEvents, PhurpleClient_onEvents, ZEND_ACC_PROTECTED)
+	PHP_ME(PhurpleClient, useEventObjects, PhurpleClient_useEventObjects, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, addMessageFilter, PhurpleClient_addMessageFilter, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, removeMessageFilter, PhurpleClient_removeMessageFilter, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, clearMessageFilters, NULL, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, getFilteredCount, NULL, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, registerCommand, PhurpleClient_registerCommand, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, unregisterCommand, PhurpleClient_unregisterCommand, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, on, PhurpleClient_on, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, off, PhurpleClient_off, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, sendCompleted, PhurpleClient_sendCompleted, ZEND_ACC_PROTECTED)
+	PHP_ME(PhurpleClient, setSendLimit, PhurpleClient_setSendLimit, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, setSendQueue, PhurpleClient_setSendQueue, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, getSendQueueLength, PhurpleClient_getSendQueueLength, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, clearSendQueue, PhurpleClient_clearSendQueue, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, broadcast, PhurpleClient_broadcast, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, setConnectLimits, PhurpleClient_setConnectLimits, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, getConnectProgress, NULL, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, setReconnectLimit, PhurpleClient_setReconnectLimit, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, onReconnect, PhurpleClient_onReconnect, ZEND_ACC_PROTECTED)
+	PHP_ME(PhurpleClient, forwardEvents, PhurpleClient_batchEvents, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, spawnWorkers, PhurpleClient_spawnWorkers, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	PHP_ME(PhurpleClient, getWorkerId, NULL, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	PHP_ME(PhurpleClient, workerFor, PhurpleClient_workerFor, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	PHP_ME(PhurpleClient, notifySupervisor, PhurpleClient_notifySupervisor, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	PHP_ME(PhurpleClient, sendToWorker, PhurpleClient_sendToWorker, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	PHP_ME(PhurpleClient, sendViaWorker, PhurpleClient_sendViaWorker, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	PHP_ME(PhurpleClient, readWorkers, PhurpleClient_readWorkers, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	PHP_ME(PhurpleClient, onSupervisorMessage, PhurpleClient_onSupervisorMessage, ZEND_ACC_PROTECTED)
+	PHP_ME(PhurpleClient, setPresenceCoalescing, PhurpleClient_setPresenceCoalescing, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleClient, buddyPresenceChanged, PhurpleClient_buddyPresenceChanged, ZEND_ACC_PROTECTED)
 	{NULL, NULL, NULL}
 };
 /* }}} */
@@ -624,6 +851,7 @@ zend_function_entry PhurpleConversation_methods[] = {
 	PHP_ME(PhurpleConversation, __construct, NULL, ZEND_ACC_PUBLIC)
 	PHP_ME(PhurpleConversation, getName, NULL, ZEND_ACC_PUBLIC)
 	PHP_ME(PhurpleConversation, sendIM, PhurpleConversation_sendIM, ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleConversation, sendMany, PhurpleConversation_sendMany, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
 	PHP_ME(PhurpleConversation, getAccount, NULL, ZEND_ACC_PUBLIC)
 	PHP_ME(PhurpleConversation, setAccount, PhurpleConversation_setAccount, ZEND_ACC_PUBLIC)
 	PHP_ME(PhurpleConversation, inviteUser, PhurpleConversation_inviteUser, ZEND_ACC_PUBLIC)
@@ -659,6 +887,8 @@ zend_function_entry PhurpleAccount_methods[] = {
 	PHP_ME(PhurpleAccount, isDisconnecting, NULL, ZEND_ACC_PUBLIC)
 #endif
 	PHP_ME(PhurpleAccount, isDisconnected, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleAccount, getOnlineBuddies, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleAccount, getOnlineCount, NULL, ZEND_ACC_PUBLIC)
 	{NULL, NULL, NULL}
 };
 /* }}} */
@@ -703,6 +933,12 @@ zend_function_entry PhurpleBuddyList_methods[] = {
 	PHP_ME(PhurpleBuddyList, removeBuddy, PhurpleBuddyList_removeBuddy, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
 	PHP_ME(PhurpleBuddyList, removeGroup, PhurpleBuddyList_removeGroup, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
 	PHP_ME(PhurpleBuddyList, addChat, PhurpleBuddyList_addChat, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	PHP_ME(PhurpleBuddyList, begin, NULL, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	PHP_ME(PhurpleBuddyList, commit, NULL, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	PHP_ME(PhurpleBuddyList, batch, PhurpleBuddyList_batch, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	PHP_ME(PhurpleBuddyList, import, PhurpleBuddyList_import, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	PHP_ME(PhurpleBuddyList, export, PhurpleBuddyList_export, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	PHP_ME(PhurpleBuddyList, iterate, PhurpleBuddyList_iterate, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
 	{NULL, NULL, NULL}
 };
 /* }}} */
@@ -715,6 +951,7 @@ zend_function_entry PhurpleGroup_methods[] = {
 	PHP_ME(PhurpleGroup, getSize, NULL, ZEND_ACC_PUBLIC)
 	PHP_ME(PhurpleGroup, getOnlineCount, NULL, ZEND_ACC_PUBLIC)
 	PHP_ME(PhurpleGroup, getName, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleGroup, getOnlineBuddies, PhurpleGroup_getOnlineBuddies, ZEND_ACC_PUBLIC)
 	{NULL, NULL, NULL}
 };
 /* }}} */
@@ -729,6 +966,27 @@ zend_function_entry PhurplePresence_methods[] = {
 /* }}} */
 
 
+/* {{{ event class methods[] */
+zend_function_entry PhurpleEvent_methods[] = {
+	PHP_ME(PhurpleEvent, __construct, NULL, ZEND_ACC_FINAL | ZEND_ACC_PRIVATE)
+	{NULL, NULL, NULL}
+};
+/* }}} */
+
+
+/* {{{ buddy list iterator class methods[] */
+zend_function_entry PhurpleBuddyListIterator_methods[] = {
+	PHP_ME(PhurpleBuddyListIterator, __construct, NULL, ZEND_ACC_FINAL | ZEND_ACC_PRIVATE)
+	PHP_ME(PhurpleBuddyListIterator, rewind, NULL, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleBuddyListIterator, valid, NULL, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleBuddyListIterator, current, NULL, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleBuddyListIterator, key, NULL, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	PHP_ME(PhurpleBuddyListIterator, next, NULL, ZEND_ACC_FINAL | ZEND_ACC_PUBLIC)
+	{NULL, NULL, NULL}
+};
+/* }}} */
+
+
 /* {{{ phurple_module_entry */
 zend_module_entry phurple_module_entry = {
 #if ZEND_MODULE_API_NO >= 20010901
@@ -756,6 +1014,7 @@ ZEND_GET_MODULE(phurple)
 /* {{{ PHP_INI */
 PHP_INI_BEGIN()
 	STD_PHP_INI_ENTRY("phurple.custom_plugin_path", "", PHP_INI_ALL, OnUpdateString, custom_plugin_path, zend_phurple_globals, phurple_globals)
+	STD_PHP_INI_ENTRY("phurple.event_loop", "glib", PHP_INI_ALL, OnUpdateString, event_loop, zend_phurple_globals, phurple_globals)
 PHP_INI_END()
 /* }}} */
 
@@ -815,6 +1074,25 @@ PHP_MINIT_FUNCTION(phurple)
 	zend_declare_class_constant_long(PhurpleClient_ce, "STATUS_INVISIBLE", sizeof("STATUS_INVISIBLE")-1, PURPLE_STATUS_INVISIBLE TSRMLS_CC);
 	zend_declare_class_constant_long(PhurpleClient_ce, "STATUS_AWAY", sizeof("STATUS_AWAY")-1, PURPLE_STATUS_AWAY TSRMLS_CC);
 	zend_declare_class_constant_long(PhurpleClient_ce, "STATUS_MOBILE", sizeof("STATUS_MOBILE")-1, PURPLE_STATUS_MOBILE TSRMLS_CC);
+	/* Message filter fields and match types */
+	zend_declare_class_constant_long(PhurpleClient_ce, "FILTER_MESSAGE", sizeof("FILTER_MESSAGE")-1, PHURPLE_FILTER_MESSAGE TSRMLS_CC);
+	zend_declare_class_constant_long(PhurpleClient_ce, "FILTER_SENDER", sizeof("FILTER_SENDER")-1, PHURPLE_FILTER_SENDER TSRMLS_CC);
+	zend_declare_class_constant_long(PhurpleClient_ce, "FILTER_CONVERSATION", sizeof("FILTER_CONVERSATION")-1, PHURPLE_FILTER_CONVERSATION TSRMLS_CC);
+	zend_declare_class_constant_long(PhurpleClient_ce, "FILTER_FLAGS", sizeof("FILTER_FLAGS")-1, PHURPLE_FILTER_FLAGS TSRMLS_CC);
+	zend_declare_class_constant_long(PhurpleClient_ce, "MATCH_PREFIX", sizeof("MATCH_PREFIX")-1, PHURPLE_MATCH_PREFIX TSRMLS_CC);
+	zend_declare_class_constant_long(PhurpleClient_ce, "MATCH_CONTAINS", sizeof("MATCH_CONTAINS")-1, PHURPLE_MATCH_CONTAINS TSRMLS_CC);
+	zend_declare_class_constant_long(PhurpleClient_ce, "MATCH_REGEX", sizeof("MATCH_REGEX")-1, PHURPLE_MATCH_REGEX TSRMLS_CC);
+	zend_declare_class_constant_long(PhurpleClient_ce, "MATCH_NOCASE", sizeof("MATCH_NOCASE")-1, PHURPLE_MATCH_NOCASE TSRMLS_CC);
+
+	zend_declare_class_constant_long(PhurpleClient_ce, "SEND_SENT", sizeof("SEND_SENT")-1, PHURPLE_SEND_SENT TSRMLS_CC);
+	zend_declare_class_constant_long(PhurpleClient_ce, "SEND_DROPPED", sizeof("SEND_DROPPED")-1, PHURPLE_SEND_DROPPED TSRMLS_CC);
+	zend_declare_class_constant_long(PhurpleClient_ce, "SEND_FAILED", sizeof("SEND_FAILED")-1, PHURPLE_SEND_FAILED TSRMLS_CC);
+	zend_declare_class_constant_long(PhurpleClient_ce, "QUEUE_DROP_NEWEST", sizeof("QUEUE_DROP_NEWEST")-1, PHURPLE_QUEUE_DROP_NEWEST TSRMLS_CC);
+	zend_declare_class_constant_long(PhurpleClient_ce, "QUEUE_DROP_OLDEST", sizeof("QUEUE_DROP_OLDEST")-1, PHURPLE_QUEUE_DROP_OLDEST TSRMLS_CC);
+
+	zend_declare_class_constant_long(PhurpleClient_ce, "RECONNECT_SCHEDULED", sizeof("RECONNECT_SCHEDULED")-1, PHURPLE_RECONNECT_SCHEDULED TSRMLS_CC);
+	zend_declare_class_constant_long(PhurpleClient_ce, "RECONNECT_STARTED", sizeof("RECONNECT_STARTED")-1, PHURPLE_RECONNECT_STARTED TSRMLS_CC);
+	zend_declare_class_constant_long(PhurpleClient_ce, "RECONNECT_GAVE_UP", sizeof("RECONNECT_GAVE_UP")-1, PHURPLE_RECONNECT_GAVE_UP TSRMLS_CC);
 	
 	INIT_CLASS_ENTRY(ce, PHURPLE_CONVERSATION_CLASS_NAME, PhurpleConversation_methods);
 	ce.create_object = php_conversation_obj_init;
@@ -904,6 +1182,26 @@ PHP_MINIT_FUNCTION(phurple)
 	ce.create_object = php_presence_obj_init;
 	PhurplePresence_ce = zend_register_internal_class(&ce TSRMLS_CC);
 
+	INIT_CLASS_ENTRY(ce, PHURPLE_EVENT_CLASS_NAME, PhurpleEvent_methods);
+	ce.create_object = php_event_obj_init;
+	PhurpleEvent_ce = zend_register_internal_class(&ce TSRMLS_CC);
+	PhurpleEvent_ce->ce_flags |= ZEND_ACC_FINAL_CLASS;
+	/* filled on the first read, see event.c */
+	zend_declare_property_null(PhurpleEvent_ce, "conversation", sizeof("conversation")-1, ZEND_ACC_PUBLIC TSRMLS_CC);
+	zend_declare_property_null(PhurpleEvent_ce, "account", sizeof("account")-1, ZEND_ACC_PUBLIC TSRMLS_CC);
+	zend_declare_property_null(PhurpleEvent_ce, "buddy", sizeof("buddy")-1, ZEND_ACC_PUBLIC TSRMLS_CC);
+	zend_declare_property_null(PhurpleEvent_ce, "sender", sizeof("sender")-1, ZEND_ACC_PUBLIC TSRMLS_CC);
+	zend_declare_property_null(PhurpleEvent_ce, "alias", sizeof("alias")-1, ZEND_ACC_PUBLIC TSRMLS_CC);
+	zend_declare_property_null(PhurpleEvent_ce, "message", sizeof("message")-1, ZEND_ACC_PUBLIC TSRMLS_CC);
+	zend_declare_property_null(PhurpleEvent_ce, "flags", sizeof("flags")-1, ZEND_ACC_PUBLIC TSRMLS_CC);
+	zend_declare_property_null(PhurpleEvent_ce, "time", sizeof("time")-1, ZEND_ACC_PUBLIC TSRMLS_CC);
+
+	INIT_CLASS_ENTRY(ce, PHURPLE_BUDDYLIST_ITERATOR_CLASS_NAME, PhurpleBuddyListIterator_methods);
+	ce.create_object = php_buddylistiterator_obj_init;
+	PhurpleBuddyListIterator_ce = zend_register_internal_class(&ce TSRMLS_CC);
+	PhurpleBuddyListIterator_ce->ce_flags |= ZEND_ACC_FINAL_CLASS;
+	zend_class_implements(PhurpleBuddyListIterator_ce TSRMLS_CC, 1, zend_ce_iterator);
+
 	/* end initalizing classes */
 	
 #if defined(HAVE_SIGNAL_H) && !defined(PHP_WIN32)
@@ -951,6 +1249,14 @@ PHP_MSHUTDOWN_FUNCTION(phurple)
 {
 	UNREGISTER_INI_ENTRIES();
 
+	phurple_eventfd_shutdown();
+	phurple_epoll_shutdown();
+
+	if (phurple_protocols) {
+		g_hash_table_destroy(phurple_protocols);
+		phurple_protocols = NULL;
+	}
+
 #ifdef ZTS
 	ts_free_id(phurple_globals_id);
 #else
@@ -971,6 +1277,17 @@ PHP_RINIT_FUNCTION(phurple)
 /* {{{ PHP_RSHUTDOWN_FUNCTION */
 PHP_RSHUTDOWN_FUNCTION(phurple)
 {
+	if (PHURPLE_G(object_map)) {
+		g_hash_table_destroy(PHURPLE_G(object_map));
+		PHURPLE_G(object_map) = NULL;
+	}
+
+	phurple_protocols_cache_clear(TSRMLS_C);
+
+	phurple_frame_pool_clear(TSRMLS_C);
+
+	phurple_workers_shutdown();
+
 	return SUCCESS;
 }
 /* }}} */
@@ -1078,6 +1395,87 @@ phurple_long_zval(long l)
 }
 /* }}} */
 
+/* {{{ identity map of the wrapper objects, keyed by the libpurple pointer.
+	The map only holds the object handle, so the same object is returned for
+	as long as something else keeps it alive. The free handlers of the
+	wrappers drop their entry, see phurple_object_map_release(). */
+static zend_object_store_bucket *
+phurple_object_map_bucket(void *ptr TSRMLS_DC)
+{
+	zend_object_handle handle;
+
+	if (!PHURPLE_G(object_map)) {
+		return NULL;
+	}
+
+	handle = (zend_object_handle) GPOINTER_TO_UINT(g_hash_table_lookup(PHURPLE_G(object_map), ptr));
+	if (!handle || !EG(objects_store).object_buckets || handle >= EG(objects_store).top
+		|| !EG(objects_store).object_buckets[handle].valid) {
+		return NULL;
+	}
+
+	return &EG(objects_store).object_buckets[handle];
+}
+
+/* the object storage of the wrapper, the caller gets no reference */
+void*
+phurple_object_map_find(void *ptr TSRMLS_DC)
+{
+	zend_object_store_bucket *bucket = phurple_object_map_bucket(ptr TSRMLS_CC);
+
+	return bucket ? bucket->bucket.obj.object : NULL;
+}
+
+/* own container for the caller, referencing the mapped object */
+zval*
+phurple_object_map_get(void *ptr TSRMLS_DC)
+{
+	zval *ret;
+	zend_object_store_bucket *bucket = phurple_object_map_bucket(ptr TSRMLS_CC);
+
+	/* the destructor already ran, the object is on its way out */
+	if (!bucket || bucket->destructor_called) {
+		return NULL;
+	}
+
+	MAKE_STD_ZVAL(ret);
+	Z_TYPE_P(ret) = IS_OBJECT;
+	Z_OBJ_HANDLE_P(ret) = (zend_object_handle)(bucket - EG(objects_store).object_buckets);
+	Z_OBJ_HT_P(ret) = &default_phurple_obj_handlers;
+	zend_objects_store_add_ref(ret TSRMLS_CC);
+
+	return ret;
+}
+
+void
+phurple_object_map_add(void *ptr, zval *obj TSRMLS_DC)
+{
+	if (!PHURPLE_G(object_map)) {
+		PHURPLE_G(object_map) = g_hash_table_new(g_direct_hash, g_direct_equal);
+	}
+
+	g_hash_table_insert(PHURPLE_G(object_map), ptr, GUINT_TO_POINTER(Z_OBJ_HANDLE_P(obj)));
+}
+
+void
+phurple_object_map_remove(void *ptr TSRMLS_DC)
+{
+	if (PHURPLE_G(object_map)) {
+		g_hash_table_remove(PHURPLE_G(object_map), ptr);
+	}
+}
+
+/* called by the free handler of a wrapper, another wrapper might be mapped
+	to the pointer already */
+void
+phurple_object_map_release(void *ptr, void *obj TSRMLS_DC)
+{
+	if (ptr && phurple_object_map_find(ptr TSRMLS_CC) == obj) {
+		phurple_object_map_remove(ptr TSRMLS_CC);
+	}
+}
+/* }}} */
+
 char*
 phurple_tolower(const char *s)
 {/* {{{ */
@@ -1109,50 +1507,128 @@ phurple_hash_index_find(HashTable *ht, void *element)
 }
 /* }}} */
 
-char*
-phurple_get_protocol_id_by_name(const char *protocol_name)
+/* Case insensitive, so the lookups need no lowercased copies */
+static guint
+phurple_protocol_hash(gconstpointer key)
+{/* {{{ */
+	const char *p = key;
+	guint h = 5381;
+
+	for (; *p; p++) {
+		h = (h << 5) + h + g_ascii_tolower(*p);
+	}
+
+	return h;
+}
+/* }}} */
+
+static gboolean
+phurple_protocol_equal(gconstpointer a, gconstpointer b)
+{/* {{{ */
+	return 0 == g_ascii_strcasecmp(a, b);
+}
+/* }}} */
+
+/* Map both the protocol names and ids to the plugins */
+static void
+phurple_protocols_rebuild(void)
 {/* {{{ */
 	GList *iter;
-	char *lc_proto = phurple_tolower(protocol_name);
+	TSRMLS_FETCH();
 
-	iter = purple_plugins_get_protocols();
+	if (phurple_protocols) {
+		g_hash_table_remove_all(phurple_protocols);
+	} else {
+		phurple_protocols = g_hash_table_new(phurple_protocol_hash, phurple_protocol_equal);
+	}
 
-	for (; iter; iter = iter->next) {
+	for (iter = purple_plugins_get_protocols(); iter; iter = iter->next) {
 		PurplePlugin *plugin = iter->data;
 		PurplePluginInfo *info = plugin->info;
 
+		if (info && info->id) {
+			g_hash_table_insert(phurple_protocols, info->id, plugin);
+		}
 		if (info && info->name) {
-			char *lc_name = phurple_tolower(info->name);
+			g_hash_table_insert(phurple_protocols, info->name, plugin);
+		}
+	}
 
-			if (0 == strcmp(lc_name, lc_proto)) {
-				efree(lc_proto);
-				efree(lc_name);
-				return info->id;
-			}
+	phurple_protocols_cache_clear(TSRMLS_C);
+}
+/* }}} */
+
+static void
+phurple_protocols_plugin_changed(PurplePlugin *plugin, gpointer data)
+{/* {{{ */
+	if (plugin->info && PURPLE_PLUGIN_PROTOCOL == plugin->info->type) {
+		phurple_protocols_rebuild();
+	}
+}
+/* }}} */
+
+void
+phurple_protocols_cache_clear(TSRMLS_D)
+{/* {{{ */
+	int i;
 
-			efree(lc_name);
+	for (i = 0; i < 2; i++) {
+		if (PHURPLE_G(protocol_cache)[i]) {
+			zval_ptr_dtor(&PHURPLE_G(protocol_cache)[i]);
+			PHURPLE_G(protocol_cache)[i] = NULL;
 		}
 	}
+}
+/* }}} */
 
-	efree(lc_proto);
+/* Build the protocol table, called once the core is initialized */
+void
+phurple_protocols_init(void)
+{/* {{{ */
+	static int handle;
 
-	return NULL;
+	phurple_protocols_rebuild();
+
+	purple_signal_connect(purple_plugins_get_handle(), "plugin-load", &handle,
+						  PURPLE_CALLBACK(phurple_protocols_plugin_changed), NULL);
+	purple_signal_connect(purple_plugins_get_handle(), "plugin-unload", &handle,
+						  PURPLE_CALLBACK(phurple_protocols_plugin_changed), NULL);
+}
+/* }}} */
+
+PurplePlugin *
+phurple_find_protocol(const char *name)
+{/* {{{ */
+	if (!phurple_protocols) {
+		phurple_protocols_rebuild();
+	}
+
+	return g_hash_table_lookup(phurple_protocols, name);
+}
+/* }}} */
+
+/* Accepts either a protocol name or id */
+char*
+phurple_get_protocol_id_by_name(const char *protocol_name)
+{/* {{{ */
+	PurplePlugin *plugin = phurple_find_protocol(protocol_name);
+
+	return plugin ? plugin->info->id : NULL;
 }
 /* }}} */
 
 /* Only returns the returned zval if retval_ptr != NULL */
 zval*
-call_custom_method(zval **object_pp, zend_class_entry *obj_ce,
+call_custom_method_params(zval **object_pp, zend_class_entry *obj_ce,
 					zend_function **fn_proxy, char *function_name,
 					int function_name_len, zval **retval_ptr_ptr,
-					int param_count, ... )
+					int param_count, zval ***params)
 {/* {{{ */
 	int result, i;
 	zend_fcall_info fci;
 	zend_fcall_info_cache fcic;
-	zval z_fname, ***params, *retval;
+	zval z_fname, *retval = NULL;
 	HashTable *function_table;
-	va_list given_params;
 		/**
 		 * TODO Remove this call and pass the tsrm_ls directly as param
 		 */
@@ -1162,22 +1638,11 @@ call_custom_method(zval **object_pp, zend_class_entry *obj_ce,
 	php_printf("==================== call_custom_method begin ============================\n");
 	php_printf("class: %s\n", obj_ce->name);
 	php_printf("method name: %s\n", function_name);
-#endif
-
-	params = (zval ***) safe_emalloc(param_count, sizeof(zval **), 0);
-
-	va_start(given_params, param_count);
-
-#if PHURPLE_INTERNAL_DEBUG
 	php_printf("param count: %d\n", param_count);
-#endif
 	for(i=0;i<param_count;i++) {
-		params[i] = va_arg(given_params, zval **);
-#if PHURPLE_INTERNAL_DEBUG
 		php_printf("i=>%d: ", i);phurple_dump_zval(*params[i]);php_printf("\n");
-#endif
 	}
-	va_end(given_params);
+#endif
 	
 	fci.size = sizeof(fci);
 	fci.function_table = EG(function_table);
@@ -1242,9 +1707,6 @@ call_custom_method(zval **object_pp, zend_class_entry *obj_ce,
 		}
 	}
 
-	if(params) {
-		efree(params);
-	}
 #if PHURPLE_INTERNAL_DEBUG
 	php_printf("==================== call_custom_method end ============================\n\n");
 #endif
@@ -1259,6 +1721,34 @@ call_custom_method(zval **object_pp, zend_class_entry *obj_ce,
 }
 /* }}} */
 
+zval*
+call_custom_method(zval **object_pp, zend_class_entry *obj_ce,
+					zend_function **fn_proxy, char *function_name,
+					int function_name_len, zval **retval_ptr_ptr,
+					int param_count, ... )
+{/* {{{ */
+	int i;
+	zval **stack_params[PHURPLE_FRAME_SIZE], ***params, *ret;
+	va_list given_params;
+
+	params = param_count > PHURPLE_FRAME_SIZE ? (zval ***) safe_emalloc(param_count, sizeof(zval **), 0) : stack_params;
+
+	va_start(given_params, param_count);
+	for(i=0;i<param_count;i++) {
+		params[i] = va_arg(given_params, zval **);
+	}
+	va_end(given_params);
+
+	ret = call_custom_method_params(object_pp, obj_ce, fn_proxy, function_name, function_name_len, retval_ptr_ptr, param_count, params);
+
+	if (params != stack_params) {
+		efree(params);
+	}
+
+	return ret;
+}
+/* }}} */
+
 static void*
 phurple_request_authorize(PurpleAccount *account,
 							const char *remote_user,
@@ -1270,13 +1760,12 @@ phurple_request_authorize(PurpleAccount *account,
 							PurpleAccountRequestAuthorizationCb deny_cb,
 							void *user_data)
 {/* {{{ */
-	zval *client;
-	zend_class_entry *ce;
 	zval *result = NULL, *php_account, *php_on_list, *php_remote_user, *php_message;
 	TSRMLS_FETCH();
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
+	if (!phurple_hook_enabled(PHURPLE_HOOK_AUTHORIZE_REQUEST TSRMLS_CC)) {
+		return NULL;
+	}
 	
 	php_account = php_create_account_obj_zval(account TSRMLS_CC);
 	
@@ -1286,11 +1775,7 @@ phurple_request_authorize(PurpleAccount *account,
 	php_message = phurple_string_zval(message);
 	php_remote_user = phurple_string_zval(remote_user);
 	
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   "authorizerequest",
-					   sizeof("authorizerequest")-1,
+	phurple_call_hook(PHURPLE_HOOK_AUTHORIZE_REQUEST,
 					   &result,
 					   4,
 					   &php_account,
@@ -1308,6 +1793,10 @@ phurple_request_authorize(PurpleAccount *account,
 		
 	}
 
+	if (result) {
+		zval_ptr_dtor(&result);
+	}
+
 	zval_ptr_dtor(&php_account);
 	zval_ptr_dtor(&php_remote_user);
 	zval_ptr_dtor(&php_message);
@@ -1427,19 +1916,44 @@ glib_input_add(gint fd, PurpleInputCondition condition, PurpleInputFunction func
 										  phurple_glib_io_invoke, closure, phurple_glib_io_destroy);
 	
 	g_io_channel_unref(channel);
+
+	phurple_eventfd_invalidate();
+
 	return closure->result;
 }
 /* }}} */
 
+/* The sources added between two dispatchReady() calls have to reach the event fd */
+static guint
+phurple_glib_timeout_add(guint interval, GSourceFunc function, gpointer data)
+{/* {{{ */
+	guint id = g_timeout_add(interval, function, data);
+
+	phurple_eventfd_invalidate();
+
+	return id;
+}
+/* }}} */
+
+#if GLIB_CHECK_VERSION(2,14,0)
+static guint
+phurple_glib_timeout_add_seconds(guint interval, GSourceFunc function, gpointer data)
+{/* {{{ */
+	guint id = g_timeout_add_seconds(interval, function, data);
+
+	phurple_eventfd_invalidate();
+
+	return id;
+}
+/* }}} */
+#endif
+
 static void
 phurple_write_conv_function(PurpleConversation *conv, const char *who, const char *alias, const char *message, PurpleMessageFlags flags, time_t mtime)
 {/* {{{ */
-	const int PARAMS_COUNT = 6;
-	zval *conversation, *buddy, *tmp1, *tmp2, *tmp3, *tmp4;
+	struct phurple_frame frame;
 	PurpleBuddy *pbuddy = NULL;
 	PurpleAccount *paccount = NULL;
-	zval *client;
-	zend_class_entry *ce;
 
 	char *who_san = (!who || '\0' == who) ? "" : (char*)who;
 	char *alias_san = (!alias || '\0' == alias) ? "" : (char*)alias;
@@ -1447,109 +1961,86 @@ phurple_write_conv_function(PurpleConversation *conv, const char *who, const cha
 
 	TSRMLS_FETCH();
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
+	if (!phurple_hook_enabled(PHURPLE_HOOK_WRITE_CONV TSRMLS_CC)) {
+		return;
+	}
 
-	conversation = php_create_conversation_obj_zval(conv TSRMLS_CC);
+	if (phurple_hook_event(PHURPLE_HOOK_WRITE_CONV TSRMLS_CC)) {
+		zval *event = php_create_event_obj_zval(conv, purple_conversation_get_account(conv), who_san,
+												alias_san, message_san, (long)flags, (long)mtime TSRMLS_CC);
+
+		phurple_call_hook(PHURPLE_HOOK_WRITE_CONV, NULL, 1, &event);
+		phurple_event_obj_release(&event TSRMLS_CC);
+		return;
+	}
+
+	phurple_frame_init(&frame, PHURPLE_HOOK_WRITE_CONV TSRMLS_CC);
+	phurple_frame_zval(&frame, php_create_conversation_obj_zval(conv TSRMLS_CC));
 
 	paccount = purple_conversation_get_account(conv);
 
 	pbuddy = purple_find_buddy(paccount, !who_san ? purple_conversation_get_name(conv) : who_san);
 	if(NULL != pbuddy) {
-		buddy = php_create_buddy_obj_zval(pbuddy TSRMLS_CC);
+		phurple_frame_zval(&frame, php_create_buddy_obj_zval(pbuddy TSRMLS_CC));
 	} else {
-		buddy = phurple_string_zval(who_san);
+		phurple_frame_string(&frame, who_san TSRMLS_CC);
 	}
 
-	tmp1 = phurple_string_zval(alias_san);
-	tmp2 = phurple_string_zval(message_san);
-	tmp3 = phurple_long_zval((long)flags);
-	tmp4 = phurple_long_zval((long)mtime);
-
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   "writeconv",
-					   sizeof("writeconv")-1,
-					   NULL,
-					   PARAMS_COUNT,
-					   &conversation,
-					   &buddy,
-					   &tmp1,
-					   &tmp2,
-					   &tmp3,
-					   &tmp4
-					   );
+	phurple_frame_string(&frame, alias_san TSRMLS_CC);
+	phurple_frame_string(&frame, message_san TSRMLS_CC);
+	phurple_frame_long(&frame, (long)flags TSRMLS_CC);
+	phurple_frame_long(&frame, (long)mtime TSRMLS_CC);
 
-	zval_ptr_dtor(&tmp1);
-	zval_ptr_dtor(&tmp2);
-	zval_ptr_dtor(&tmp3);
-	zval_ptr_dtor(&tmp4);
-	zval_ptr_dtor(&conversation);
-	zval_ptr_dtor(&buddy);
+	phurple_frame_call(&frame, NULL TSRMLS_CC);
+	phurple_frame_release(&frame TSRMLS_CC);
 }
 /* }}} */
 
 static void
 phurple_write_im_function(PurpleConversation *conv, const char *who, const char *message, PurpleMessageFlags flags, time_t mtime)
 {/* {{{ */
-	const int PARAMS_COUNT = 5;
-	zval *conversation, *buddy, *tmp1, *tmp2, *tmp3;
+	struct phurple_frame frame;
 	PurpleBuddy *pbuddy = NULL;
 	PurpleAccount *paccount = NULL;
-	zval *client;
-	zend_class_entry *ce;
 
 	char *who_san = (!who || '\0' == who) ? "" : (char*)who;
 	char *message_san = (!message || '\0' == message) ? "" : (char*)message;
 
 	TSRMLS_FETCH();
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
+	if (!phurple_hook_enabled(PHURPLE_HOOK_WRITE_IM TSRMLS_CC)) {
+		return;
+	}
+
+	if (phurple_hook_event(PHURPLE_HOOK_WRITE_IM TSRMLS_CC)) {
+		zval *event = php_create_event_obj_zval(conv, purple_conversation_get_account(conv), who_san,
+												NULL, message_san, (long)flags, (long)mtime TSRMLS_CC);
 
-	conversation = php_create_conversation_obj_zval(conv TSRMLS_CC);
+		phurple_call_hook(PHURPLE_HOOK_WRITE_IM, NULL, 1, &event);
+		phurple_event_obj_release(&event TSRMLS_CC);
+		return;
+	}
+
+	phurple_frame_init(&frame, PHURPLE_HOOK_WRITE_IM TSRMLS_CC);
+	phurple_frame_zval(&frame, php_create_conversation_obj_zval(conv TSRMLS_CC));
 
 	paccount = purple_conversation_get_account(conv);
 	if(paccount) {
 		pbuddy = purple_find_buddy(paccount, !who_san ? purple_conversation_get_name(conv) : who_san);
-		
-		if(NULL != pbuddy) {
-			buddy = php_create_buddy_obj_zval(pbuddy TSRMLS_CC);
-		} else {
-			if(who_san) {
-				buddy = phurple_string_zval(who_san);
-			} else {
-				MAKE_STD_ZVAL(buddy);
-				ZVAL_NULL(buddy);
-			}
-		}
 	}
 
-	tmp1 = phurple_string_zval(message_san);
-	tmp2 = phurple_long_zval((long)flags);
-	tmp3 = phurple_long_zval((long)mtime);
-
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   "writeim",
-					   sizeof("writeim")-1,
-					   NULL,
-					   PARAMS_COUNT,
-					   &conversation,
-					   &buddy,
-					   &tmp1,
-					   &tmp2,
-					   &tmp3
-	);
+	if(NULL != pbuddy) {
+		phurple_frame_zval(&frame, php_create_buddy_obj_zval(pbuddy TSRMLS_CC));
+	} else {
+		phurple_frame_string(&frame, who_san TSRMLS_CC);
+	}
 
-	zval_ptr_dtor(&tmp1);
-	zval_ptr_dtor(&tmp2);
-	zval_ptr_dtor(&tmp3);
-	zval_ptr_dtor(&conversation);
-	zval_ptr_dtor(&buddy);
+	phurple_frame_string(&frame, message_san TSRMLS_CC);
+	phurple_frame_long(&frame, (long)flags TSRMLS_CC);
+	phurple_frame_long(&frame, (long)mtime TSRMLS_CC);
 
+	phurple_frame_call(&frame, NULL TSRMLS_CC);
+	phurple_frame_release(&frame TSRMLS_CC);
 }
 /* }}} */
 
@@ -1570,16 +2061,22 @@ void
 	PurpleRequestActionCb *act_cbs;
 	zval *acts, *conversation, *acc, *tmp0, *tmp1, *tmp2, *tmp3, *tmp4;
 	zval *client_ret = NULL;
-	zval *client;
-	zend_class_entry *ce;
 	TSRMLS_FETCH();
 
 	if (action_count < 1) {
 		return NULL;
 	}
 
-	client = PHURPLE_G(phurple_client_obj);
-	ce = Z_OBJCE_P(client);
+	if (!phurple_hook_enabled(PHURPLE_HOOK_REQUEST_ACTION TSRMLS_CC)) {
+		/* the default implementation picks the first action */
+		PurpleRequestActionCb cb;
+
+		va_arg(actions, char *);
+		cb = va_arg(actions, PurpleRequestActionCb);
+		cb(user_data, 0);
+
+		return NULL;
+	}
 
 	/* XXX find a way to use the action callbacks not only from dialog window like GTK */
 	act_cbs = emalloc(action_count * sizeof(PurpleRequestActionCb));
@@ -1630,11 +2127,7 @@ void
 	conversation = php_create_conversation_obj_zval(conv TSRMLS_CC);
 
 	/* call phurple client cb*/
-	call_custom_method(&client,
-					   ce,
-					   NULL,
-					   "requestaction",
-					   sizeof("requestaction")-1,
+	phurple_call_hook(PHURPLE_HOOK_REQUEST_ACTION,
 					   &client_ret,
 					   PARAMS_COUNT,
 					   &tmp0,
@@ -1646,13 +2139,17 @@ void
 					   &conversation,
 					   &acts
 	);
-	convert_to_long(client_ret);
+	if (client_ret) {
+		convert_to_long(client_ret);
 
-	/* call action cb depending on phurple client return */
-	if (Z_LVAL_P(client_ret) >= 0 && Z_LVAL_P(client_ret) < action_count) {
-		PurpleRequestActionCb act_to_call = act_cbs[Z_LVAL_P(client_ret)];;
-		act_to_call(user_data, 0);
-	} /* else issue waning? */	
+		/* call action cb depending on phurple client return */
+		if (Z_LVAL_P(client_ret) >= 0 && Z_LVAL_P(client_ret) < action_count) {
+			PurpleRequestActionCb act_to_call = act_cbs[Z_LVAL_P(client_ret)];;
+			act_to_call(user_data, 0);
+		} /* else issue waning? */	
+
+		zval_ptr_dtor(&client_ret);
+	}
 	
 	efree(act_cbs);
 	zval_ptr_dtor(&tmp0);
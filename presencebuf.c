@@ -0,0 +1,308 @@
+/**
+ * Copyright (c) 2007-2014, Anatol Belski <ab@php.net>
+ *
+ * This file is part of Phurple.
+ *
+ * Phurple is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Phurple is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Phurple.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <php.h>
+
+#include "php_phurple.h"
+
+#include <glib.h>
+
+#include <string.h>
+
+#include <purple.h>
+
+extern zval *
+php_create_account_obj_zval(PurpleAccount *paccount TSRMLS_DC);
+
+extern zval *
+php_create_buddy_obj_zval(PurpleBuddy *pbuddy TSRMLS_DC);
+
+extern zval*
+phurple_call_hook(enum phurple_hook hook, zval **retval_ptr_ptr, int param_count, ...);
+
+extern zend_bool
+phurple_hook_delivered(enum phurple_hook hook TSRMLS_DC);
+
+#define PHURPLE_PRESENCE_WINDOW_MS	1000
+#define PHURPLE_PRESENCE_MAX_FLUSH	256
+
+/* A buddy with presence changes not delivered yet, its state is only read
+	on delivery, so any number of changes collapse into the latest one */
+struct phurple_presence_pending {
+	PurpleBuddy *buddy;
+	gint64 due;		/* ms, monotonic */
+	long changes;
+};
+
+static struct {
+	GQueue queue;			/* by due time */
+	GHashTable *buddies;	/* PurpleBuddy * => GList * link of the queue */
+	long window;
+	long max_flush;
+	guint timer;
+} phurple_presence_buf = {G_QUEUE_INIT, NULL, PHURPLE_PRESENCE_WINDOW_MS, PHURPLE_PRESENCE_MAX_FLUSH, 0};
+
+static gboolean
+phurple_presence_flush(gpointer data);
+
+static void
+phurple_presence_schedule(void)
+{/*{{{*/
+	struct phurple_presence_pending *p;
+	gint64 delay;
+
+	if (phurple_presence_buf.timer || !phurple_presence_buf.queue.head) {
+		return;
+	}
+
+	p = (struct phurple_presence_pending *)phurple_presence_buf.queue.head->data;
+	delay = p->due - g_get_monotonic_time() / 1000;
+
+	phurple_presence_buf.timer = purple_timeout_add(delay > 0 ? (guint)delay : 0, phurple_presence_flush, NULL);
+}/*}}}*/
+
+static zval *
+phurple_presence_record(struct phurple_presence_pending *p TSRMLS_DC)
+{/*{{{*/
+	PurpleBuddy *buddy = p->buddy;
+	PurplePresence *presence = purple_buddy_get_presence(buddy);
+	PurpleStatus *status = presence ? purple_presence_get_active_status(presence) : NULL;
+	zval *record;
+
+	MAKE_STD_ZVAL(record);
+	array_init(record);
+
+	/* unless the handler keeps the record, its wrappers are freed after the flush */
+	add_assoc_zval(record, "buddy", php_create_buddy_obj_zval(buddy TSRMLS_CC));
+	add_assoc_zval(record, "account", php_create_account_obj_zval(purple_buddy_get_account(buddy) TSRMLS_CC));
+	add_assoc_string(record, "name", (char *)purple_buddy_get_name(buddy), 1);
+	add_assoc_bool(record, "online", PURPLE_BUDDY_IS_ONLINE(buddy));
+	if (status) {
+		add_assoc_string(record, "status", (char *)purple_status_get_id(status), 1);
+	} else {
+		add_assoc_null(record, "status");
+	}
+	add_assoc_long(record, "idle", presence && purple_presence_is_idle(presence) ? (long)purple_presence_get_idle_time(presence) : 0);
+	add_assoc_long(record, "changes", p->changes);
+
+	return record;
+}/*}}}*/
+
+/* Deliver the due buddies, at most max_flush per loop iteration */
+static gboolean
+phurple_presence_flush(gpointer data)
+{/*{{{*/
+	gint64 now = g_get_monotonic_time() / 1000;
+	zval *batch;
+	long n = 0;
+	TSRMLS_FETCH();
+
+	phurple_presence_buf.timer = 0;
+
+	MAKE_STD_ZVAL(batch);
+	array_init(batch);
+
+	while (n < phurple_presence_buf.max_flush && phurple_presence_buf.queue.head) {
+		GList *link = phurple_presence_buf.queue.head;
+		struct phurple_presence_pending *p = (struct phurple_presence_pending *)link->data;
+
+		if (p->due > now) {
+			break;
+		}
+
+		g_queue_unlink(&phurple_presence_buf.queue, link);
+		g_hash_table_remove(phurple_presence_buf.buddies, p->buddy);
+
+		add_next_index_zval(batch, phurple_presence_record(p TSRMLS_CC));
+		n++;
+
+		g_free(p);
+		g_list_free_1(link);
+	}
+
+	/* changes raised by the handler are queued for a later flush */
+	if (n) {
+		phurple_call_hook(PHURPLE_HOOK_BUDDY_PRESENCE_CHANGED, NULL, 1, &batch);
+	}
+
+	zval_ptr_dtor(&batch);
+
+	/* the rest is due in the next loop iteration at the latest */
+	phurple_presence_schedule();
+
+	return FALSE;
+}/*}}}*/
+
+static void
+phurple_presence_push(PurpleBuddy *buddy)
+{/*{{{*/
+	struct phurple_presence_pending *p;
+	GList *link;
+	TSRMLS_FETCH();
+
+	if (!phurple_hook_delivered(PHURPLE_HOOK_BUDDY_PRESENCE_CHANGED TSRMLS_CC)) {
+		return;
+	}
+
+	/* already waiting, the window isn't extended so a flapping buddy is still reported */
+	link = (GList *) g_hash_table_lookup(phurple_presence_buf.buddies, buddy);
+	if (link) {
+		((struct phurple_presence_pending *)link->data)->changes++;
+		return;
+	}
+
+	p = g_new0(struct phurple_presence_pending, 1);
+	p->buddy = buddy;
+	p->due = g_get_monotonic_time() / 1000 + phurple_presence_buf.window;
+	p->changes = 1;
+
+	/* usually the latest, only a window shortened by setPresenceCoalescing()
+		puts it before the older entries */
+	link = phurple_presence_buf.queue.tail;
+	while (link && ((struct phurple_presence_pending *)link->data)->due > p->due) {
+		link = link->prev;
+	}
+
+	if (link) {
+		g_queue_insert_after(&phurple_presence_buf.queue, link, p);
+		link = link->next;
+	} else {
+		g_queue_push_head(&phurple_presence_buf.queue, p);
+		link = phurple_presence_buf.queue.head;
+	}
+	g_hash_table_insert(phurple_presence_buf.buddies, buddy, link);
+
+	/* the timer may be armed for a later head */
+	if (link == phurple_presence_buf.queue.head && phurple_presence_buf.timer) {
+		purple_timeout_remove(phurple_presence_buf.timer);
+		phurple_presence_buf.timer = 0;
+	}
+
+	phurple_presence_schedule();
+}/*}}}*/
+
+static void
+phurple_presence_status_changed(PurpleBuddy *buddy, PurpleStatus *old_status, PurpleStatus *status)
+{/*{{{*/
+	phurple_presence_push(buddy);
+}/*}}}*/
+
+static void
+phurple_presence_idle_changed(PurpleBuddy *buddy, gboolean old_idle, gboolean idle)
+{/*{{{*/
+	phurple_presence_push(buddy);
+}/*}}}*/
+
+static void
+phurple_presence_drop(PurpleBuddy *buddy)
+{/*{{{*/
+	GList *link = (GList *) g_hash_table_lookup(phurple_presence_buf.buddies, buddy);
+
+	if (link) {
+		g_hash_table_remove(phurple_presence_buf.buddies, buddy);
+		g_free(link->data);
+		g_queue_delete_link(&phurple_presence_buf.queue, link);
+	}
+}/*}}}*/
+
+/* Start watching the buddy presence, done by Client::connect() */
+void
+phurple_presence_init(void)
+{/*{{{*/
+	void *blist_handle = purple_blist_get_handle();
+
+	if (phurple_presence_buf.buddies) {
+		return;
+	}
+
+	phurple_presence_buf.buddies = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	purple_signal_connect(blist_handle, "buddy-signed-on", &phurple_presence_buf,
+						  PURPLE_CALLBACK(phurple_presence_push), NULL);
+	purple_signal_connect(blist_handle, "buddy-signed-off", &phurple_presence_buf,
+						  PURPLE_CALLBACK(phurple_presence_push), NULL);
+	purple_signal_connect(blist_handle, "buddy-status-changed", &phurple_presence_buf,
+						  PURPLE_CALLBACK(phurple_presence_status_changed), NULL);
+	purple_signal_connect(blist_handle, "buddy-idle-changed", &phurple_presence_buf,
+						  PURPLE_CALLBACK(phurple_presence_idle_changed), NULL);
+	purple_signal_connect(blist_handle, "buddy-removed", &phurple_presence_buf,
+						  PURPLE_CALLBACK(phurple_presence_drop), NULL);
+}/*}}}*/
+
+void
+phurple_presence_set_window(long window, long max_flush)
+{/*{{{*/
+	phurple_presence_buf.window = window > 0 ? window : 0;
+	phurple_presence_buf.max_flush = max_flush > 0 ? max_flush : PHURPLE_PRESENCE_MAX_FLUSH;
+}/*}}}*/
+
+/* An account is destroyed */
+void
+phurple_presence_forget(PurpleAccount *account)
+{/*{{{*/
+	GList *link = phurple_presence_buf.queue.head;
+
+	while (link) {
+		GList *next = link->next;
+		struct phurple_presence_pending *p = (struct phurple_presence_pending *)link->data;
+
+		if (purple_buddy_get_account(p->buddy) == account) {
+			phurple_presence_drop(p->buddy);
+		}
+		link = next;
+	}
+}/*}}}*/
+
+/* Drop the pending changes without delivering them */
+void
+phurple_presence_clear(void)
+{/*{{{*/
+	if (!phurple_presence_buf.buddies) {
+		return;
+	}
+
+	purple_signals_disconnect_by_handle(&phurple_presence_buf);
+
+	if (phurple_presence_buf.timer) {
+		purple_timeout_remove(phurple_presence_buf.timer);
+		phurple_presence_buf.timer = 0;
+	}
+
+	g_queue_foreach(&phurple_presence_buf.queue, (GFunc) g_free, NULL);
+	g_queue_clear(&phurple_presence_buf.queue);
+
+	g_hash_table_destroy(phurple_presence_buf.buddies);
+	phurple_presence_buf.buddies = NULL;
+
+	phurple_presence_buf.window = PHURPLE_PRESENCE_WINDOW_MS;
+	phurple_presence_buf.max_flush = PHURPLE_PRESENCE_MAX_FLUSH;
+}/*}}}*/
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
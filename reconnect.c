@@ -0,0 +1,332 @@
+/**
+ * Copyright (c) 2007-2014, Anatol Belski <ab@php.net>
+ *
+ * This file is part of Phurple.
+ *
+ * Phurple is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Phurple is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Phurple.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <php.h>
+
+#include "php_phurple.h"
+
+#include <glib.h>
+
+#include <string.h>
+
+#include <purple.h>
+
+extern zval *
+php_create_account_obj_zval(PurpleAccount *paccount TSRMLS_DC);
+
+extern zval*
+phurple_call_hook(enum phurple_hook hook, zval **retval_ptr_ptr, int param_count, ...);
+
+extern zend_bool
+phurple_hook_delivered(enum phurple_hook hook TSRMLS_DC);
+
+extern zval*
+phurple_long_zval(long l);
+
+extern int
+phurple_connq_push(PurpleAccount *account, const char *ui_id);
+
+/* Defaults of the Account::set() options */
+#define PHURPLE_RECONNECT_MIN_MS		1000
+#define PHURPLE_RECONNECT_MAX_MS		300000
+#define PHURPLE_RECONNECT_ATTEMPTS		10
+
+#define PHURPLE_RECONNECT_WINDOW_MS		60000
+
+/* The reconnect state of an account which lost its connection */
+struct phurple_reconnect {
+	PurpleAccount *account;
+	long attempt;
+	long error;
+	guint timer;
+};
+
+static struct {
+	GHashTable *accounts;	/* PurpleAccount * => struct phurple_reconnect * */
+	char *ui_id;
+	long per_minute;		/* global cap, 0 means unlimited */
+	gint64 window_start;
+	long window_count;
+} phurple_reconnects = {NULL, NULL, 0, 0, 0};
+
+static void
+phurple_reconnect_free(gpointer data)
+{/*{{{*/
+	struct phurple_reconnect *rc = (struct phurple_reconnect *)data;
+
+	if (rc->timer) {
+		purple_timeout_remove(rc->timer);
+	}
+	g_free(rc);
+}/*}}}*/
+
+/* An integer or boolean Account::set() option */
+static long
+phurple_reconnect_option(PurpleAccount *account, const char *name, long def)
+{/*{{{*/
+	GHashTable *table;
+	PurpleAccountSetting *setting;
+
+	table = (GHashTable *) g_hash_table_lookup(account->ui_settings, phurple_reconnects.ui_id);
+	if (!table) {
+		return def;
+	}
+
+	setting = (PurpleAccountSetting *) g_hash_table_lookup(table, name);
+	if (!setting) {
+		return def;
+	}
+
+	switch (setting->type) {
+		case PURPLE_PREF_BOOLEAN:
+			return setting->value.boolean;
+
+		case PURPLE_PREF_INT:
+			return setting->value.integer;
+
+		default:
+			return def;
+	}
+}/*}}}*/
+
+static void
+phurple_reconnect_emit(PurpleAccount *account, long state, long attempt, long delay, long error)
+{/*{{{*/
+	zval *acc, *st, *att, *del, *err;
+	TSRMLS_FETCH();
+
+	if (!phurple_hook_delivered(PHURPLE_HOOK_ON_RECONNECT TSRMLS_CC)) {
+		return;
+	}
+
+	acc = php_create_account_obj_zval(account TSRMLS_CC);
+	st = phurple_long_zval(state);
+	att = phurple_long_zval(attempt);
+	del = phurple_long_zval(delay);
+	err = phurple_long_zval(error);
+
+	phurple_call_hook(PHURPLE_HOOK_ON_RECONNECT, NULL, 5, &acc, &st, &att, &del, &err);
+
+	zval_ptr_dtor(&acc);
+	zval_ptr_dtor(&st);
+	zval_ptr_dtor(&att);
+	zval_ptr_dtor(&del);
+	zval_ptr_dtor(&err);
+}/*}}}*/
+
+/* Exponential backoff with equal jitter, half of the delay is random */
+static guint
+phurple_reconnect_delay(PurpleAccount *account, long attempt)
+{/*{{{*/
+	long min = phurple_reconnect_option(account, "reconnect_min", PHURPLE_RECONNECT_MIN_MS);
+	long max = phurple_reconnect_option(account, "reconnect_max", PHURPLE_RECONNECT_MAX_MS);
+	double delay = min > 0 ? min : 1;
+	long i;
+
+	for (i = 1; i < attempt && delay < max; i++) {
+		delay *= 2;
+	}
+	if (delay > max) {
+		delay = max;
+	}
+
+	return (guint)(delay / 2 + g_random_double_range(0, delay / 2));
+}/*}}}*/
+
+/* With the global cap reached the attempt is postponed to a random point
+	of the next window, which spreads a burst of them */
+static gboolean
+phurple_reconnect_admit(guint *delay)
+{/*{{{*/
+	gint64 now = g_get_monotonic_time() / 1000;
+
+	if (!phurple_reconnects.per_minute) {
+		return TRUE;
+	}
+
+	if (now - phurple_reconnects.window_start >= PHURPLE_RECONNECT_WINDOW_MS) {
+		phurple_reconnects.window_start = now;
+		phurple_reconnects.window_count = 0;
+	}
+
+	if (phurple_reconnects.window_count < phurple_reconnects.per_minute) {
+		phurple_reconnects.window_count++;
+		return TRUE;
+	}
+
+	*delay = (guint)(phurple_reconnects.window_start + PHURPLE_RECONNECT_WINDOW_MS - now)
+			 + (guint) g_random_int_range(0, PHURPLE_RECONNECT_WINDOW_MS / 4);
+
+	return FALSE;
+}/*}}}*/
+
+static gboolean
+phurple_reconnect_fire(gpointer data)
+{/*{{{*/
+	PurpleAccount *account = (PurpleAccount *)data;
+	struct phurple_reconnect *rc;
+	guint delay;
+
+	rc = (struct phurple_reconnect *) g_hash_table_lookup(phurple_reconnects.accounts, account);
+	if (!rc) {
+		return FALSE;
+	}
+	rc->timer = 0;
+
+	/* disabled or connected meanwhile */
+	if (!purple_account_get_enabled(account, phurple_reconnects.ui_id) || !purple_account_is_disconnected(account)) {
+		g_hash_table_remove(phurple_reconnects.accounts, account);
+		return FALSE;
+	}
+
+	if (!phurple_reconnect_admit(&delay)) {
+		rc->timer = purple_timeout_add(delay, phurple_reconnect_fire, account);
+		phurple_reconnect_emit(account, PHURPLE_RECONNECT_SCHEDULED, rc->attempt, (long)delay, rc->error);
+		return FALSE;
+	}
+
+	phurple_reconnect_emit(account, PHURPLE_RECONNECT_STARTED, rc->attempt, 0, rc->error);
+
+	/* the callback could have deleted the account */
+	if (!g_hash_table_lookup(phurple_reconnects.accounts, account)) {
+		return FALSE;
+	}
+
+	/* a connect scheduler spreads the attempts further */
+	if (!phurple_connq_push(account, phurple_reconnects.ui_id)) {
+		purple_account_connect(account);
+	}
+
+	return FALSE;
+}/*}}}*/
+
+static void
+phurple_reconnect_connection_error(PurpleConnection *conn, PurpleConnectionError err, const gchar *desc)
+{/*{{{*/
+	PurpleAccount *account = purple_connection_get_account(conn);
+	struct phurple_reconnect *rc;
+	long attempts;
+	guint delay;
+
+	if (!account || !phurple_reconnect_option(account, "reconnect", 0)) {
+		return;
+	}
+
+	rc = (struct phurple_reconnect *) g_hash_table_lookup(phurple_reconnects.accounts, account);
+	if (!rc) {
+		rc = g_new0(struct phurple_reconnect, 1);
+		rc->account = account;
+		g_hash_table_insert(phurple_reconnects.accounts, account, rc);
+	}
+
+	rc->error = (long)err;
+	rc->attempt++;
+
+	attempts = phurple_reconnect_option(account, "reconnect_attempts", PHURPLE_RECONNECT_ATTEMPTS);
+
+	/* retrying a wrong password or a kicked session would only make it worse */
+	if ((purple_connection_error_is_fatal(err) && !phurple_reconnect_option(account, "reconnect_fatal", 0))
+		|| (attempts > 0 && rc->attempt > attempts)) {
+		long attempt = rc->attempt - 1;
+
+		g_hash_table_remove(phurple_reconnects.accounts, account);
+		phurple_reconnect_emit(account, PHURPLE_RECONNECT_GAVE_UP, attempt, 0, (long)err);
+		return;
+	}
+
+	if (rc->timer) {
+		purple_timeout_remove(rc->timer);
+	}
+
+	delay = phurple_reconnect_delay(account, rc->attempt);
+	rc->timer = purple_timeout_add(delay, phurple_reconnect_fire, account);
+
+	phurple_reconnect_emit(account, PHURPLE_RECONNECT_SCHEDULED, rc->attempt, (long)delay, (long)err);
+}/*}}}*/
+
+static void
+phurple_reconnect_signed_on(PurpleConnection *conn)
+{/*{{{*/
+	g_hash_table_remove(phurple_reconnects.accounts, purple_connection_get_account(conn));
+}/*}}}*/
+
+/* Start watching the connection errors, done by Client::connect() */
+void
+phurple_reconnect_init(const char *ui_id)
+{/*{{{*/
+	if (phurple_reconnects.accounts) {
+		return;
+	}
+
+	phurple_reconnects.accounts = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, phurple_reconnect_free);
+	phurple_reconnects.ui_id = g_strdup(ui_id);
+
+	purple_signal_connect(purple_connections_get_handle(), "connection-error", &phurple_reconnects,
+						  PURPLE_CALLBACK(phurple_reconnect_connection_error), NULL);
+	purple_signal_connect(purple_connections_get_handle(), "signed-on", &phurple_reconnects,
+						  PURPLE_CALLBACK(phurple_reconnect_signed_on), NULL);
+}/*}}}*/
+
+void
+phurple_reconnect_set_limit(long per_minute)
+{/*{{{*/
+	phurple_reconnects.per_minute = per_minute > 0 ? per_minute : 0;
+}/*}}}*/
+
+/* An account is disabled or destroyed */
+void
+phurple_reconnect_forget(PurpleAccount *account)
+{/*{{{*/
+	if (phurple_reconnects.accounts) {
+		g_hash_table_remove(phurple_reconnects.accounts, account);
+	}
+}/*}}}*/
+
+void
+phurple_reconnect_clear(void)
+{/*{{{*/
+	if (!phurple_reconnects.accounts) {
+		return;
+	}
+
+	purple_signals_disconnect_by_handle(&phurple_reconnects);
+
+	g_hash_table_destroy(phurple_reconnects.accounts);
+	phurple_reconnects.accounts = NULL;
+
+	g_free(phurple_reconnects.ui_id);
+	phurple_reconnects.ui_id = NULL;
+
+	phurple_reconnects.per_minute = 0;
+	phurple_reconnects.window_start = 0;
+	phurple_reconnects.window_count = 0;
+}/*}}}*/
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
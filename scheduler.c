@@ -0,0 +1,493 @@
+/**
+ * Copyright (c) 2007-2014, Anatol Belski <ab@php.net>
+ *
+ * This file is part of Phurple.
+ *
+ * Phurple is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Phurple is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Phurple.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <php.h>
+
+#include "php_phurple.h"
+
+#include <glib.h>
+
+#include <string.h>
+
+#include <purple.h>
+
+/* A connect that neither signed on nor failed by then gives its slot up,
+	the connection itself goes on */
+#define PHURPLE_CONNQ_TIMEOUT_MS 60000
+
+/* An account waiting for or holding a connect slot */
+struct phurple_connq_entry {
+	PurpleAccount *account;
+	char *host;
+	char *ui_id;
+	zend_bool startup;	/* enabled in accounts.xml, only its status is to be activated */
+	guint delay;		/* holds a slot, started after the jitter */
+	guint timeout;
+};
+
+static struct {
+	GQueue *pending;		/* struct phurple_connq_entry * in the enable order */
+	GHashTable *inflight;	/* PurpleAccount * => struct phurple_connq_entry * */
+	GHashTable *hosts;		/* host => connects in flight */
+	long max;				/* 0 means the scheduler is off */
+	long per_host;			/* 0 means unlimited */
+	long jitter;			/* ms */
+	long total;
+	long connected;
+	long failed;
+	long cancelled;
+	guint timer;
+	PurpleSavedStatus *startup;	/* activated by the first loop run */
+} phurple_connq = {NULL, NULL, NULL, 0, 0, 0, 0, 0, 0, 0, 0, NULL};
+
+static void
+phurple_connq_schedule(void);
+
+static void
+phurple_connq_entry_free(struct phurple_connq_entry *entry)
+{/*{{{*/
+	if (entry->delay) {
+		purple_timeout_remove(entry->delay);
+	}
+	if (entry->timeout) {
+		purple_timeout_remove(entry->timeout);
+	}
+	g_free(entry->host);
+	g_free(entry->ui_id);
+	g_free(entry);
+}/*}}}*/
+
+/* The server setting, the domain of the user name or the protocol, what
+	a server side connect limit most likely applies to */
+static char *
+phurple_connq_host(PurpleAccount *account)
+{/*{{{*/
+	const char *server = purple_account_get_string(account, "server", NULL);
+	const char *at;
+
+	if (server && *server) {
+		return g_ascii_strdown(server, -1);
+	}
+
+	at = strchr(purple_account_get_username(account), '@');
+	if (at && at[1]) {
+		char *host = g_strndup(at + 1, strcspn(at + 1, "/"));
+		char *lc = g_ascii_strdown(host, -1);
+
+		g_free(host);
+
+		return lc;
+	}
+
+	return g_strdup(purple_account_get_protocol_id(account));
+}/*}}}*/
+
+static long
+phurple_connq_host_count(const char *host)
+{/*{{{*/
+	return GPOINTER_TO_INT(g_hash_table_lookup(phurple_connq.hosts, host));
+}/*}}}*/
+
+static void
+phurple_connq_host_add(const char *host, int delta)
+{/*{{{*/
+	long count = phurple_connq_host_count(host) + delta;
+
+	if (count > 0) {
+		g_hash_table_replace(phurple_connq.hosts, g_strdup(host), GINT_TO_POINTER(count));
+	} else {
+		g_hash_table_remove(phurple_connq.hosts, host);
+	}
+}/*}}}*/
+
+/* The first pending account a slot is free for */
+static GList *
+phurple_connq_eligible(void)
+{/*{{{*/
+	GList *l;
+
+	if (!phurple_connq.pending || (long)g_hash_table_size(phurple_connq.inflight) >= phurple_connq.max) {
+		return NULL;
+	}
+
+	for (l = phurple_connq.pending->head; l; l = l->next) {
+		struct phurple_connq_entry *entry = (struct phurple_connq_entry *)l->data;
+
+		if (!phurple_connq.per_host || phurple_connq_host_count(entry->host) < phurple_connq.per_host) {
+			return l;
+		}
+	}
+
+	return NULL;
+}/*}}}*/
+
+/* The connect of an account is over, free its slot and count it under
+	connected, failed or cancelled */
+static void
+phurple_connq_done(PurpleAccount *account, long *outcome)
+{/*{{{*/
+	struct phurple_connq_entry *entry;
+
+	if (!phurple_connq.inflight) {
+		return;
+	}
+
+	entry = (struct phurple_connq_entry *) g_hash_table_lookup(phurple_connq.inflight, account);
+	if (!entry) {
+		return;
+	}
+
+	g_hash_table_remove(phurple_connq.inflight, account);
+	phurple_connq_host_add(entry->host, -1);
+
+	(*outcome)++;
+
+	phurple_connq_entry_free(entry);
+
+	phurple_connq_schedule();
+}/*}}}*/
+
+static gboolean
+phurple_connq_timeout(gpointer data)
+{/*{{{*/
+	struct phurple_connq_entry *entry = (struct phurple_connq_entry *)data;
+
+	entry->timeout = 0;
+	phurple_connq_done(entry->account, &phurple_connq.failed);
+
+	return FALSE;
+}/*}}}*/
+
+/* Enable the account, which connects it with its current status */
+static void
+phurple_connq_enable(struct phurple_connq_entry *entry)
+{/*{{{*/
+	if (entry->startup) {
+		purple_savedstatus_activate_for_account(purple_savedstatus_get_current(), entry->account);
+	} else if (!purple_account_get_enabled(entry->account, entry->ui_id)) {
+		purple_account_set_enabled(entry->account, entry->ui_id, TRUE);
+	}
+}/*}}}*/
+
+static void
+phurple_connq_start(struct phurple_connq_entry *entry)
+{/*{{{*/
+	PurpleAccount *account = entry->account;
+
+	entry->timeout = purple_timeout_add(PHURPLE_CONNQ_TIMEOUT_MS, phurple_connq_timeout, entry);
+
+	/* the signals can come before the enabling returns */
+	phurple_connq_enable(entry);
+
+	if (g_hash_table_lookup(phurple_connq.inflight, account) != entry) {
+		return;
+	}
+
+	if (purple_account_is_connected(account)) {
+		phurple_connq_done(account, &phurple_connq.connected);
+	} else if (purple_account_is_disconnected(account)) {
+		purple_account_connect(account);
+
+		if (g_hash_table_lookup(phurple_connq.inflight, account) == entry
+			&& purple_account_is_disconnected(account)) {
+			phurple_connq_done(account, &phurple_connq.failed);
+		}
+	}
+}/*}}}*/
+
+static gboolean
+phurple_connq_delayed(gpointer data)
+{/*{{{*/
+	struct phurple_connq_entry *entry = (struct phurple_connq_entry *)data;
+
+	entry->delay = 0;
+	phurple_connq_start(entry);
+
+	return FALSE;
+}/*}}}*/
+
+/* Fill every free slot. With a jitter each connect gets its own random
+	delay, the slot is held meanwhile. */
+static gboolean
+phurple_connq_tick(gpointer data)
+{/*{{{*/
+	GList *l;
+
+	phurple_connq.timer = 0;
+
+	while ((l = phurple_connq_eligible())) {
+		struct phurple_connq_entry *entry = (struct phurple_connq_entry *)l->data;
+
+		g_queue_delete_link(phurple_connq.pending, l);
+		g_hash_table_insert(phurple_connq.inflight, entry->account, entry);
+		phurple_connq_host_add(entry->host, 1);
+
+		if (phurple_connq.jitter) {
+			entry->delay = purple_timeout_add((guint) g_random_int_range(0, phurple_connq.jitter + 1),
+											  phurple_connq_delayed, entry);
+		} else {
+			phurple_connq_start(entry);
+		}
+	}
+
+	return FALSE;
+}/*}}}*/
+
+/* The slots are filled from the loop, not from within the signal handlers */
+static void
+phurple_connq_schedule(void)
+{/*{{{*/
+	if (phurple_connq.timer || !phurple_connq_eligible()) {
+		return;
+	}
+
+	phurple_connq.timer = purple_timeout_add(0, phurple_connq_tick, NULL);
+}/*}}}*/
+
+static void
+phurple_connq_signed_on(PurpleConnection *conn)
+{/*{{{*/
+	phurple_connq_done(purple_connection_get_account(conn), &phurple_connq.connected);
+}/*}}}*/
+
+static void
+phurple_connq_signed_off(PurpleConnection *conn)
+{/*{{{*/
+	phurple_connq_done(purple_connection_get_account(conn), &phurple_connq.failed);
+}/*}}}*/
+
+static void
+phurple_connq_connection_error(PurpleConnection *conn, PurpleConnectionError err, const gchar *desc)
+{/*{{{*/
+	phurple_connq_done(purple_connection_get_account(conn), &phurple_connq.failed);
+}/*}}}*/
+
+static GList *
+phurple_connq_find_pending(PurpleAccount *account)
+{/*{{{*/
+	GList *l;
+
+	for (l = phurple_connq.pending ? phurple_connq.pending->head : NULL; l; l = l->next) {
+		if (((struct phurple_connq_entry *)l->data)->account == account) {
+			return l;
+		}
+	}
+
+	return NULL;
+}/*}}}*/
+
+static struct phurple_connq_entry *
+phurple_connq_add(PurpleAccount *account, const char *ui_id)
+{/*{{{*/
+	struct phurple_connq_entry *entry;
+
+	if (!phurple_connq.pending) {
+		phurple_connq.pending = g_queue_new();
+		phurple_connq.inflight = g_hash_table_new(g_direct_hash, g_direct_equal);
+		phurple_connq.hosts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+		purple_signal_connect(purple_connections_get_handle(), "signed-on", &phurple_connq,
+							  PURPLE_CALLBACK(phurple_connq_signed_on), NULL);
+		purple_signal_connect(purple_connections_get_handle(), "signed-off", &phurple_connq,
+							  PURPLE_CALLBACK(phurple_connq_signed_off), NULL);
+		purple_signal_connect(purple_connections_get_handle(), "connection-error", &phurple_connq,
+							  PURPLE_CALLBACK(phurple_connq_connection_error), NULL);
+	}
+
+	if (g_hash_table_lookup(phurple_connq.inflight, account) || phurple_connq_find_pending(account)) {
+		return NULL;
+	}
+
+	entry = g_new0(struct phurple_connq_entry, 1);
+	entry->account = account;
+	entry->host = phurple_connq_host(account);
+	entry->ui_id = g_strdup(ui_id);
+
+	g_queue_push_tail(phurple_connq.pending, entry);
+	phurple_connq.total++;
+
+	phurple_connq_schedule();
+
+	return entry;
+}/*}}}*/
+
+/* Queue the enabling of an account. Returns 0 if the scheduler is off and
+	the caller has to enable it itself. */
+int
+phurple_connq_push(PurpleAccount *account, const char *ui_id)
+{/*{{{*/
+	if (phurple_connq.max <= 0) {
+		return 0;
+	}
+
+	phurple_connq_add(account, ui_id);
+
+	return 1;
+}/*}}}*/
+
+/* The saved status isn't activated before the loop runs, so the accounts
+	enabled in accounts.xml connect under the limits set meanwhile */
+void
+phurple_connq_defer_startup(PurpleSavedStatus *status)
+{/*{{{*/
+	phurple_connq.startup = status;
+}/*}}}*/
+
+void
+phurple_connq_startup(const char *ui_id)
+{/*{{{*/
+	PurpleSavedStatus *status = phurple_connq.startup;
+	GList *accounts, *l;
+
+	if (!status) {
+		return;
+	}
+	phurple_connq.startup = NULL;
+
+	if (phurple_connq.max <= 0) {
+		purple_savedstatus_activate(status);
+		return;
+	}
+
+	/* make it the current status without activating it for the accounts,
+		that's done one by one when they get a slot */
+	purple_prefs_set_int("/purple/savedstatus/default", purple_savedstatus_get_creation_time(status));
+
+	accounts = purple_accounts_get_all_active();
+	for (l = accounts; l; l = l->next) {
+		struct phurple_connq_entry *entry = phurple_connq_add((PurpleAccount *)l->data, ui_id);
+
+		if (entry) {
+			entry->startup = 1;
+		}
+	}
+	g_list_free(accounts);
+}/*}}}*/
+
+/* An account is disabled or destroyed */
+void
+phurple_connq_forget(PurpleAccount *account)
+{/*{{{*/
+	GList *l = phurple_connq_find_pending(account);
+
+	if (l) {
+		phurple_connq_entry_free((struct phurple_connq_entry *)l->data);
+		g_queue_delete_link(phurple_connq.pending, l);
+		phurple_connq.cancelled++;
+		return;
+	}
+
+	phurple_connq_done(account, &phurple_connq.cancelled);
+}/*}}}*/
+
+/* Limit the connects in flight, max <= 0 switches the scheduler off and
+	enables the pending accounts right away */
+void
+phurple_connq_set_limits(long max, long per_host, long jitter)
+{/*{{{*/
+	phurple_connq.max = max > 0 ? max : 0;
+	phurple_connq.per_host = per_host > 0 ? per_host : 0;
+	phurple_connq.jitter = jitter > 0 ? jitter : 0;
+
+	if (!phurple_connq.pending) {
+		return;
+	}
+
+	if (!phurple_connq.max) {
+		struct phurple_connq_entry *entry;
+
+		if (phurple_connq.timer) {
+			purple_timeout_remove(phurple_connq.timer);
+			phurple_connq.timer = 0;
+		}
+
+		while ((entry = (struct phurple_connq_entry *) g_queue_pop_head(phurple_connq.pending))) {
+			phurple_connq_enable(entry);
+			phurple_connq_entry_free(entry);
+		}
+
+		return;
+	}
+
+	phurple_connq_schedule();
+}/*}}}*/
+
+/* total, pending, connecting, connected, failed, cancelled */
+void
+phurple_connq_progress(long *progress)
+{/*{{{*/
+	progress[0] = phurple_connq.total;
+	progress[1] = phurple_connq.pending ? (long)g_queue_get_length(phurple_connq.pending) : 0;
+	progress[2] = phurple_connq.inflight ? (long)g_hash_table_size(phurple_connq.inflight) : 0;
+	progress[3] = phurple_connq.connected;
+	progress[4] = phurple_connq.failed;
+	progress[5] = phurple_connq.cancelled;
+}/*}}}*/
+
+static void
+phurple_connq_inflight_free(gpointer key, gpointer value, gpointer data)
+{/*{{{*/
+	phurple_connq_entry_free((struct phurple_connq_entry *)value);
+}/*}}}*/
+
+/* Drop the scheduler state, the pending accounts aren't connected */
+void
+phurple_connq_clear(void)
+{/*{{{*/
+	struct phurple_connq_entry *entry;
+
+	if (phurple_connq.timer) {
+		purple_timeout_remove(phurple_connq.timer);
+		phurple_connq.timer = 0;
+	}
+
+	if (phurple_connq.pending) {
+		purple_signals_disconnect_by_handle(&phurple_connq);
+
+		while ((entry = (struct phurple_connq_entry *) g_queue_pop_head(phurple_connq.pending))) {
+			phurple_connq_entry_free(entry);
+		}
+		g_queue_free(phurple_connq.pending);
+		phurple_connq.pending = NULL;
+
+		g_hash_table_foreach(phurple_connq.inflight, phurple_connq_inflight_free, NULL);
+		g_hash_table_destroy(phurple_connq.inflight);
+		phurple_connq.inflight = NULL;
+
+		g_hash_table_destroy(phurple_connq.hosts);
+		phurple_connq.hosts = NULL;
+	}
+
+	phurple_connq.max = phurple_connq.per_host = phurple_connq.jitter = 0;
+	phurple_connq.total = phurple_connq.connected = phurple_connq.failed = phurple_connq.cancelled = 0;
+	phurple_connq.startup = NULL;
+}/*}}}*/
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
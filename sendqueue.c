@@ -0,0 +1,681 @@
+/**
+ * Copyright (c) 2007-2014, Anatol Belski <ab@php.net>
+ *
+ * This file is part of Phurple.
+ *
+ * Phurple is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Phurple is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Phurple.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <php.h>
+
+#include "php_phurple.h"
+
+#include <glib.h>
+
+#include <string.h>
+
+#include <purple.h>
+
+extern zval *
+php_create_account_obj_zval(PurpleAccount *paccount TSRMLS_DC);
+
+extern zval*
+phurple_call_hook(enum phurple_hook hook, zval **retval_ptr_ptr, int param_count, ...);
+
+extern zend_bool
+phurple_hook_delivered(enum phurple_hook hook TSRMLS_DC);
+
+extern zval*
+phurple_long_zval(long l);
+
+extern zval*
+phurple_string_zval(const char *s);
+
+/* Poll interval while the account of a non empty queue is offline */
+#define PHURPLE_SENDQ_OFFLINE_MS 1000
+
+/* A message waiting for tokens. The conversation is reset by
+	phurple_sendq_forget_conv() if it's closed meanwhile. */
+struct phurple_send_msg {
+	PurpleConversation *conv;
+	PurpleConversationType type;
+	char *name;
+	char *message;
+	int len;
+	struct phurple_send_msg *next;
+};
+
+struct phurple_send_limit {
+	double messages;	/* per second, 0 means unlimited */
+	long bytes;			/* per second, 0 means unlimited */
+	long burst;
+};
+
+/* The token buckets and the FIFO of an account */
+struct phurple_send_queue {
+	PurpleAccount *account;
+	struct phurple_send_limit limit;
+	zend_bool own_limit;	/* set for the account, not the default */
+	double tokens;
+	double byte_tokens;
+	gint64 stamp;
+	struct phurple_send_msg *head;
+	struct phurple_send_msg *tail;
+	long length;
+};
+
+static struct {
+	GHashTable *queues;		/* PurpleAccount * => struct phurple_send_queue * */
+	struct phurple_send_limit def;
+	long size;				/* per account, 0 means unbounded */
+	int policy;
+	guint timer;
+	zend_bool draining;
+	GHashTable *bulk_convs;	/* normalized recipient => conversation, see phurple_send_bulk() */
+} phurple_sendq = {NULL, {0, 0, 1}, 0, PHURPLE_QUEUE_DROP_NEWEST, 0, 0, NULL};
+
+static void
+phurple_send_msg_free(struct phurple_send_msg *msg)
+{/*{{{*/
+	g_free(msg->name);
+	g_free(msg->message);
+	g_free(msg);
+}/*}}}*/
+
+static long
+phurple_send_queue_discard(struct phurple_send_queue *q)
+{/*{{{*/
+	long count = q->length;
+
+	while (q->head) {
+		struct phurple_send_msg *msg = q->head;
+
+		q->head = msg->next;
+		phurple_send_msg_free(msg);
+	}
+
+	q->tail = NULL;
+	q->length = 0;
+
+	return count;
+}/*}}}*/
+
+static void
+phurple_send_queue_free(gpointer data)
+{/*{{{*/
+	struct phurple_send_queue *q = (struct phurple_send_queue *)data;
+
+	phurple_send_queue_discard(q);
+	g_free(q);
+}/*}}}*/
+
+static struct phurple_send_queue *
+phurple_send_queue_get(PurpleAccount *account, zend_bool create)
+{/*{{{*/
+	struct phurple_send_queue *q = NULL;
+
+	if (phurple_sendq.queues) {
+		q = (struct phurple_send_queue *) g_hash_table_lookup(phurple_sendq.queues, account);
+	}
+
+	if (!q && create) {
+		if (!phurple_sendq.queues) {
+			phurple_sendq.queues = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, phurple_send_queue_free);
+		}
+
+		q = g_new0(struct phurple_send_queue, 1);
+		q->account = account;
+		q->limit = phurple_sendq.def;
+		q->tokens = (double)q->limit.burst;
+		q->byte_tokens = (double)q->limit.bytes;
+		q->stamp = g_get_monotonic_time();
+
+		g_hash_table_insert(phurple_sendq.queues, account, q);
+	}
+
+	return q;
+}/*}}}*/
+
+/* Top the buckets up for the time passed. The byte bucket holds a second
+	worth of bytes. */
+static void
+phurple_send_queue_refill(struct phurple_send_queue *q)
+{/*{{{*/
+	gint64 now = g_get_monotonic_time();
+	double elapsed = (now - q->stamp) / 1000000.0;
+
+	q->stamp = now;
+
+	q->tokens += elapsed * q->limit.messages;
+	if (q->tokens > q->limit.burst) {
+		q->tokens = (double)q->limit.burst;
+	}
+
+	if (q->limit.bytes) {
+		q->byte_tokens += elapsed * q->limit.bytes;
+		if (q->byte_tokens > q->limit.bytes) {
+			q->byte_tokens = (double)q->limit.bytes;
+		}
+	}
+}/*}}}*/
+
+/* Milliseconds until the head of the queue may go, 0 if it may go now.
+	A message longer than the byte bucket goes once the bucket is full and
+	leaves it in debt. */
+static guint
+phurple_send_queue_wait(struct phurple_send_queue *q)
+{/*{{{*/
+	double wait = 0, need;
+
+	if (!q->head || q->limit.messages <= 0) {
+		return 0;
+	}
+
+	if (q->tokens < 1) {
+		wait = (1 - q->tokens) / q->limit.messages;
+	}
+
+	if (q->limit.bytes) {
+		need = MIN(q->head->len, q->limit.bytes) - q->byte_tokens;
+		if (need > 0 && need / q->limit.bytes > wait) {
+			wait = need / q->limit.bytes;
+		}
+	}
+
+	return wait > 0 ? (guint)(wait * 1000) + 1 : 0;
+}/*}}}*/
+
+static void
+phurple_send_completed(PurpleAccount *account, const char *name, const char *message, long status TSRMLS_DC)
+{/*{{{*/
+	zval *acc, *who, *msg, *st;
+
+	if (!phurple_hook_delivered(PHURPLE_HOOK_SEND_COMPLETED TSRMLS_CC)) {
+		return;
+	}
+
+	acc = php_create_account_obj_zval(account TSRMLS_CC);
+	who = phurple_string_zval(name);
+	msg = phurple_string_zval(message);
+	st = phurple_long_zval(status);
+
+	phurple_call_hook(PHURPLE_HOOK_SEND_COMPLETED, NULL, 4, &acc, &who, &msg, &st);
+
+	zval_ptr_dtor(&acc);
+	zval_ptr_dtor(&who);
+	zval_ptr_dtor(&msg);
+	zval_ptr_dtor(&st);
+}/*}}}*/
+
+static void
+phurple_send_msg_deliver(PurpleAccount *account, struct phurple_send_msg *msg TSRMLS_DC)
+{/*{{{*/
+	PurpleConversation *conv = msg->conv;
+	long status = PHURPLE_SEND_SENT;
+
+	if (!conv) {
+		status = PHURPLE_SEND_FAILED;
+	} else if (PURPLE_CONV_TYPE_IM == msg->type) {
+		purple_conv_im_send(PURPLE_CONV_IM(conv), msg->message);
+	} else {
+		purple_conv_chat_send(PURPLE_CONV_CHAT(conv), msg->message);
+	}
+
+	phurple_send_completed(account, msg->name, msg->message, status TSRMLS_CC);
+	phurple_send_msg_free(msg);
+}/*}}}*/
+
+/* Send what the buckets of an account allow. The queue is looked up for
+	every message, a callback could have deleted the account. */
+static void
+phurple_send_queue_drain(PurpleAccount *account TSRMLS_DC)
+{/*{{{*/
+	struct phurple_send_queue *q;
+
+	while ((q = phurple_send_queue_get(account, 0)) && q->head) {
+		struct phurple_send_msg *msg;
+
+		if (!purple_account_is_connected(account)) {
+			break;
+		}
+
+		if (q->limit.messages > 0) {
+			phurple_send_queue_refill(q);
+			if (phurple_send_queue_wait(q)) {
+				break;
+			}
+			q->tokens -= 1;
+			if (q->limit.bytes) {
+				q->byte_tokens -= q->head->len;
+			}
+		}
+
+		msg = q->head;
+		q->head = msg->next;
+		if (!q->head) {
+			q->tail = NULL;
+		}
+		q->length--;
+
+		phurple_send_msg_deliver(account, msg TSRMLS_CC);
+	}
+}/*}}}*/
+
+static gboolean
+phurple_sendq_tick(gpointer data);
+
+/* Arm the timer for the queue which is due first */
+static void
+phurple_sendq_schedule(void)
+{/*{{{*/
+	GHashTableIter iter;
+	gpointer value;
+	guint wait = G_MAXUINT;
+
+	if (phurple_sendq.timer) {
+		purple_timeout_remove(phurple_sendq.timer);
+		phurple_sendq.timer = 0;
+	}
+
+	if (!phurple_sendq.queues) {
+		return;
+	}
+
+	g_hash_table_iter_init(&iter, phurple_sendq.queues);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		struct phurple_send_queue *q = (struct phurple_send_queue *)value;
+		guint w;
+
+		if (!q->head) {
+			continue;
+		}
+
+		if (!purple_account_is_connected(q->account)) {
+			w = PHURPLE_SENDQ_OFFLINE_MS;
+		} else {
+			phurple_send_queue_refill(q);
+			w = phurple_send_queue_wait(q);
+		}
+
+		if (w < wait) {
+			wait = w;
+		}
+	}
+
+	if (G_MAXUINT != wait) {
+		phurple_sendq.timer = purple_timeout_add(wait, phurple_sendq_tick, NULL);
+	}
+}/*}}}*/
+
+/* Drain every queue, then schedule the next round */
+static void
+phurple_sendq_run(TSRMLS_D)
+{/*{{{*/
+	GList *accounts, *l;
+
+	if (phurple_sendq.draining || !phurple_sendq.queues) {
+		return;
+	}
+
+	phurple_sendq.draining = 1;
+
+	/* the callbacks may add or remove queues */
+	accounts = g_hash_table_get_keys(phurple_sendq.queues);
+	for (l = accounts; l; l = l->next) {
+		phurple_send_queue_drain((PurpleAccount *)l->data TSRMLS_CC);
+	}
+	g_list_free(accounts);
+
+	phurple_sendq.draining = 0;
+
+	phurple_sendq_schedule();
+}/*}}}*/
+
+static gboolean
+phurple_sendq_tick(gpointer data)
+{/*{{{*/
+	TSRMLS_FETCH();
+
+	phurple_sendq.timer = 0;
+	phurple_sendq_run(TSRMLS_C);
+
+	return FALSE;
+}/*}}}*/
+
+static zend_bool
+phurple_send_limited(PurpleAccount *account)
+{/*{{{*/
+	struct phurple_send_queue *q = phurple_send_queue_get(account, 0);
+
+	return q ? q->limit.messages > 0 : phurple_sendq.def.messages > 0;
+}/*}}}*/
+
+/* Append a message to the queue of a rate limited account */
+static int
+phurple_sendq_enqueue(PurpleConversation *conv, const char *message, int message_len TSRMLS_DC)
+{/*{{{*/
+	PurpleAccount *account = purple_conversation_get_account(conv);
+	struct phurple_send_queue *q = phurple_send_queue_get(account, 1);
+	struct phurple_send_msg *msg;
+
+	if (phurple_sendq.size > 0 && q->length >= phurple_sendq.size) {
+		if (PHURPLE_QUEUE_DROP_NEWEST == phurple_sendq.policy) {
+			return 0;
+		}
+
+		msg = q->head;
+		q->head = msg->next;
+		if (!q->head) {
+			q->tail = NULL;
+		}
+		q->length--;
+
+		phurple_send_completed(account, msg->name, msg->message, PHURPLE_SEND_DROPPED TSRMLS_CC);
+		phurple_send_msg_free(msg);
+
+		/* the callback could have deleted the account */
+		q = phurple_send_queue_get(account, 0);
+		if (!q) {
+			return 0;
+		}
+	}
+
+	msg = g_new0(struct phurple_send_msg, 1);
+	msg->conv = conv;
+	msg->type = purple_conversation_get_type(conv);
+	msg->name = g_strdup(purple_conversation_get_name(conv));
+	msg->message = g_strndup(message, message_len);
+	msg->len = message_len;
+
+	if (q->tail) {
+		q->tail->next = msg;
+	} else {
+		q->head = msg;
+	}
+	q->tail = msg;
+	q->length++;
+
+	/* a message in a burst goes out right away, others once the timer fires */
+	if (1 == q->length) {
+		phurple_sendq_run(TSRMLS_C);
+	}
+
+	return 1;
+}/*}}}*/
+
+/* Queue a message of the conversation when its account is rate limited.
+	Returns PHURPLE_SEND_DIRECT when there's no limit and the caller has to
+	send it itself, otherwise whether the message was accepted. */
+int
+phurple_sendq_push(PurpleConversation *conv, const char *message, int message_len TSRMLS_DC)
+{/*{{{*/
+	PurpleAccount *account = purple_conversation_get_account(conv);
+
+	if (!account || !phurple_send_limited(account)) {
+		return PHURPLE_SEND_DIRECT;
+	}
+
+	return phurple_sendq_enqueue(conv, message, message_len TSRMLS_CC);
+}/*}}}*/
+
+/* Start a bulk send, the conversations are resolved once per recipient
+	until phurple_send_bulk_end(). Returns the cache of an outer bulk send,
+	a callback could start one. */
+GHashTable *
+phurple_send_bulk_begin(void)
+{/*{{{*/
+	GHashTable *prev = phurple_sendq.bulk_convs;
+
+	phurple_sendq.bulk_convs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+	return prev;
+}/*}}}*/
+
+void
+phurple_send_bulk_end(GHashTable *prev)
+{/*{{{*/
+	g_hash_table_destroy(phurple_sendq.bulk_convs);
+	phurple_sendq.bulk_convs = prev;
+}/*}}}*/
+
+/* Find the conversation with a recipient, an IM is opened if there's none.
+	Chats have to be joined before. */
+static PurpleConversation *
+phurple_send_bulk_conv(PurpleAccount *account, PurpleConversationType type, const char *name)
+{/*{{{*/
+	PurpleConversation *conv;
+	char *key;
+
+	key = g_strdup_printf("%p:%d:%s", (void *)account, (int)type, purple_normalize(account, name));
+
+	conv = (PurpleConversation *) g_hash_table_lookup(phurple_sendq.bulk_convs, key);
+	if (conv) {
+		g_free(key);
+		return conv;
+	}
+
+	conv = purple_find_conversation_with_account(type, name, account);
+	if (!conv && PURPLE_CONV_TYPE_IM == type) {
+		conv = purple_conversation_new(PURPLE_CONV_TYPE_IM, account, name);
+	}
+
+	if (conv) {
+		g_hash_table_insert(phurple_sendq.bulk_convs, key, conv);
+	} else {
+		g_free(key);
+	}
+
+	return conv;
+}/*}}}*/
+
+/* Send or queue a message of a bulk send, returns whether it was accepted */
+int
+phurple_send_bulk(PurpleAccount *account, PurpleConversationType type, const char *name,
+				  const char *message, int message_len TSRMLS_DC)
+{/*{{{*/
+	PurpleConversation *conv;
+
+	if (!message_len || !name) {
+		return 0;
+	}
+
+	conv = phurple_send_bulk_conv(account, type, name);
+	if (!conv) {
+		return 0;
+	}
+
+	if (phurple_send_limited(account)) {
+		return phurple_sendq_enqueue(conv, message, message_len TSRMLS_CC);
+	}
+
+	if (PURPLE_CONV_TYPE_IM == type) {
+		purple_conv_im_send(PURPLE_CONV_IM(conv), message);
+	} else {
+		purple_conv_chat_send(PURPLE_CONV_CHAT(conv), message);
+	}
+
+	return 1;
+}/*}}}*/
+
+static gboolean
+phurple_send_bulk_conv_is(gpointer key, gpointer value, gpointer conv)
+{/*{{{*/
+	return value == conv;
+}/*}}}*/
+
+/* A conversation is being deleted, a callback of a bulk send could close
+	one. Its queued messages fail when their turn comes. */
+void
+phurple_sendq_forget_conv(PurpleConversation *conv)
+{/*{{{*/
+	struct phurple_send_queue *q;
+	struct phurple_send_msg *msg;
+
+	if (phurple_sendq.bulk_convs) {
+		g_hash_table_foreach_remove(phurple_sendq.bulk_convs, phurple_send_bulk_conv_is, conv);
+	}
+
+	q = phurple_send_queue_get(purple_conversation_get_account(conv), 0);
+	if (!q) {
+		return;
+	}
+
+	for (msg = q->head; msg; msg = msg->next) {
+		if (msg->conv == conv) {
+			msg->conv = NULL;
+		}
+	}
+}/*}}}*/
+
+/* Set the limit of an account, or the default one without an account.
+	Messages per second <= 0 removes the limit, the queued messages are
+	sent then. */
+void
+phurple_sendq_set_limit(PurpleAccount *account, double messages, long bytes, long burst TSRMLS_DC)
+{/*{{{*/
+	struct phurple_send_limit limit;
+
+	limit.messages = messages > 0 ? messages : 0;
+	limit.bytes = bytes > 0 ? bytes : 0;
+	limit.burst = burst > 0 ? burst : 1;
+
+	if (account) {
+		struct phurple_send_queue *q = phurple_send_queue_get(account, limit.messages > 0);
+
+		if (q) {
+			q->own_limit = limit.messages > 0;
+			q->limit = q->own_limit ? limit : phurple_sendq.def;
+			q->tokens = MIN(q->tokens, (double)q->limit.burst);
+			q->byte_tokens = MIN(q->byte_tokens, (double)q->limit.bytes);
+		}
+	} else {
+		GHashTableIter iter;
+		gpointer value;
+
+		phurple_sendq.def = limit;
+
+		if (phurple_sendq.queues) {
+			g_hash_table_iter_init(&iter, phurple_sendq.queues);
+			while (g_hash_table_iter_next(&iter, NULL, &value)) {
+				struct phurple_send_queue *q = (struct phurple_send_queue *)value;
+
+				if (!q->own_limit) {
+					q->limit = limit;
+					q->tokens = MIN(q->tokens, (double)q->limit.burst);
+					q->byte_tokens = MIN(q->byte_tokens, (double)q->limit.bytes);
+				}
+			}
+		}
+	}
+
+	phurple_sendq_run(TSRMLS_C);
+}/*}}}*/
+
+void
+phurple_sendq_set_size(long size, int policy)
+{/*{{{*/
+	phurple_sendq.size = size > 0 ? size : 0;
+	phurple_sendq.policy = policy;
+}/*}}}*/
+
+/* Queued messages of an account, or of all the accounts */
+long
+phurple_sendq_length(PurpleAccount *account)
+{/*{{{*/
+	GHashTableIter iter;
+	gpointer value;
+	long length = 0;
+
+	if (account) {
+		struct phurple_send_queue *q = phurple_send_queue_get(account, 0);
+
+		return q ? q->length : 0;
+	}
+
+	if (phurple_sendq.queues) {
+		g_hash_table_iter_init(&iter, phurple_sendq.queues);
+		while (g_hash_table_iter_next(&iter, NULL, &value)) {
+			length += ((struct phurple_send_queue *)value)->length;
+		}
+	}
+
+	return length;
+}/*}}}*/
+
+/* Throw the queued messages away, returns their count */
+long
+phurple_sendq_discard(PurpleAccount *account)
+{/*{{{*/
+	GHashTableIter iter;
+	gpointer value;
+	long count = 0;
+
+	if (account) {
+		struct phurple_send_queue *q = phurple_send_queue_get(account, 0);
+
+		return q ? phurple_send_queue_discard(q) : 0;
+	}
+
+	if (phurple_sendq.queues) {
+		g_hash_table_iter_init(&iter, phurple_sendq.queues);
+		while (g_hash_table_iter_next(&iter, NULL, &value)) {
+			count += phurple_send_queue_discard((struct phurple_send_queue *)value);
+		}
+	}
+
+	return count;
+}/*}}}*/
+
+/* An account is being destroyed */
+void
+phurple_sendq_forget(PurpleAccount *account)
+{/*{{{*/
+	if (phurple_sendq.queues) {
+		g_hash_table_remove(phurple_sendq.queues, account);
+	}
+}/*}}}*/
+
+/* Drop the queues and the limits */
+void
+phurple_sendq_clear(void)
+{/*{{{*/
+	if (phurple_sendq.timer) {
+		purple_timeout_remove(phurple_sendq.timer);
+		phurple_sendq.timer = 0;
+	}
+
+	if (phurple_sendq.queues) {
+		g_hash_table_destroy(phurple_sendq.queues);
+		phurple_sendq.queues = NULL;
+	}
+
+	phurple_sendq.def.messages = 0;
+	phurple_sendq.def.bytes = 0;
+	phurple_sendq.def.burst = 1;
+	phurple_sendq.size = 0;
+	phurple_sendq.policy = PHURPLE_QUEUE_DROP_NEWEST;
+}/*}}}*/
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
@@ -0,0 +1,72 @@
+--TEST--
+Phurple\Client::registerCommand() and unregisterCommand() command trie
+--SKIPIF--
+<?php
+if (!extension_loaded("phurple")) print "skip";
+?>
+--FILE--
+<?php
+use Phurple\Client;
+
+class TestClient extends Client {}
+
+$dir = sys_get_temp_dir() . "/phurple-test-003";
+@mkdir($dir);
+Client::setUserDir($dir);
+Client::setUiId("TestUI");
+
+$client = TestClient::getInstance();
+
+$handler = function ($args, $sender, $conversation, $account) {};
+
+foreach (array("", "!two words", "!tab\tbed", "!nul\0byte") as $name) {
+	try {
+		$client->registerCommand($name, $handler);
+	} catch (Exception $e) {
+		echo $e->getMessage(), "\n";
+	}
+}
+
+/* the commands share the nodes of their common prefix */
+$client->registerCommand("!he", $handler);
+$client->registerCommand("!help", $handler);
+$client->registerCommand("!hello", $handler);
+
+/* an inner node without a handler, a path running off the trie */
+var_dump($client->unregisterCommand("!h"));
+var_dump($client->unregisterCommand("!hel"));
+var_dump($client->unregisterCommand("!helpme"));
+var_dump($client->unregisterCommand("?help"));
+
+/* removing a command leaves the longer ones through its node alone */
+var_dump($client->unregisterCommand("!help"));
+var_dump($client->unregisterCommand("!help"));
+var_dump($client->unregisterCommand("!hello"));
+var_dump($client->unregisterCommand("!he"));
+
+/* registering again replaces the handler */
+$client->registerCommand("!ping", $handler);
+$client->registerCommand("!ping", function ($args, $sender, $conversation, $account) {});
+var_dump($client->unregisterCommand("!ping"));
+var_dump($client->unregisterCommand("!ping"));
+
+/* a removed command can be registered again */
+$client->registerCommand("!he", $handler);
+var_dump($client->unregisterCommand("!he"));
+?>
+--EXPECT--
+Empty command name
+Command names can't contain whitespace
+Command names can't contain whitespace
+Command names can't contain whitespace
+bool(false)
+bool(false)
+bool(false)
+bool(false)
+bool(true)
+bool(false)
+bool(true)
+bool(true)
+bool(true)
+bool(false)
+bool(true)
@@ -0,0 +1,78 @@
+--TEST--
+Phurple\Client::addMessageFilter() rule validation and bookkeeping
+--SKIPIF--
+<?php
+if (!extension_loaded("phurple")) print "skip";
+?>
+--FILE--
+<?php
+use Phurple\Client;
+
+class TestClient extends Client {}
+
+$dir = sys_get_temp_dir() . "/phurple-test-004";
+@mkdir($dir);
+Client::setUserDir($dir);
+Client::setUiId("TestUI");
+
+$client = TestClient::getInstance();
+
+function add($client, $field, $match, $pattern, $scope = NULL)
+{
+	try {
+		if (NULL === $scope) {
+			return @$client->addMessageFilter($field, $match, $pattern);
+		}
+		return @$client->addMessageFilter($field, $match, $pattern, $scope);
+	} catch (Exception $e) {
+		echo $e->getMessage(), "\n";
+	}
+}
+
+add($client, 9, Client::MATCH_PREFIX, "!");
+add($client, Client::FILTER_MESSAGE, 7, "!");
+add($client, Client::FILTER_MESSAGE, Client::MATCH_PREFIX, "!", 0);
+add($client, Client::FILTER_MESSAGE, Client::MATCH_REGEX, "(unbalanced");
+var_dump($client->getFilteredCount());
+
+$ids = array(
+	add($client, Client::FILTER_MESSAGE, Client::MATCH_PREFIX, "!"),
+	add($client, Client::FILTER_SENDER, Client::MATCH_CONTAINS | Client::MATCH_NOCASE, "@example.com"),
+	add($client, Client::FILTER_CONVERSATION, Client::MATCH_REGEX, "^room-[0-9]+$", Client::CONV_TYPE_CHAT),
+	/* the flags pattern is converted to a mask */
+	add($client, Client::FILTER_FLAGS, Client::MATCH_PREFIX, "1"),
+);
+var_dump($ids);
+
+/* the ids aren't reused */
+var_dump($client->removeMessageFilter($ids[1]));
+var_dump($client->removeMessageFilter($ids[1]));
+var_dump(add($client, Client::FILTER_MESSAGE, Client::MATCH_PREFIX, "?"));
+var_dump($client->removeMessageFilter(0));
+
+$client->clearMessageFilters();
+var_dump($client->removeMessageFilter($ids[0]));
+var_dump($client->getFilteredCount());
+?>
+--EXPECT--
+Unknown filter field 9
+Unknown match type 7
+The scope must contain CONV_TYPE_IM or CONV_TYPE_CHAT
+Invalid filter pattern
+int(0)
+array(4) {
+  [0]=>
+  int(1)
+  [1]=>
+  int(2)
+  [2]=>
+  int(3)
+  [3]=>
+  int(4)
+}
+bool(true)
+bool(false)
+int(5)
+bool(false)
+bool(false)
+int(0)
@@ -0,0 +1,71 @@
+--TEST--
+Phurple\Client::setConnectLimits() validation and connect queue progress
+--SKIPIF--
+<?php
+if (!extension_loaded("phurple")) print "skip";
+?>
+--FILE--
+<?php
+use Phurple\Client;
+
+class TestClient extends Client {}
+
+$dir = sys_get_temp_dir() . "/phurple-test-005";
+@mkdir($dir);
+Client::setUserDir($dir);
+Client::setUiId("TestUI");
+
+$client = TestClient::getInstance();
+
+foreach (array(array(2, -1), array(2, 0, -100)) as $limits) {
+	try {
+		call_user_func_array(array($client, "setConnectLimits"), $limits);
+	} catch (Exception $e) {
+		echo $e->getMessage(), "\n";
+	}
+}
+
+function progress($client)
+{
+	echo implode(" ", $client->getConnectProgress()), "\n";
+}
+
+progress($client);
+
+/* the loop never runs, so the queued accounts wait for a slot */
+$client->setConnectLimits(2, 1, 500);
+$accounts = $client->addAccounts(array(
+	"prpl-jabber://conn1@example.com:secret",
+	"prpl-jabber://conn2@example.com:secret",
+	"prpl-jabber://conn3@example.com:secret",
+));
+progress($client);
+
+/* an account is queued once */
+$accounts[0]->setEnabled(true);
+progress($client);
+
+/* disabling or deleting a queued account cancels its connect */
+$accounts[0]->setEnabled(false);
+progress($client);
+$client->deleteAccount($accounts[1]);
+progress($client);
+
+/* a re-enabled account is queued again */
+$accounts[0]->setEnabled(true);
+progress($client);
+
+$client->deleteAccount($accounts[0]);
+$client->deleteAccount($accounts[2]);
+progress($client);
+?>
+--EXPECT--
+Negative per host limit -1
+Negative jitter -100
+0 0 0 0 0 0
+3 3 0 0 0 0
+3 3 0 0 0 0
+3 2 0 0 0 1
+3 1 0 0 0 2
+4 2 0 0 0 2
+4 0 0 0 0 4
@@ -0,0 +1,62 @@
+--TEST--
+Phurple\Client::setSendLimit() and setSendQueue() validation
+--SKIPIF--
+<?php
+if (!extension_loaded("phurple")) print "skip";
+?>
+--FILE--
+<?php
+use Phurple\Client;
+
+class TestClient extends Client {}
+
+$dir = sys_get_temp_dir() . "/phurple-test-006";
+@mkdir($dir);
+Client::setUserDir($dir);
+Client::setUiId("TestUI");
+
+$client = TestClient::getInstance();
+
+function attempt($callable, $args)
+{
+	try {
+		var_dump(call_user_func_array($callable, $args));
+	} catch (Exception $e) {
+		echo $e->getMessage(), "\n";
+	}
+}
+
+attempt(array($client, "setSendLimit"), array(2, -1));
+attempt(array($client, "setSendLimit"), array(2, 0, 0));
+attempt(array($client, "setSendQueue"), array(-1));
+attempt(array($client, "setSendQueue"), array(10, 7));
+attempt(array($client, "setSendQueue"), array(0, Client::QUEUE_DROP_OLDEST));
+
+/* keep the accounts offline, their connects wait for the loop */
+$client->setConnectLimits(1);
+$account = $client->addAccount("prpl-jabber://queue@example.com:secret");
+$gone = $client->addAccount("prpl-jabber://gone@example.com:secret");
+
+attempt(array($client, "setSendLimit"), array(2, 512, 4, $account));
+attempt(array($client, "getSendQueueLength"), array($account));
+attempt(array($client, "getSendQueueLength"), array());
+attempt(array($client, "clearSendQueue"), array($account));
+
+$client->deleteAccount($gone);
+attempt(array($client, "setSendLimit"), array(2, 0, 1, $gone));
+attempt(array($client, "getSendQueueLength"), array($gone));
+
+$client->deleteAccount($account);
+?>
+--EXPECT--
+Negative byte limit -1
+The burst must be at least 1, 0 given
+Negative queue size -1
+Unknown queue policy 7
+NULL
+NULL
+int(0)
+int(0)
+int(0)
+The account is gone
+The account is gone
@@ -0,0 +1,70 @@
+--TEST--
+Phurple\Client::broadcast() and Phurple\Conversation::sendMany() entry validation
+--SKIPIF--
+<?php
+if (!extension_loaded("phurple")) print "skip";
+?>
+--FILE--
+<?php
+use Phurple\Client;
+
+class TestClient extends Client {}
+
+$dir = sys_get_temp_dir() . "/phurple-test-007";
+@mkdir($dir);
+Client::setUserDir($dir);
+Client::setUiId("TestUI");
+
+$client = TestClient::getInstance();
+
+function attempt($callable, $args)
+{
+	try {
+		var_dump(call_user_func_array($callable, $args));
+	} catch (Exception $e) {
+		echo $e->getMessage(), "\n";
+	}
+}
+
+/* keep the accounts offline, their connects wait for the loop */
+$client->setConnectLimits(1);
+$account = $client->addAccount("prpl-jabber://bulk@example.com:secret");
+$gone = $client->addAccount("prpl-jabber://gone@example.com:secret");
+
+/* a bad entry anywhere fails the whole bulk send before anything is sent */
+attempt(array($client, "broadcast"), array($account, array("a@example.com", 42), "hi"));
+attempt(array($client, "broadcast"), array($account, array("a@example.com"), "hi", 99));
+attempt("Phurple\\Conversation::sendMany", array(array(
+	array($account, "a@example.com", "hi"),
+	array($account, "b@example.com"),
+)));
+attempt("Phurple\\Conversation::sendMany", array(array(
+	array($account, "a@example.com", "hi"),
+	"not an entry",
+)));
+attempt("Phurple\\Conversation::sendMany", array(array(
+	array($account, "a@example.com", "hi", 99),
+)));
+
+$client->deleteAccount($gone);
+attempt(array($client, "broadcast"), array($gone, array("a@example.com"), "hi"));
+attempt("Phurple\\Conversation::sendMany", array(array(
+	array($account, "a@example.com", "hi"),
+	array($gone, "b@example.com", "hi"),
+)));
+
+attempt("Phurple\\Conversation::sendMany", array(array()));
+attempt(array($client, "broadcast"), array($account, array(), "hi"));
+
+$client->deleteAccount($account);
+?>
+--EXPECT--
+Recipient 1 is not a string
+Unknown conversation type
+Entry 1 is not an (account, recipient, message) array
+Entry 1 is not an (account, recipient, message) array
+Entry 0 has an unknown conversation type
+The account is gone
+The account of entry 1 is gone
+int(0)
+int(0)
@@ -0,0 +1,50 @@
+--TEST--
+The accounts enabled in accounts.xml connect on the first iterate() call
+--SKIPIF--
+<?php
+if (!extension_loaded("phurple")) print "skip";
+?>
+--FILE--
+<?php
+use Phurple\Client;
+
+class TestClient extends Client {}
+
+$dir = sys_get_temp_dir() . "/phurple-test-008";
+@mkdir($dir);
+file_put_contents("$dir/accounts.xml", <<<XML
+<?xml version='1.0' encoding='UTF-8' ?>
+<account version='1.0'>
+ <account>
+  <protocol>prpl-jabber</protocol>
+  <name>boot@example.com</name>
+  <password>secret</password>
+  <settings ui='TestUI'>
+   <setting name='auto-login' type='bool'>1</setting>
+  </settings>
+ </account>
+</account>
+XML
+);
+Client::setUserDir($dir);
+Client::setUiId("TestUI");
+
+$client = TestClient::getInstance();
+
+$account = $client->findAccount("boot@example.com");
+var_dump($account->isConnecting());
+
+/* the saved status is activated on entry, no event is dispatched so no
+	network answer can change the state meanwhile */
+$client->iterate(0, 0);
+var_dump($account->isConnecting());
+
+$client->deleteAccount($account);
+?>
+--CLEAN--
+<?php
+@unlink(sys_get_temp_dir() . "/phurple-test-008/accounts.xml");
+?>
+--EXPECT--
+bool(false)
+bool(true)
@@ -0,0 +1,70 @@
+--TEST--
+Phurple\Client::on() and off() listener ordering
+--SKIPIF--
+<?php
+if (!extension_loaded("phurple")) print "skip";
+?>
+--FILE--
+<?php
+use Phurple\Client;
+
+class TestClient extends Client {}
+
+$dir = sys_get_temp_dir() . "/phurple-test-009";
+@mkdir($dir);
+Client::setUserDir($dir);
+Client::setUiId("TestUI");
+
+$client = TestClient::getInstance();
+$client->connect();
+
+try {
+	$client->on("noSuchCallback", function () {});
+} catch (Exception $e) {
+	echo $e->getMessage(), "\n";
+}
+
+function listener($tag)
+{
+	return function ($connection) use ($tag) {
+		echo $tag, "\n";
+	};
+}
+
+$a = listener("a");
+$b = listener("b");
+$c = listener("c");
+$d = listener("d");
+
+/* higher priorities first, the same priority in the order of on() calls */
+$client->on("onSigningOn", $a);
+$client->on("onSigningOn", $b, 10);
+$client->on("onSigningOn", $c);
+$client->on("onSigningOn", $d, -5);
+/* a listener detached by an earlier one isn't called anymore */
+$client->on("OnSigningOn", function ($connection) use ($client, $c) {
+	echo "e detaches c\n";
+	$client->off("onSigningOn", $c);
+}, 5);
+
+/* enabling the new account connects it, signing-on is emitted right away
+	and nothing has to come from the network */
+$account = $client->addAccount("prpl-jabber://listen@example.com:secret");
+
+var_dump($client->off("onSigningOn", $c));
+var_dump($client->off("onSigningOn", $a));
+var_dump($client->off("onSigningOn"));
+var_dump($client->off("onSigningOn"));
+
+$client->deleteAccount($account);
+?>
+--EXPECT--
+Unknown callback method 'noSuchCallback'
+b
+e detaches c
+a
+d
+int(0)
+int(1)
+int(3)
+int(0)
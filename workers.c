@@ -0,0 +1,747 @@
+/**
+ * Copyright (c) 2007-2014, Anatol Belski <ab@php.net>
+ *
+ * This file is part of Phurple.
+ *
+ * Phurple is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Phurple is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Phurple.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <php.h>
+#include <zend_exceptions.h>
+#include <ext/standard/php_var.h>
+#include <ext/standard/php_smart_str.h>
+
+#include "php_phurple.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <string.h>
+
+#ifndef PHP_WIN32
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#endif
+
+#include <purple.h>
+
+extern zval*
+phurple_call_hook(enum phurple_hook hook, zval **retval_ptr_ptr, int param_count, ...);
+
+extern zend_bool
+phurple_hook_delivered(enum phurple_hook hook TSRMLS_DC);
+
+extern GHashTable *
+phurple_send_bulk_begin(void);
+
+extern void
+phurple_send_bulk_end(GHashTable *prev);
+
+extern int
+phurple_send_bulk(PurpleAccount *account, PurpleConversationType type, const char *name,
+				  const char *message, int message_len TSRMLS_DC);
+
+/* A frame is a 4 byte length in network order, the type byte and
+	a serialized PHP value */
+#define PHURPLE_WORKER_HEADER 5
+#define PHURPLE_WORKER_READ_SIZE 65536
+
+/* The other end of a socketpair, a worker for the supervisor and the
+	supervisor for a worker */
+struct phurple_worker_peer {
+	int pid;
+	int fd;		/* -1 once the peer is gone, non blocking */
+	GString *in;
+	GString *out;	/* the frames the socket didn't take yet */
+};
+
+static struct {
+	int id;			/* -1 in the supervisor */
+	int count;
+	struct phurple_worker_peer *peers;
+	guint watch;	/* the supervisor socket in the worker's event loop */
+	guint out_watch;	/* while the worker has frames buffered */
+} phurple_workers = {-1, 0, NULL, 0, 0};
+
+int
+phurple_worker_id(void)
+{/*{{{*/
+	return phurple_workers.id;
+}/*}}}*/
+
+int
+phurple_worker_count(void)
+{/*{{{*/
+	return phurple_workers.count;
+}/*}}}*/
+
+/* The worker an account or any other key belongs to, the same in all
+	the processes */
+int
+phurple_worker_for(const char *key, int key_len)
+{/*{{{*/
+	if (!phurple_workers.count) {
+		return -1;
+	}
+
+	return (int)(zend_hash_func(key, key_len) % (ulong)phurple_workers.count);
+}/*}}}*/
+
+#ifndef PHP_WIN32
+
+#ifdef MSG_NOSIGNAL
+# define PHURPLE_WORKER_SEND_FLAGS MSG_NOSIGNAL
+#else
+# define PHURPLE_WORKER_SEND_FLAGS 0
+#endif
+
+/* Write out what the socket takes without blocking. Fails only if the
+	peer is gone, the read side notices that too. */
+static int
+phurple_worker_drain(struct phurple_worker_peer *peer)
+{/*{{{*/
+	while (peer->out->len) {
+		ssize_t w = send(peer->fd, peer->out->str, peer->out->len, PHURPLE_WORKER_SEND_FLAGS);
+
+		if (w < 0) {
+			if (EINTR == errno) {
+				continue;
+			}
+			return EAGAIN == errno || EWOULDBLOCK == errno ? SUCCESS : FAILURE;
+		}
+
+		g_string_erase(peer->out, 0, w);
+	}
+
+	return SUCCESS;
+}/*}}}*/
+
+static void
+phurple_worker_output(gpointer data, gint fd, PurpleInputCondition cond);
+
+/* In the worker the event loop drains the rest once the socket is writable */
+static void
+phurple_worker_watch_output(void)
+{/*{{{*/
+	struct phurple_worker_peer *peer = &phurple_workers.peers[0];
+
+	if (peer->fd < 0 || !peer->out->len) {
+		if (phurple_workers.out_watch) {
+			purple_input_remove(phurple_workers.out_watch);
+			phurple_workers.out_watch = 0;
+		}
+		return;
+	}
+
+	/* not attached to a client yet, phurple_worker_attach() comes back here */
+	if (phurple_workers.watch && !phurple_workers.out_watch) {
+		phurple_workers.out_watch = purple_input_add(peer->fd, PURPLE_INPUT_WRITE, phurple_worker_output, NULL);
+	}
+}/*}}}*/
+
+static void
+phurple_worker_output(gpointer data, gint fd, PurpleInputCondition cond)
+{/*{{{*/
+	phurple_worker_drain(&phurple_workers.peers[0]);
+	phurple_worker_watch_output();
+}/*}}}*/
+
+/* Queue a frame and write what can be written right now */
+static int
+phurple_worker_write(struct phurple_worker_peer *peer, char type, const char *data, size_t len)
+{/*{{{*/
+	char header[PHURPLE_WORKER_HEADER];
+	guint32 n = htonl((guint32)len);
+	int ret;
+
+	if (peer->fd < 0) {
+		return FAILURE;
+	}
+
+	memcpy(header, &n, 4);
+	header[4] = type;
+
+	g_string_append_len(peer->out, header, sizeof(header));
+	g_string_append_len(peer->out, data, len);
+
+	ret = phurple_worker_drain(peer);
+
+	if (phurple_workers.id >= 0) {
+		phurple_worker_watch_output();
+	}
+
+	return ret;
+}/*}}}*/
+
+static int
+phurple_worker_send(struct phurple_worker_peer *peer, char type, zval *value TSRMLS_DC)
+{/*{{{*/
+	smart_str buf = {0};
+	php_serialize_data_t var_hash;
+	int ret;
+
+	PHP_VAR_SERIALIZE_INIT(var_hash);
+	php_var_serialize(&buf, &value, &var_hash TSRMLS_CC);
+	PHP_VAR_SERIALIZE_DESTROY(var_hash);
+
+	ret = phurple_worker_write(peer, type, buf.c ? buf.c : "", buf.len);
+
+	smart_str_free(&buf);
+
+	return ret;
+}/*}}}*/
+
+static zval *
+phurple_worker_unserialize(const char *data, size_t len TSRMLS_DC)
+{/*{{{*/
+	php_unserialize_data_t var_hash;
+	const unsigned char *p = (const unsigned char *)data;
+	zval *value;
+
+	MAKE_STD_ZVAL(value);
+
+	PHP_VAR_UNSERIALIZE_INIT(var_hash);
+	if (!php_var_unserialize(&value, &p, p + len, &var_hash TSRMLS_CC)) {
+		zval_dtor(value);
+		ZVAL_NULL(value);
+	}
+	PHP_VAR_UNSERIALIZE_DESTROY(var_hash);
+
+	return value;
+}/*}}}*/
+
+/* Read what's there, returns 0 once the peer closed its end */
+static int
+phurple_worker_fill(struct phurple_worker_peer *peer)
+{/*{{{*/
+	char buf[PHURPLE_WORKER_READ_SIZE];
+	ssize_t r;
+
+	do {
+		r = read(peer->fd, buf, sizeof(buf));
+	} while (r < 0 && EINTR == errno);
+
+	if (r > 0) {
+		g_string_append_len(peer->in, buf, r);
+		return 1;
+	}
+
+	return r < 0 && (EAGAIN == errno || EWOULDBLOCK == errno);
+}/*}}}*/
+
+/* The next complete frame of the buffer, if any */
+static int
+phurple_worker_frame(struct phurple_worker_peer *peer, char *type, const char **data, size_t *len)
+{/*{{{*/
+	guint32 n;
+
+	if (peer->in->len < PHURPLE_WORKER_HEADER) {
+		return 0;
+	}
+
+	memcpy(&n, peer->in->str, 4);
+	n = ntohl(n);
+
+	if (peer->in->len < PHURPLE_WORKER_HEADER + n) {
+		return 0;
+	}
+
+	*type = peer->in->str[4];
+	*data = peer->in->str + PHURPLE_WORKER_HEADER;
+	*len = n;
+
+	return 1;
+}/*}}}*/
+
+static void
+phurple_worker_peer_close(struct phurple_worker_peer *peer)
+{/*{{{*/
+	if (peer->fd >= 0) {
+		close(peer->fd);
+		peer->fd = -1;
+	}
+	if (peer->in) {
+		g_string_free(peer->in, TRUE);
+		peer->in = NULL;
+	}
+	if (peer->out) {
+		g_string_free(peer->out, TRUE);
+		peer->out = NULL;
+	}
+}/*}}}*/
+
+/* Both ends are non blocking, the frames are buffered by the sender */
+static int
+phurple_worker_nonblock(int fd)
+{/*{{{*/
+	int flags = fcntl(fd, F_GETFL, 0);
+
+	return flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0 ? FAILURE : SUCCESS;
+}/*}}}*/
+
+static void
+phurple_worker_peer_init(struct phurple_worker_peer *peer, int pid, int fd)
+{/*{{{*/
+	peer->pid = pid;
+	peer->fd = fd;
+	peer->in = g_string_new(NULL);
+	peer->out = g_string_new(NULL);
+}/*}}}*/
+
+/* A sendViaWorker() command, handled without calling into PHP */
+static void
+phurple_worker_handle_send(zval *cmd TSRMLS_DC)
+{/*{{{*/
+	zval **account, **name, **message;
+	PurpleAccount *paccount;
+	GHashTable *prev;
+
+	if (IS_ARRAY != Z_TYPE_P(cmd)
+		|| zend_hash_index_find(Z_ARRVAL_P(cmd), 0, (void **) &account) == FAILURE
+		|| zend_hash_index_find(Z_ARRVAL_P(cmd), 1, (void **) &name) == FAILURE
+		|| zend_hash_index_find(Z_ARRVAL_P(cmd), 2, (void **) &message) == FAILURE
+		|| IS_STRING != Z_TYPE_PP(account) || IS_STRING != Z_TYPE_PP(name) || IS_STRING != Z_TYPE_PP(message)) {
+		return;
+	}
+
+	paccount = purple_accounts_find(Z_STRVAL_PP(account), NULL);
+	if (!paccount) {
+		return;
+	}
+
+	prev = phurple_send_bulk_begin();
+	phurple_send_bulk(paccount, PURPLE_CONV_TYPE_IM, Z_STRVAL_PP(name), Z_STRVAL_PP(message), Z_STRLEN_PP(message) TSRMLS_CC);
+	phurple_send_bulk_end(prev);
+}/*}}}*/
+
+/* The supervisor wrote to the worker, or went away */
+static void
+phurple_worker_input(gpointer data, gint fd, PurpleInputCondition cond)
+{/*{{{*/
+	struct phurple_worker_peer *peer = &phurple_workers.peers[0];
+	const char *frame;
+	size_t len;
+	char type;
+	TSRMLS_FETCH();
+
+	if (!phurple_worker_fill(peer)) {
+		purple_input_remove(phurple_workers.watch);
+		phurple_workers.watch = 0;
+		phurple_worker_peer_close(peer);
+		phurple_worker_watch_output();
+
+		/* nobody to work for anymore, runLoop() returns */
+		if (PHURPLE_G(phurple_client_obj)) {
+			struct ze_client_obj *zco = (struct ze_client_obj *) zend_object_store_get_object(PHURPLE_G(phurple_client_obj) TSRMLS_CC);
+
+			if (zco->loop) {
+				g_main_loop_quit(zco->loop);
+			}
+		}
+		return;
+	}
+
+	while (peer->in && phurple_worker_frame(peer, &type, &frame, &len)) {
+		zval *value = phurple_worker_unserialize(frame, len TSRMLS_CC);
+
+		g_string_erase(peer->in, 0, PHURPLE_WORKER_HEADER + len);
+
+		if (PHURPLE_WORKER_FRAME_SEND == type) {
+			phurple_worker_handle_send(value TSRMLS_CC);
+		} else if (phurple_hook_delivered(PHURPLE_HOOK_ON_SUPERVISOR_MESSAGE TSRMLS_CC)) {
+			phurple_call_hook(PHURPLE_HOOK_ON_SUPERVISOR_MESSAGE, NULL, 1, &value);
+		}
+
+		zval_ptr_dtor(&value);
+	}
+}/*}}}*/
+
+/* Give the worker process its own user dir and run the init callable,
+	the worker ends with it */
+static void
+phurple_worker_run(int id, const char *dir, zend_fcall_info *fci, zend_fcall_info_cache *fcc TSRMLS_DC)
+{/*{{{*/
+	zval *zid, *zcount, *retval = NULL;
+	zval **params[2];
+
+	zend_update_static_property_string(PhurpleClient_ce, "user_dir", strlen("user_dir"), (char *)dir TSRMLS_CC);
+	purple_util_set_user_dir(dir);
+
+	MAKE_STD_ZVAL(zid);
+	ZVAL_LONG(zid, id);
+	MAKE_STD_ZVAL(zcount);
+	ZVAL_LONG(zcount, phurple_workers.count);
+
+	params[0] = &zid;
+	params[1] = &zcount;
+
+	fci->retval_ptr_ptr = &retval;
+	fci->params = params;
+	fci->param_count = 2;
+	fci->no_separation = 1;
+
+	zend_call_function(fci, fcc TSRMLS_CC);
+
+	if (retval) {
+		zval_ptr_dtor(&retval);
+	}
+	zval_ptr_dtor(&zid);
+	zval_ptr_dtor(&zcount);
+
+	if (EG(exception)) {
+		zend_exception_error(EG(exception), E_WARNING TSRMLS_CC);
+		zend_clear_exception(TSRMLS_C);
+		EG(exit_status) = 255;
+	}
+
+	/* like exit(), the rest of the script is the supervisor's */
+	zend_bailout();
+}/*}}}*/
+
+/* Fork the workers, returns only in the supervisor */
+int
+phurple_workers_spawn(int count, const char *user_dir, zend_fcall_info *fci, zend_fcall_info_cache *fcc TSRMLS_DC)
+{/*{{{*/
+	char **dirs;
+	int i, j, ret = SUCCESS;
+
+	/* fail before anything is forked */
+	dirs = g_new0(char *, count + 1);
+	for (i = 0; i < count; i++) {
+		dirs[i] = g_strdup_printf("%s%sworker%d", user_dir, G_DIR_SEPARATOR_S, i);
+		if (g_mkdir_with_parents(dirs[i], 0700) < 0) {
+			zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "Couldn't create the worker directory '%s'", dirs[i]);
+			g_strfreev(dirs);
+			return FAILURE;
+		}
+	}
+
+	phurple_workers.peers = g_new0(struct phurple_worker_peer, count);
+	phurple_workers.count = count;
+
+	for (i = 0; i < count; i++) {
+		int sv[2];
+		pid_t pid;
+
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+			zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "Couldn't create a socket pair: %s", strerror(errno));
+			ret = FAILURE;
+			break;
+		}
+
+		if (FAILURE == phurple_worker_nonblock(sv[0]) || FAILURE == phurple_worker_nonblock(sv[1])) {
+			zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "Couldn't make the worker socket non blocking: %s", strerror(errno));
+			close(sv[0]);
+			close(sv[1]);
+			ret = FAILURE;
+			break;
+		}
+
+		/* nothing buffered may be written twice */
+		fflush(NULL);
+
+		pid = fork();
+		if (pid < 0) {
+			zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "Couldn't fork a worker: %s", strerror(errno));
+			close(sv[0]);
+			close(sv[1]);
+			ret = FAILURE;
+			break;
+		}
+
+		if (0 == pid) {
+			struct phurple_worker_peer *supervisor = g_new0(struct phurple_worker_peer, 1);
+
+			close(sv[0]);
+
+			/* the sockets of the other workers belong to the supervisor */
+			for (j = 0; j < i; j++) {
+				phurple_worker_peer_close(&phurple_workers.peers[j]);
+			}
+			g_free(phurple_workers.peers);
+
+			phurple_worker_peer_init(supervisor, (int)getppid(), sv[1]);
+
+			phurple_workers.peers = supervisor;
+			phurple_workers.id = i;
+
+			phurple_worker_run(i, dirs[i], fci, fcc TSRMLS_CC);
+		}
+
+		close(sv[1]);
+
+		phurple_worker_peer_init(&phurple_workers.peers[i], (int)pid, sv[0]);
+	}
+
+	g_strfreev(dirs);
+
+	if (FAILURE == ret) {
+		/* a partial fleet would hash the accounts wrong */
+		for (j = 0; j < i; j++) {
+			kill(phurple_workers.peers[j].pid, SIGTERM);
+			waitpid(phurple_workers.peers[j].pid, NULL, 0);
+			phurple_worker_peer_close(&phurple_workers.peers[j]);
+		}
+		g_free(phurple_workers.peers);
+		phurple_workers.peers = NULL;
+		phurple_workers.count = 0;
+	}
+
+	return ret;
+}/*}}}*/
+
+/* Watch the supervisor socket, done once the worker has a client */
+void
+phurple_worker_attach(void)
+{/*{{{*/
+	if (phurple_workers.id < 0 || phurple_workers.watch || phurple_workers.peers[0].fd < 0) {
+		return;
+	}
+
+	phurple_workers.watch = purple_input_add(phurple_workers.peers[0].fd, PURPLE_INPUT_READ, phurple_worker_input, NULL);
+
+	/* notified before the client existed */
+	phurple_worker_watch_output();
+}/*}}}*/
+
+/* Worker to supervisor */
+int
+phurple_worker_notify(char type, zval *value TSRMLS_DC)
+{/*{{{*/
+	if (phurple_workers.id < 0 || phurple_workers.peers[0].fd < 0) {
+		return FAILURE;
+	}
+
+	return phurple_worker_send(&phurple_workers.peers[0], type, value TSRMLS_CC);
+}/*}}}*/
+
+/* A forwardEvents() batch */
+void
+phurple_worker_forward_events(zval *batch TSRMLS_DC)
+{/*{{{*/
+	phurple_worker_notify(PHURPLE_WORKER_FRAME_EVENTS, batch TSRMLS_CC);
+}/*}}}*/
+
+/* Supervisor to worker */
+int
+phurple_worker_post(int id, char type, zval *value TSRMLS_DC)
+{/*{{{*/
+	if (phurple_workers.id >= 0 || id < 0 || id >= phurple_workers.count || phurple_workers.peers[id].fd < 0) {
+		return FAILURE;
+	}
+
+	return phurple_worker_send(&phurple_workers.peers[id], type, value TSRMLS_CC);
+}/*}}}*/
+
+/* Collect what the workers sent within the timeout, ms < 0 waits forever.
+	The frames buffered for the workers are written meanwhile. */
+void
+phurple_workers_read(int timeout, zval *records TSRMLS_DC)
+{/*{{{*/
+	struct pollfd *fds;
+	int *ids, nfds, i;
+	gint64 deadline = timeout >= 0 ? g_get_monotonic_time() / 1000 + timeout : -1;
+
+	array_init(records);
+
+	if (phurple_workers.id >= 0 || !phurple_workers.count) {
+		return;
+	}
+
+	fds = (struct pollfd *) safe_emalloc(phurple_workers.count, sizeof(struct pollfd), 0);
+	ids = (int *) safe_emalloc(phurple_workers.count, sizeof(int), 0);
+
+	/* a writable socket ends the poll early, it goes on until there's input */
+	while (!zend_hash_num_elements(Z_ARRVAL_P(records))) {
+		int wait = -1;
+
+		nfds = 0;
+		for (i = 0; i < phurple_workers.count; i++) {
+			struct phurple_worker_peer *peer = &phurple_workers.peers[i];
+
+			if (peer->fd >= 0) {
+				phurple_worker_drain(peer);
+
+				fds[nfds].fd = peer->fd;
+				fds[nfds].events = POLLIN | (peer->out->len ? POLLOUT : 0);
+				fds[nfds].revents = 0;
+				ids[nfds++] = i;
+			}
+		}
+
+		if (deadline >= 0) {
+			gint64 left = deadline - g_get_monotonic_time() / 1000;
+
+			wait = left > 0 ? (int)left : 0;
+		}
+
+		if (!nfds || poll(fds, nfds, wait) <= 0) {
+			break;
+		}
+
+		for (i = 0; i < nfds; i++) {
+			struct phurple_worker_peer *peer = &phurple_workers.peers[ids[i]];
+			const char *frame;
+			size_t len;
+			char type;
+			int alive;
+
+			if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+				continue;
+			}
+
+			alive = phurple_worker_fill(peer);
+
+			while (phurple_worker_frame(peer, &type, &frame, &len)) {
+				zval *record;
+
+				MAKE_STD_ZVAL(record);
+				array_init(record);
+				add_assoc_long(record, "worker", ids[i]);
+				add_assoc_string(record, "type", PHURPLE_WORKER_FRAME_EVENTS == type ? "events" : "message", 1);
+				add_assoc_zval(record, "data", phurple_worker_unserialize(frame, len TSRMLS_CC));
+				add_next_index_zval(records, record);
+
+				g_string_erase(peer->in, 0, PHURPLE_WORKER_HEADER + len);
+			}
+
+			if (!alive) {
+				zval *record;
+				int status = 0;
+
+				phurple_worker_peer_close(peer);
+
+				MAKE_STD_ZVAL(record);
+				array_init(record);
+				add_assoc_long(record, "worker", ids[i]);
+				add_assoc_string(record, "type", "exit", 1);
+				if (waitpid(peer->pid, &status, 0) > 0 && WIFEXITED(status)) {
+					add_assoc_long(record, "status", WEXITSTATUS(status));
+				} else {
+					add_assoc_long(record, "status", -1);
+				}
+				add_next_index_zval(records, record);
+			}
+		}
+
+		if (!wait && deadline >= 0) {
+			break;
+		}
+	}
+
+	efree(fds);
+	efree(ids);
+}/*}}}*/
+
+/* Close the sockets, the workers see it and leave their loops */
+void
+phurple_workers_shutdown(void)
+{/*{{{*/
+	int i, peers;
+
+	if (!phurple_workers.peers) {
+		return;
+	}
+
+	if (phurple_workers.watch) {
+		purple_input_remove(phurple_workers.watch);
+		phurple_workers.watch = 0;
+	}
+	if (phurple_workers.out_watch) {
+		purple_input_remove(phurple_workers.out_watch);
+		phurple_workers.out_watch = 0;
+	}
+
+	peers = phurple_workers.id >= 0 ? 1 : phurple_workers.count;
+	for (i = 0; i < peers; i++) {
+		/* what the socket takes still, the rest is lost */
+		if (phurple_workers.peers[i].fd >= 0) {
+			phurple_worker_drain(&phurple_workers.peers[i]);
+		}
+		phurple_worker_peer_close(&phurple_workers.peers[i]);
+		if (phurple_workers.id < 0) {
+			/* reap those already gone, init takes the rest */
+			waitpid(phurple_workers.peers[i].pid, NULL, WNOHANG);
+		}
+	}
+
+	g_free(phurple_workers.peers);
+	phurple_workers.peers = NULL;
+	phurple_workers.count = 0;
+	phurple_workers.id = -1;
+}/*}}}*/
+
+#else
+
+int
+phurple_workers_spawn(int count, const char *user_dir, zend_fcall_info *fci, zend_fcall_info_cache *fcc TSRMLS_DC)
+{/*{{{*/
+	zend_throw_exception_ex(PhurpleException_ce, 0 TSRMLS_CC, "Workers aren't supported on this platform");
+	return FAILURE;
+}/*}}}*/
+
+void
+phurple_worker_attach(void)
+{/*{{{*/
+}/*}}}*/
+
+int
+phurple_worker_notify(char type, zval *value TSRMLS_DC)
+{/*{{{*/
+	return FAILURE;
+}/*}}}*/
+
+void
+phurple_worker_forward_events(zval *batch TSRMLS_DC)
+{/*{{{*/
+}/*}}}*/
+
+int
+phurple_worker_post(int id, char type, zval *value TSRMLS_DC)
+{/*{{{*/
+	return FAILURE;
+}/*}}}*/
+
+void
+phurple_workers_read(int timeout, zval *records TSRMLS_DC)
+{/*{{{*/
+	array_init(records);
+}/*}}}*/
+
+void
+phurple_workers_shutdown(void)
+{/*{{{*/
+}/*}}}*/
+
+#endif
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */